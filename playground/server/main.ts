@@ -1,9 +1,7 @@
 /* Compiler Server */
 
-import { ExecException, exec } from 'child_process'
+import { ChildProcessWithoutNullStreams, spawn } from 'child_process'
 import express, { Express, Request, Response } from 'express'
-import tmp from 'tmp'
-import fs from 'node:fs'
 import { StatusCodes } from 'http-status-codes'
 
 interface CompilerInput {
@@ -26,6 +24,77 @@ interface CompilerOutput {
   compilerStdErr: string
 }
 
+/* Client for a resident `pixelc --serve` process.
+ *
+ * Requests and responses are sequences of fields framed as `<length>\n<bytes>`
+ * (see src/server.hh). The compiler answers requests in order, so pending
+ * requests are kept in a FIFO queue.
+ */
+class CompileServer {
+  private proc: ChildProcessWithoutNullStreams | undefined
+  private buffer: Buffer = Buffer.alloc(0)
+  private pending: Array<{
+    resolve: (fields: Array<string>) => void
+    reject: (err: Error) => void
+  }> = []
+
+  private start(): ChildProcessWithoutNullStreams {
+    const proc = spawn('../pixelc', ['--serve'])
+    proc.stdout.on('data', (chunk: Buffer) => {
+      this.buffer = Buffer.concat([this.buffer, chunk])
+      this.drain()
+    })
+    proc.stderr.on('data', (chunk: Buffer) => console.log(chunk.toString()))
+    proc.on('exit', () => this.fail(proc, Error('Compiler exited.')))
+    // the compiler failed to start, or its stdin closed under a request.
+    proc.on('error', (err: Error) => this.fail(proc, err))
+    proc.stdin.on('error', (err: Error) => this.fail(proc, err))
+    return proc
+  }
+
+  /* Fail outstanding requests; the next request restarts the compiler. */
+  private fail(proc: ChildProcessWithoutNullStreams, err: Error) {
+    // the compiler already failed, e.g. exiting after an error.
+    if (this.proc !== proc) return
+    this.proc = undefined
+    this.buffer = Buffer.alloc(0)
+    proc.kill()
+    for (const { reject } of this.pending.splice(0)) reject(err)
+  }
+
+  /* Parse as many complete responses out of the buffer as possible. */
+  private drain() {
+    while (this.pending.length > 0) {
+      const fields: Array<string> = []
+      let offset = 0
+      for (let i = 0; i < 4; i++) {
+        const newline = this.buffer.indexOf('\n', offset)
+        if (newline == -1) return
+        const size = parseInt(this.buffer.subarray(offset, newline).toString('ascii'))
+        if (newline + 1 + size > this.buffer.length) return
+        fields.push(this.buffer.subarray(newline + 1, newline + 1 + size).toString('utf8'))
+        offset = newline + 1 + size
+      }
+      this.buffer = this.buffer.subarray(offset)
+      this.pending.shift()!.resolve(fields)
+    }
+  }
+
+  public compile(srcCode: string, compilerOpts: string): Promise<Array<string>> {
+    if (this.proc === undefined) this.proc = this.start()
+    const frame = (field: string) => {
+      const bytes = Buffer.from(field, 'utf8')
+      return Buffer.concat([Buffer.from(`${bytes.length}\n`, 'ascii'), bytes])
+    }
+    return new Promise((resolve, reject) => {
+      this.pending.push({ resolve, reject })
+      this.proc!.stdin.write(Buffer.concat([frame(compilerOpts), frame(srcCode)]))
+    })
+  }
+}
+
+const compileServer = new CompileServer()
+
 const app: Express = express()
 app.use(express.json())
 
@@ -42,37 +111,22 @@ app.post('/compile', function (req: Request, res: Response) {
     return
   }
 
-  const sourceFile = tmp.fileSync({ mode: 0o644, prefix: 'pixel-src-', postfix: '.pix' })
-  const asmOutFile = tmp.fileSync({ mode: 0o644, prefix: 'pixel-asm-', postfix: '.pixardis' })
-  const xmlOutFile = tmp.fileSync({ mode: 0o644, prefix: 'pixel-xml-', postfix: '.xml' })
-
-  try {
-    fs.writeFileSync(sourceFile.name, input.srcCode, { encoding: 'ascii' })
-  } catch (err) {
-    console.log(err)
-    res.status(StatusCodes.INTERNAL_SERVER_ERROR).send('Internal Server Error. Try again later.')
-    return
-  }
-
-  exec(
-    `../pixelc ${input.compilerOpts || ''} -o ${asmOutFile.name} -xml ${xmlOutFile.name} ${sourceFile.name}`,
-    (error: ExecException | null, stdout: string, stderr: string) => {
+  compileServer
+    .compile(input.srcCode, input.compilerOpts || '')
+    .then(([status, asmOutput, xmlOutput, diagnostics]) => {
+      // the compiler does not output any assembly or XML if compilation failed.
       const output: CompilerOutput = {
-        asmOutput: fs.readFileSync(asmOutFile.name, { encoding: 'ascii' }),
-        xmlOutput: fs.readFileSync(xmlOutFile.name, { encoding: 'ascii' }),
-        compilerStdOut: stdout,
-        compilerStdErr: stderr
+        asmOutput,
+        xmlOutput,
+        compilerStdOut: '',
+        compilerStdErr: status == 'ok' ? '' : diagnostics
       }
-
-      if (error !== null) {
-        // make sure we don't output any assembly or XML if compiler didn't exit successfully
-        output.asmOutput = ''
-        output.xmlOutput = ''
-      }
-
       res.status(StatusCodes.OK).send(output)
-    }
-  )
+    })
+    .catch((err) => {
+      console.log(err)
+      res.status(StatusCodes.INTERNAL_SERVER_ERROR).send('Internal Server Error. Try again later.')
+    })
 })
 
 app.listen(port, function () {
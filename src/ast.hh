@@ -5,6 +5,7 @@
 #include "visitor.hh"
 
 #include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <numeric>
 #include <string>
@@ -13,16 +14,112 @@
 namespace ast
 {
 
+  // identifies the concrete class of a node, so passes can branch on it with a
+  // switch instead of virtual calls or RTTI.
+  enum NodeKind : uint8_t
+  {
+    // types
+    INT_TYPE_NODE,
+    FLOAT_TYPE_NODE,
+    COLOUR_TYPE_NODE,
+    BOOL_TYPE_NODE,
+    ARRAY_TYPE_NODE,
+    FUNCTION_TYPE_NODE,
+
+    // expressions
+    BINARY_EXPR_NODE,
+    UNARY_EXPR_NODE,
+    FUNCTION_CALL_NODE,
+    ARRAY_ACCESS_NODE,
+    ID_EXPR_NODE,
+    BOOL_LITERAL_EXPR_NODE,
+    INT_LITERAL_EXPR_NODE,
+    FLOAT_LITERAL_EXPR_NODE,
+    COLOUR_LITERAL_EXPR_NODE,
+    PAD_WIDTH_EXPR_NODE,
+    PAD_HEIGHT_EXPR_NODE,
+    READ_EXPR_NODE,
+    RANDI_EXPR_NODE,
+    NEW_ARR_EXPR_NODE,
+    GET_CHAR_NODE,
+    FLOAT2INT_NODE,
+
+    // statements
+    ASSIGNMENT_STMT,
+    VARIABLE_DECL_STMT,
+    PRINT_STMT,
+    DELAY_STMT,
+    PIXEL_STMT,
+    PIXEL_R_STMT,
+    RETURN_STMT,
+    PUT_CHAR_STMT,
+    IF_ELSE_STMT,
+    FOR_STMT,
+    WHILE_STMT,
+    FUNC_DECL_STMT,
+    BLOCK_STMT,
+
+    TRANSLATION_UNIT,
+  };
+
+  class ASTNode;
+  using ASTNodePtr = std::unique_ptr<ASTNode>;
+
   class ASTNode
   {
   public:
+    const NodeKind kind;
     Location loc;
-    ASTNode(Location loc) : loc(loc) {}
+    ASTNode(NodeKind kind, Location loc) : kind(kind), loc(loc) {}
 
-    virtual void accept(AbstractVisitor *v) = 0;
+    // runs v over the subtree rooted at this node.
+    void accept(AbstractVisitor *v) { v->traverse(this); }
     virtual std::vector<ASTNode *> children() = 0;
 
+    // whether this node is a T, for a concrete node class T.
+    template <typename T>
+    bool is() const { return kind == T::KIND; }
+
+    // this node as a T, or nullptr if it is something else.
+    template <typename T>
+    T *as() { return is<T>() ? static_cast<T *>(this) : nullptr; }
+    template <typename T>
+    const T *as() const
+    {
+      return is<T>() ? static_cast<const T *>(this) : nullptr;
+    }
+
     virtual ~ASTNode() {}
+
+  protected:
+    // moves the children owned by this node into out.
+    virtual void releaseChildren(std::vector<ASTNodePtr> &out) {}
+
+    template <typename T>
+    static void release(std::vector<ASTNodePtr> &out, std::unique_ptr<T> &child)
+    {
+      if (child != nullptr)
+      {
+        out.push_back(std::move(child));
+      }
+    }
+
+    // destroys the subtree below this node from a worklist rather than through
+    // nested destructors, which would overflow the stack on deep ASTs. Called
+    // by the destructor of every node with children.
+    void destroyChildren()
+    {
+      std::vector<ASTNodePtr> pending;
+      releaseChildren(pending);
+      while (!pending.empty())
+      {
+        ASTNodePtr node = std::move(pending.back());
+        pending.pop_back();
+        // node has no children left once this returns, so its own
+        // destroyChildren() does nothing.
+        node->releaseChildren(pending);
+      }
+    }
   };
 
   class TypeNode;
@@ -39,7 +136,7 @@ namespace ast
 
     bool operator==(const TypeNode &other) const
     {
-      if (typeid(*this) != typeid(other))
+      if (kind != other.kind)
       {
         return false;
       }
@@ -48,8 +145,8 @@ namespace ast
 
     bool operator!=(const TypeNode &other) const { return !(*this == other); }
 
-    virtual bool isFuncType() const { return false; }
-    virtual bool isArrType() const { return false; }
+    bool isFuncType() const { return kind == FUNCTION_TYPE_NODE; }
+    bool isArrType() const { return kind == ARRAY_TYPE_NODE; }
 
   protected:
     virtual bool equals(const TypeNode &) const = 0;
@@ -58,10 +155,12 @@ namespace ast
   class IntTypeNode : public TypeNode
   {
   public:
-    using TypeNode::TypeNode;
+    static const NodeKind KIND = INT_TYPE_NODE;
+
+    IntTypeNode(Location loc) : TypeNode(KIND, loc) {}
 
     // useful in the type checker
-    IntTypeNode() : TypeNode(Location{}) {}
+    IntTypeNode() : TypeNode(KIND, Location{}) {}
 
     TypeNodePtr copy() const override
     {
@@ -70,7 +169,6 @@ namespace ast
 
     std::string to_string() const override { return "int"; };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
 
   protected:
@@ -80,10 +178,12 @@ namespace ast
   class FloatTypeNode : public TypeNode
   {
   public:
-    using TypeNode::TypeNode;
+    static const NodeKind KIND = FLOAT_TYPE_NODE;
+
+    FloatTypeNode(Location loc) : TypeNode(KIND, loc) {}
 
     // useful in the type checker
-    FloatTypeNode() : TypeNode(Location{}) {}
+    FloatTypeNode() : TypeNode(KIND, Location{}) {}
 
     TypeNodePtr copy() const override
     {
@@ -92,7 +192,6 @@ namespace ast
 
     std::string to_string() const override { return "float"; };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
 
   protected:
@@ -102,10 +201,12 @@ namespace ast
   class ColourTypeNode : public TypeNode
   {
   public:
-    using TypeNode::TypeNode;
+    static const NodeKind KIND = COLOUR_TYPE_NODE;
+
+    ColourTypeNode(Location loc) : TypeNode(KIND, loc) {}
 
     // useful in the type checker
-    ColourTypeNode() : TypeNode(Location{}) {}
+    ColourTypeNode() : TypeNode(KIND, Location{}) {}
 
     TypeNodePtr copy() const override
     {
@@ -114,7 +215,6 @@ namespace ast
 
     std::string to_string() const override { return "colour"; };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
 
   protected:
@@ -124,10 +224,12 @@ namespace ast
   class BoolTypeNode : public TypeNode
   {
   public:
-    using TypeNode::TypeNode;
+    static const NodeKind KIND = BOOL_TYPE_NODE;
+
+    BoolTypeNode(Location loc) : TypeNode(KIND, loc) {}
 
     // useful in the type checker
-    BoolTypeNode() : TypeNode(Location{}) {}
+    BoolTypeNode() : TypeNode(KIND, Location{}) {}
 
     TypeNodePtr copy() const override
     {
@@ -136,7 +238,6 @@ namespace ast
 
     std::string to_string() const override { return "bool"; };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
 
   protected:
@@ -146,10 +247,12 @@ namespace ast
   class ArrayTypeNode : public TypeNode
   {
   public:
+    static const NodeKind KIND = ARRAY_TYPE_NODE;
+
     TypeNodePtr contained;
 
     ArrayTypeNode(TypeNodePtr &&contained, Location loc)
-        : TypeNode(loc), contained(std::move(contained)) {}
+        : TypeNode(KIND, loc), contained(std::move(contained)) {}
 
     TypeNodePtr copy() const override
     {
@@ -161,10 +264,9 @@ namespace ast
       return "[]" + contained->to_string();
     };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
-    std::vector<ASTNode *> children() override { return {contained.get()}; };
+    ~ArrayTypeNode() override { destroyChildren(); }
 
-    bool isArrType() const override { return true; }
+    std::vector<ASTNode *> children() override { return {contained.get()}; };
 
   protected:
     bool equals(const TypeNode &other) const override
@@ -173,19 +275,30 @@ namespace ast
           static_cast<const ArrayTypeNode *>(&other);
       return *this->contained == *arrTypeOther->contained;
     }
+
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, contained);
+    }
   };
 
   class FunctionTypeNode : public TypeNode
   {
   public:
+    static const NodeKind KIND = FUNCTION_TYPE_NODE;
+
     TypeNodePtr retType;
     std::vector<TypeNodePtr> argTypes;
 
     FunctionTypeNode(TypeNodePtr &&retType, std::vector<TypeNodePtr> &&argTypes,
                      Location loc)
-        : TypeNode(loc), retType(std::move(retType)),
+        : TypeNode(KIND, loc), retType(std::move(retType)),
           argTypes(std::move(argTypes)) {}
 
+    // held by value in the semantic checker's scopes. Declaring the destructor
+    // would otherwise suppress the implicit move constructor.
+    FunctionTypeNode(FunctionTypeNode &&) = default;
+
     TypeNodePtr copy() const override
     {
       std::vector<TypeNodePtr> argTypesCopy(argTypes.size());
@@ -210,7 +323,8 @@ namespace ast
              ")";
     };
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~FunctionTypeNode() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children(1 + argTypes.size());
@@ -221,8 +335,6 @@ namespace ast
       return children;
     };
 
-    bool isFuncType() const override { return true; }
-
   protected:
     bool equals(const TypeNode &other) const override
     {
@@ -249,6 +361,15 @@ namespace ast
 
       return true;
     }
+
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, retType);
+      for (auto &argType : argTypes)
+      {
+        release(out, argType);
+      }
+    }
   };
 
   class ExprNode : public ASTNode
@@ -262,6 +383,8 @@ namespace ast
   class BinaryExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = BINARY_EXPR_NODE;
+
     enum BinaryOp
     {
       ADD,
@@ -283,18 +406,28 @@ namespace ast
 
     BinaryExprNode(BinaryOp op, ExprNodePtr &&left, ExprNodePtr &&right,
                    Location loc)
-        : ExprNode(loc), op(op), left(std::move(left)), right(std::move(right)) {}
+        : ExprNode(KIND, loc), op(op), left(std::move(left)), right(std::move(right)) {}
+
+    ~BinaryExprNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       return {left.get(), right.get()};
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, left);
+      release(out, right);
+    }
   };
 
   class UnaryExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = UNARY_EXPR_NODE;
+
     enum UnaryOp
     {
       MINUS,
@@ -305,23 +438,33 @@ namespace ast
     ExprNodePtr operand;
 
     UnaryExprNode(UnaryOp op, ExprNodePtr &&operand, Location loc)
-        : ExprNode(loc), op(op), operand(std::move(operand)) {}
+        : ExprNode(KIND, loc), op(op), operand(std::move(operand)) {}
+
+    ~UnaryExprNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {operand.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, operand);
+    }
   };
 
   class FunctionCallNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = FUNCTION_CALL_NODE;
+
     std::string funcName;
     std::vector<ExprNodePtr> args;
 
     FunctionCallNode(std::string &funcName, std::vector<ExprNodePtr> &&args,
                      Location loc)
-        : ExprNode(loc), funcName(funcName), args(std::move(args)) {}
+        : ExprNode(KIND, loc), funcName(funcName), args(std::move(args)) {}
+
+    ~FunctionCallNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children(args.size());
@@ -330,158 +473,224 @@ namespace ast
                      { return arg.get(); });
       return children;
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      for (auto &arg : args)
+      {
+        release(out, arg);
+      }
+    }
   };
 
   class ArrayAccessNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = ARRAY_ACCESS_NODE;
+
     ExprNodePtr array;
     ExprNodePtr idx;
     bool isLValue;
 
     ArrayAccessNode(ExprNodePtr &&array, ExprNodePtr &&idx, bool isLValue,
                     Location loc)
-        : ExprNode(loc), array(std::move(array)), idx(std::move(idx)) {}
+        : ExprNode(KIND, loc), array(std::move(array)), idx(std::move(idx)),
+          isLValue(isLValue) {}
+
+    ~ArrayAccessNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       return {array.get(), idx.get()};
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, array);
+      release(out, idx);
+    }
   };
 
   class IdExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = ID_EXPR_NODE;
+
     std::string id;
     bool isLValue;
 
     IdExprNode(std::string &id, bool isLValue, Location loc)
-        : ExprNode(loc), id(id), isLValue(isLValue) {}
+        : ExprNode(KIND, loc), id(id), isLValue(isLValue) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class BoolLiteralExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = BOOL_LITERAL_EXPR_NODE;
+
     bool x;
 
-    BoolLiteralExprNode(bool x, Location loc) : ExprNode(loc), x(x) {}
+    BoolLiteralExprNode(bool x, Location loc) : ExprNode(KIND, loc), x(x) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class IntLiteralExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = INT_LITERAL_EXPR_NODE;
+
     int x;
 
-    IntLiteralExprNode(int x, Location loc) : ExprNode(loc), x(x) {}
+    IntLiteralExprNode(int x, Location loc) : ExprNode(KIND, loc), x(x) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class FloatLiteralExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = FLOAT_LITERAL_EXPR_NODE;
+
     float x;
 
-    FloatLiteralExprNode(float x, Location loc) : ExprNode(loc), x(x) {}
+    FloatLiteralExprNode(float x, Location loc) : ExprNode(KIND, loc), x(x) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class ColourLiteralExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = COLOUR_LITERAL_EXPR_NODE;
+
     unsigned colour;
 
     ColourLiteralExprNode(unsigned colour, Location loc)
-        : ExprNode(loc), colour(colour) {}
+        : ExprNode(KIND, loc), colour(colour) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class PadWidthExprNode : public ExprNode
   {
   public:
-    using ExprNode::ExprNode;
+    static const NodeKind KIND = PAD_WIDTH_EXPR_NODE;
+
+    PadWidthExprNode(Location loc) : ExprNode(KIND, loc) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class PadHeightExprNode : public ExprNode
   {
   public:
-    using ExprNode::ExprNode;
+    static const NodeKind KIND = PAD_HEIGHT_EXPR_NODE;
+
+    PadHeightExprNode(Location loc) : ExprNode(KIND, loc) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class ReadExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = READ_EXPR_NODE;
+
     ExprNodePtr x, y;
 
     ReadExprNode(ExprNodePtr &&x, ExprNodePtr &&y, Location loc)
-        : ExprNode(loc), x(std::move(x)), y(std::move(y)) {}
+        : ExprNode(KIND, loc), x(std::move(x)), y(std::move(y)) {}
+
+    ~ReadExprNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {x.get(), y.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, x);
+      release(out, y);
+    }
   };
 
   class RandiExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = RANDI_EXPR_NODE;
+
     ExprNodePtr operand;
 
     RandiExprNode(ExprNodePtr &&operand, Location loc)
-        : ExprNode(loc), operand(std::move(operand)) {}
+        : ExprNode(KIND, loc), operand(std::move(operand)) {}
+
+    ~RandiExprNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {operand.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, operand);
+    }
   };
 
   class NewArrExprNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = NEW_ARR_EXPR_NODE;
+
     TypeNodePtr ofType;
     ExprNodePtr operand;
 
     NewArrExprNode(TypeNodePtr &&ofType, ExprNodePtr &&operand, Location loc)
-        : ExprNode(loc), ofType(std::move(ofType)), operand(std::move(operand)) {}
+        : ExprNode(KIND, loc), ofType(std::move(ofType)), operand(std::move(operand)) {}
+
+    ~NewArrExprNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {operand.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, ofType);
+      release(out, operand);
+    }
   };
 
   class GetCharNode : public ExprNode
   {
   public:
-    using ExprNode::ExprNode;
+    static const NodeKind KIND = GET_CHAR_NODE;
+
+    GetCharNode(Location loc) : ExprNode(KIND, loc) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {}; };
   };
 
   class Float2IntNode : public ExprNode
   {
   public:
+    static const NodeKind KIND = FLOAT2INT_NODE;
+
     ExprNodePtr operand;
 
     Float2IntNode(ExprNodePtr &&operand, Location loc)
-        : ExprNode(loc), operand(std::move(operand)) {}
+        : ExprNode(KIND, loc), operand(std::move(operand)) {}
+
+    ~Float2IntNode() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {operand.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, operand);
+    }
   };
 
   class StmtNode : public ASTNode
@@ -495,136 +704,219 @@ namespace ast
   class AssignmentStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = ASSIGNMENT_STMT;
+
     ExprNodePtr lvalue;
     ExprNodePtr expr;
 
     AssignmentStmt(ExprNodePtr &&lvalue, ExprNodePtr &&expr, Location loc)
-        : StmtNode(loc), lvalue(std::move(lvalue)), expr(std::move(expr)) {}
+        : StmtNode(KIND, loc), lvalue(std::move(lvalue)), expr(std::move(expr)) {}
+
+    ~AssignmentStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       return {lvalue.get(), expr.get()};
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, lvalue);
+      release(out, expr);
+    }
   };
 
   class VariableDeclStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = VARIABLE_DECL_STMT;
+
     std::string id;
     TypeNodePtr type;
     ExprNodePtr initExpr;
 
     VariableDeclStmt(std::string &id, TypeNodePtr &&type, ExprNodePtr &&initExpr,
                      Location loc)
-        : StmtNode(loc), id(id), type(std::move(type)),
+        : StmtNode(KIND, loc), id(id), type(std::move(type)),
           initExpr(std::move(initExpr)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~VariableDeclStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       return {type.get(), initExpr.get()};
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, type);
+      release(out, initExpr);
+    }
   };
 
   class PrintStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = PRINT_STMT;
+
     ExprNodePtr expr;
 
     PrintStmt(ExprNodePtr &&expr, Location loc)
-        : StmtNode(loc), expr(std::move(expr)) {}
+        : StmtNode(KIND, loc), expr(std::move(expr)) {}
+
+    ~PrintStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {expr.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, expr);
+    }
   };
 
   class DelayStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = DELAY_STMT;
+
     ExprNodePtr expr;
 
     DelayStmt(ExprNodePtr &&expr, Location loc)
-        : StmtNode(loc), expr(std::move(expr)) {}
+        : StmtNode(KIND, loc), expr(std::move(expr)) {}
+
+    ~DelayStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {expr.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, expr);
+    }
   };
 
   class PixelStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = PIXEL_STMT;
+
     ExprNodePtr x, y;
     ExprNodePtr colour;
 
     PixelStmt(ExprNodePtr &&x, ExprNodePtr &&y, ExprNodePtr &&colour,
               Location loc)
-        : StmtNode(loc), x(std::move(x)), y(std::move(y)),
+        : StmtNode(KIND, loc), x(std::move(x)), y(std::move(y)),
           colour(std::move(colour)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~PixelStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       return {x.get(), y.get(), colour.get()};
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, x);
+      release(out, y);
+      release(out, colour);
+    }
   };
 
   class PixelRStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = PIXEL_R_STMT;
+
     ExprNodePtr x, y;
     ExprNodePtr w, h;
     ExprNodePtr colour;
 
     PixelRStmt(ExprNodePtr &&x, ExprNodePtr &&y, ExprNodePtr &&w, ExprNodePtr &&h,
                ExprNodePtr &&colour, Location loc)
-        : StmtNode(loc), x(std::move(x)), y(std::move(y)), w(std::move(w)),
+        : StmtNode(KIND, loc), x(std::move(x)), y(std::move(y)), w(std::move(w)),
           h(std::move(h)), colour(std::move(colour)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~PixelRStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       return {x.get(), y.get(), w.get(), h.get(), colour.get()};
     };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, x);
+      release(out, y);
+      release(out, w);
+      release(out, h);
+      release(out, colour);
+    }
   };
 
   class ReturnStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = RETURN_STMT;
+
     ExprNodePtr expr;
 
     ReturnStmt(ExprNodePtr &&expr, Location loc)
-        : StmtNode(loc), expr(std::move(expr)) {}
+        : StmtNode(KIND, loc), expr(std::move(expr)) {}
+
+    ~ReturnStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {expr.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, expr);
+    }
   };
 
   class PutCharStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = PUT_CHAR_STMT;
+
     ExprNodePtr expr;
 
     PutCharStmt(ExprNodePtr &&expr, Location loc)
-        : StmtNode(loc), expr(std::move(expr)) {}
+        : StmtNode(KIND, loc), expr(std::move(expr)) {}
+
+    ~PutCharStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override { return {expr.get()}; };
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, expr);
+    }
   };
 
   class IfElseStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = IF_ELSE_STMT;
+
     ExprNodePtr cond;
     StmtNodePtr ifBody;
     StmtNodePtr elseBody;
 
     IfElseStmt(ExprNodePtr &&cond, StmtNodePtr &&ifBody, StmtNodePtr &&elseBody,
                Location loc)
-        : StmtNode(loc), cond(std::move(cond)), ifBody(std::move(ifBody)),
+        : StmtNode(KIND, loc), cond(std::move(cond)), ifBody(std::move(ifBody)),
           elseBody(std::move(elseBody)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~IfElseStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children{cond.get(), ifBody.get()};
@@ -634,11 +926,21 @@ namespace ast
       }
       return children;
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, cond);
+      release(out, ifBody);
+      release(out, elseBody);
+    }
   };
 
   class ForStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = FOR_STMT;
+
     StmtNodePtr varDecl;
     ExprNodePtr cond;
     StmtNodePtr assignment;
@@ -646,30 +948,50 @@ namespace ast
 
     ForStmt(StmtNodePtr &&varDecl, ExprNodePtr &&cond, StmtNodePtr &&assignment,
             StmtNodePtr &&body, Location loc)
-        : StmtNode(loc), varDecl(std::move(varDecl)), cond(std::move(cond)),
+        : StmtNode(KIND, loc), varDecl(std::move(varDecl)), cond(std::move(cond)),
           assignment(std::move(assignment)), body(std::move(body)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~ForStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       return {varDecl.get(), cond.get(), assignment.get(), body.get()};
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, varDecl);
+      release(out, cond);
+      release(out, assignment);
+      release(out, body);
+    }
   };
 
   class WhileStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = WHILE_STMT;
+
     ExprNodePtr cond;
     StmtNodePtr body;
 
     WhileStmt(ExprNodePtr &&cond, StmtNodePtr &&body, Location loc)
-        : StmtNode(loc), cond(std::move(cond)), body(std::move(body)) {}
+        : StmtNode(KIND, loc), cond(std::move(cond)), body(std::move(body)) {}
+
+    ~WhileStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       return {cond.get(), body.get()};
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      release(out, cond);
+      release(out, body);
+    }
   };
 
   using FormalParam = std::pair<std::string, TypeNodePtr>;
@@ -677,6 +999,8 @@ namespace ast
   class FuncDeclStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = FUNC_DECL_STMT;
+
     std::string funcName;
     std::vector<FormalParam> params;
     TypeNodePtr retType;
@@ -684,10 +1008,11 @@ namespace ast
 
     FuncDeclStmt(std::string &funcName, std::vector<FormalParam> &&params,
                  TypeNodePtr &&retType, StmtNodePtr &&body, Location loc)
-        : StmtNode(loc), funcName(funcName), params(std::move(params)),
+        : StmtNode(KIND, loc), funcName(funcName), params(std::move(params)),
           retType(std::move(retType)), body(std::move(body)) {}
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
+    ~FuncDeclStmt() override { destroyChildren(); }
+
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children(params.size() + 2);
@@ -701,17 +1026,31 @@ namespace ast
 
       return children;
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      for (FormalParam &param : params)
+      {
+        release(out, param.second);
+      }
+      release(out, retType);
+      release(out, body);
+    }
   };
 
   class BlockStmt : public StmtNode
   {
   public:
+    static const NodeKind KIND = BLOCK_STMT;
+
     std::vector<StmtNodePtr> stmts;
 
     BlockStmt(std::vector<StmtNodePtr> &&stmts, Location loc)
-        : StmtNode(loc), stmts(std::move(stmts)) {}
+        : StmtNode(KIND, loc), stmts(std::move(stmts)) {}
+
+    ~BlockStmt() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children(stmts.size());
@@ -720,17 +1059,29 @@ namespace ast
                      { return stmt.get(); });
       return children;
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      for (auto &stmt : stmts)
+      {
+        release(out, stmt);
+      }
+    }
   };
 
   class TranslationUnit : public StmtNode
   {
   public:
+    static const NodeKind KIND = TRANSLATION_UNIT;
+
     std::vector<StmtNodePtr> stmts;
 
     TranslationUnit(std::vector<StmtNodePtr> &&stmts, Location loc)
-        : StmtNode(loc), stmts(std::move(stmts)) {}
+        : StmtNode(KIND, loc), stmts(std::move(stmts)) {}
+
+    ~TranslationUnit() override { destroyChildren(); }
 
-    void accept(AbstractVisitor *v) override { v->visit(*this); }
     std::vector<ASTNode *> children() override
     {
       std::vector<ASTNode *> children(stmts.size());
@@ -739,8 +1090,135 @@ namespace ast
                      { return stmt.get(); });
       return children;
     }
+
+  protected:
+    void releaseChildren(std::vector<ASTNodePtr> &out) override
+    {
+      for (auto &stmt : stmts)
+      {
+        release(out, stmt);
+      }
+    }
   };
 
+  template <typename V>
+  void visitNode(V &v, ASTNode &node)
+  {
+    switch (node.kind)
+    {
+    case IntTypeNode::KIND:
+      v.visit(static_cast<IntTypeNode &>(node));
+      break;
+    case FloatTypeNode::KIND:
+      v.visit(static_cast<FloatTypeNode &>(node));
+      break;
+    case ColourTypeNode::KIND:
+      v.visit(static_cast<ColourTypeNode &>(node));
+      break;
+    case BoolTypeNode::KIND:
+      v.visit(static_cast<BoolTypeNode &>(node));
+      break;
+    case ArrayTypeNode::KIND:
+      v.visit(static_cast<ArrayTypeNode &>(node));
+      break;
+    case FunctionTypeNode::KIND:
+      // visiting function types is optional, so V may not declare an overload.
+      static_cast<AbstractVisitor &>(v).visit(
+          static_cast<FunctionTypeNode &>(node));
+      break;
+    case BinaryExprNode::KIND:
+      v.visit(static_cast<BinaryExprNode &>(node));
+      break;
+    case UnaryExprNode::KIND:
+      v.visit(static_cast<UnaryExprNode &>(node));
+      break;
+    case FunctionCallNode::KIND:
+      v.visit(static_cast<FunctionCallNode &>(node));
+      break;
+    case ArrayAccessNode::KIND:
+      v.visit(static_cast<ArrayAccessNode &>(node));
+      break;
+    case IdExprNode::KIND:
+      v.visit(static_cast<IdExprNode &>(node));
+      break;
+    case BoolLiteralExprNode::KIND:
+      v.visit(static_cast<BoolLiteralExprNode &>(node));
+      break;
+    case IntLiteralExprNode::KIND:
+      v.visit(static_cast<IntLiteralExprNode &>(node));
+      break;
+    case FloatLiteralExprNode::KIND:
+      v.visit(static_cast<FloatLiteralExprNode &>(node));
+      break;
+    case ColourLiteralExprNode::KIND:
+      v.visit(static_cast<ColourLiteralExprNode &>(node));
+      break;
+    case PadWidthExprNode::KIND:
+      v.visit(static_cast<PadWidthExprNode &>(node));
+      break;
+    case PadHeightExprNode::KIND:
+      v.visit(static_cast<PadHeightExprNode &>(node));
+      break;
+    case ReadExprNode::KIND:
+      v.visit(static_cast<ReadExprNode &>(node));
+      break;
+    case RandiExprNode::KIND:
+      v.visit(static_cast<RandiExprNode &>(node));
+      break;
+    case NewArrExprNode::KIND:
+      v.visit(static_cast<NewArrExprNode &>(node));
+      break;
+    case GetCharNode::KIND:
+      v.visit(static_cast<GetCharNode &>(node));
+      break;
+    case Float2IntNode::KIND:
+      v.visit(static_cast<Float2IntNode &>(node));
+      break;
+    case AssignmentStmt::KIND:
+      v.visit(static_cast<AssignmentStmt &>(node));
+      break;
+    case VariableDeclStmt::KIND:
+      v.visit(static_cast<VariableDeclStmt &>(node));
+      break;
+    case PrintStmt::KIND:
+      v.visit(static_cast<PrintStmt &>(node));
+      break;
+    case DelayStmt::KIND:
+      v.visit(static_cast<DelayStmt &>(node));
+      break;
+    case PixelStmt::KIND:
+      v.visit(static_cast<PixelStmt &>(node));
+      break;
+    case PixelRStmt::KIND:
+      v.visit(static_cast<PixelRStmt &>(node));
+      break;
+    case ReturnStmt::KIND:
+      v.visit(static_cast<ReturnStmt &>(node));
+      break;
+    case PutCharStmt::KIND:
+      v.visit(static_cast<PutCharStmt &>(node));
+      break;
+    case IfElseStmt::KIND:
+      v.visit(static_cast<IfElseStmt &>(node));
+      break;
+    case ForStmt::KIND:
+      v.visit(static_cast<ForStmt &>(node));
+      break;
+    case WhileStmt::KIND:
+      v.visit(static_cast<WhileStmt &>(node));
+      break;
+    case FuncDeclStmt::KIND:
+      v.visit(static_cast<FuncDeclStmt &>(node));
+      break;
+    case BlockStmt::KIND:
+      v.visit(static_cast<BlockStmt &>(node));
+      break;
+    case TranslationUnit::KIND:
+      v.visit(static_cast<TranslationUnit &>(node));
+      break;
+    }
+  }
+
 } // namespace ast
 
 #endif // AST_H_
@@ -0,0 +1,899 @@
+#include "ast_binary.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ast
+{
+
+  static const std::string_view MAGIC{"\0PXAST", 6};
+  static const uint8_t FORMAT_VERSION = 1;
+
+  // tags identifying the kind of each serialized node. Tags only ever get
+  // appended, so older files keep their meaning.
+  enum NodeTag : uint8_t
+  {
+    NULL_TAG, // absent optional child, e.g. a missing else branch
+
+    // types
+    INT_TYPE_TAG,
+    FLOAT_TYPE_TAG,
+    COLOUR_TYPE_TAG,
+    BOOL_TYPE_TAG,
+    ARRAY_TYPE_TAG,
+    FUNCTION_TYPE_TAG,
+
+    // expressions
+    BINARY_EXPR_TAG,
+    UNARY_EXPR_TAG,
+    FUNCTION_CALL_TAG,
+    ID_EXPR_TAG,
+    BOOL_LITERAL_TAG,
+    INT_LITERAL_TAG,
+    FLOAT_LITERAL_TAG,
+    COLOUR_LITERAL_TAG,
+    PAD_WIDTH_TAG,
+    PAD_HEIGHT_TAG,
+    READ_EXPR_TAG,
+    RANDI_EXPR_TAG,
+    NEW_ARR_EXPR_TAG,
+    ARRAY_ACCESS_TAG,
+    GET_CHAR_TAG,
+    FLOAT2INT_TAG,
+
+    // statements
+    ASSIGNMENT_STMT_TAG,
+    VARIABLE_DECL_STMT_TAG,
+    PRINT_STMT_TAG,
+    DELAY_STMT_TAG,
+    PIXEL_STMT_TAG,
+    PIXELR_STMT_TAG,
+    RETURN_STMT_TAG,
+    PUT_CHAR_STMT_TAG,
+    IF_ELSE_STMT_TAG,
+    FOR_STMT_TAG,
+    WHILE_STMT_TAG,
+    FUNC_DECL_STMT_TAG,
+    BLOCK_STMT_TAG,
+    TRANSLATION_UNIT_TAG,
+  };
+
+  static uint64_t zigzag(int64_t x)
+  {
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+  }
+
+  static int64_t unzigzag(uint64_t x)
+  {
+    return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+  }
+
+  class BinaryASTWriter final : public Visitor<BinaryASTWriter>
+  {
+  private:
+    // nodes are encoded before the identifier table is complete, so they are
+    // buffered here and written after the table.
+    std::string body;
+
+    std::unordered_map<std::string, uint64_t> idIndices;
+    std::vector<const std::string *> ids;
+
+    uint32_t prevLine = 0;
+
+    void putVarint(uint64_t x)
+    {
+      while (x >= 0x80)
+      {
+        body.push_back(static_cast<char>((x & 0x7f) | 0x80));
+        x >>= 7;
+      }
+      body.push_back(static_cast<char>(x));
+    }
+
+    void putId(const std::string &id)
+    {
+      auto [it, inserted] = idIndices.try_emplace(id, ids.size());
+      if (inserted)
+      {
+        ids.push_back(&it->first);
+      }
+      putVarint(it->second);
+    }
+
+    void putHeader(NodeTag tag, const ASTNode &node)
+    {
+      body.push_back(static_cast<char>(tag));
+
+      const Location &loc = node.loc;
+      putVarint(zigzag(int64_t(loc.sline) - int64_t(prevLine)));
+      putVarint(loc.scol);
+      putVarint(zigzag(int64_t(loc.eline) - int64_t(loc.sline)));
+      putVarint(loc.ecol);
+      prevLine = loc.sline;
+    }
+
+    // nodes are written as they are visited, so children are scheduled rather
+    // than written directly.
+    void putNode(ASTNode *node)
+    {
+      if (node == nullptr)
+      {
+        schedule([this]
+                 { body.push_back(static_cast<char>(NULL_TAG)); });
+        return;
+      }
+      schedule(node);
+    }
+
+    void putChildren(ASTNode &node)
+    {
+      for (ASTNode *child : node.children())
+      {
+        putNode(child);
+      }
+    }
+
+    template <typename StmtPtrs> void putStmts(StmtPtrs &stmts)
+    {
+      putVarint(stmts.size());
+      for (StmtNodePtr &stmt : stmts)
+      {
+        putNode(stmt.get());
+      }
+    }
+
+  public:
+    void visit(IntTypeNode &node) override { putHeader(INT_TYPE_TAG, node); }
+    void visit(FloatTypeNode &node) override { putHeader(FLOAT_TYPE_TAG, node); }
+    void visit(ColourTypeNode &node) override
+    {
+      putHeader(COLOUR_TYPE_TAG, node);
+    }
+    void visit(BoolTypeNode &node) override { putHeader(BOOL_TYPE_TAG, node); }
+
+    void visit(ArrayTypeNode &node) override
+    {
+      putHeader(ARRAY_TYPE_TAG, node);
+      putNode(node.contained.get());
+    }
+
+    void visit(FunctionTypeNode &node) override
+    {
+      putHeader(FUNCTION_TYPE_TAG, node);
+      putVarint(node.argTypes.size());
+      putChildren(node);
+    }
+
+    void visit(BinaryExprNode &node) override
+    {
+      putHeader(BINARY_EXPR_TAG, node);
+      putVarint(node.op);
+      putChildren(node);
+    }
+
+    void visit(UnaryExprNode &node) override
+    {
+      putHeader(UNARY_EXPR_TAG, node);
+      putVarint(node.op);
+      putChildren(node);
+    }
+
+    void visit(FunctionCallNode &node) override
+    {
+      putHeader(FUNCTION_CALL_TAG, node);
+      putId(node.funcName);
+      putVarint(node.args.size());
+      putChildren(node);
+    }
+
+    void visit(IdExprNode &node) override
+    {
+      putHeader(ID_EXPR_TAG, node);
+      putId(node.id);
+      putVarint(node.isLValue);
+    }
+
+    void visit(BoolLiteralExprNode &node) override
+    {
+      putHeader(BOOL_LITERAL_TAG, node);
+      putVarint(node.x);
+    }
+
+    void visit(IntLiteralExprNode &node) override
+    {
+      putHeader(INT_LITERAL_TAG, node);
+      putVarint(zigzag(node.x));
+    }
+
+    void visit(FloatLiteralExprNode &node) override
+    {
+      putHeader(FLOAT_LITERAL_TAG, node);
+      uint32_t bits;
+      std::memcpy(&bits, &node.x, sizeof(bits));
+      putVarint(bits);
+    }
+
+    void visit(ColourLiteralExprNode &node) override
+    {
+      putHeader(COLOUR_LITERAL_TAG, node);
+      putVarint(node.colour);
+    }
+
+    void visit(PadWidthExprNode &node) override
+    {
+      putHeader(PAD_WIDTH_TAG, node);
+    }
+
+    void visit(PadHeightExprNode &node) override
+    {
+      putHeader(PAD_HEIGHT_TAG, node);
+    }
+
+    void visit(ReadExprNode &node) override
+    {
+      putHeader(READ_EXPR_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(RandiExprNode &node) override
+    {
+      putHeader(RANDI_EXPR_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(NewArrExprNode &node) override
+    {
+      putHeader(NEW_ARR_EXPR_TAG, node);
+      putNode(node.ofType.get());
+      putNode(node.operand.get());
+    }
+
+    void visit(ArrayAccessNode &node) override
+    {
+      putHeader(ARRAY_ACCESS_TAG, node);
+      putVarint(node.isLValue);
+      putChildren(node);
+    }
+
+    void visit(GetCharNode &node) override { putHeader(GET_CHAR_TAG, node); }
+
+    void visit(Float2IntNode &node) override
+    {
+      putHeader(FLOAT2INT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(AssignmentStmt &node) override
+    {
+      putHeader(ASSIGNMENT_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(VariableDeclStmt &node) override
+    {
+      putHeader(VARIABLE_DECL_STMT_TAG, node);
+      putId(node.id);
+      putChildren(node);
+    }
+
+    void visit(PrintStmt &node) override
+    {
+      putHeader(PRINT_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(DelayStmt &node) override
+    {
+      putHeader(DELAY_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(PixelStmt &node) override
+    {
+      putHeader(PIXEL_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(PixelRStmt &node) override
+    {
+      putHeader(PIXELR_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(ReturnStmt &node) override
+    {
+      putHeader(RETURN_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(PutCharStmt &node) override
+    {
+      putHeader(PUT_CHAR_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(IfElseStmt &node) override
+    {
+      putHeader(IF_ELSE_STMT_TAG, node);
+      putNode(node.cond.get());
+      putNode(node.ifBody.get());
+      putNode(node.elseBody.get());
+    }
+
+    void visit(ForStmt &node) override
+    {
+      putHeader(FOR_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(WhileStmt &node) override
+    {
+      putHeader(WHILE_STMT_TAG, node);
+      putChildren(node);
+    }
+
+    void visit(FuncDeclStmt &node) override
+    {
+      putHeader(FUNC_DECL_STMT_TAG, node);
+      putId(node.funcName);
+      putVarint(node.params.size());
+      for (FormalParam &param : node.params)
+      {
+        schedule([this, &param]
+                 { putId(param.first); });
+        putNode(param.second.get());
+      }
+      putNode(node.retType.get());
+      putNode(node.body.get());
+    }
+
+    void visit(BlockStmt &node) override
+    {
+      putHeader(BLOCK_STMT_TAG, node);
+      putStmts(node.stmts);
+    }
+
+    void visit(TranslationUnit &node) override
+    {
+      putHeader(TRANSLATION_UNIT_TAG, node);
+      putStmts(node.stmts);
+    }
+
+    void write(BufferedWriter &w)
+    {
+      std::string header{MAGIC};
+      header.push_back(static_cast<char>(FORMAT_VERSION));
+
+      // the table is encoded with the same varint helper, so swap it in
+      // temporarily.
+      std::string nodes;
+      std::swap(nodes, body);
+      putVarint(ids.size());
+      for (const std::string *id : ids)
+      {
+        putVarint(id->size());
+        body += *id;
+      }
+
+      w << header << body << nodes;
+    }
+  };
+
+  class BinaryASTReader
+  {
+  private:
+    std::string_view data;
+    size_t pos = 0;
+
+    std::vector<std::string> ids;
+    uint32_t prevLine = 0;
+
+    [[noreturn]] void fail(const std::string &reason)
+    {
+      throw CompilationError("Malformed binary AST at byte " +
+                             std::to_string(pos) + ": " + reason);
+    }
+
+    uint8_t getByte()
+    {
+      if (pos >= data.size())
+      {
+        fail("unexpected end of data.");
+      }
+      return static_cast<uint8_t>(data[pos++]);
+    }
+
+    uint64_t getVarint()
+    {
+      uint64_t x = 0;
+      for (int shift = 0; shift < 64; shift += 7)
+      {
+        uint8_t byte = getByte();
+        x |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+          return x;
+        }
+      }
+      fail("varint is too long.");
+    }
+
+    // a count of items which each take at least one byte, checked against
+    // the remaining data so corrupt counts can't cause huge allocations.
+    size_t getCount()
+    {
+      uint64_t count = getVarint();
+      if (count > data.size() - pos)
+      {
+        fail("count exceeds remaining data.");
+      }
+      return count;
+    }
+
+    bool getBool()
+    {
+      uint64_t x = getVarint();
+      if (x > 1)
+      {
+        fail("invalid boolean.");
+      }
+      return x;
+    }
+
+    const std::string &getId()
+    {
+      uint64_t idx = getVarint();
+      if (idx >= ids.size())
+      {
+        fail("identifier index out of range.");
+      }
+      return ids[idx];
+    }
+
+    Location getLocation()
+    {
+      Location loc;
+      loc.sline = prevLine + unzigzag(getVarint());
+      loc.scol = getVarint();
+      loc.eline = loc.sline + unzigzag(getVarint());
+      loc.ecol = getVarint();
+      prevLine = loc.sline;
+      return loc;
+    }
+
+    // the kind of node a child has to be.
+    enum Expected
+    {
+      TYPE,
+      EXPR,
+      STMT,
+      OPTIONAL_STMT,
+    };
+
+    // a node whose fields have been read, but whose children may not have
+    // been yet.
+    struct PendingNode
+    {
+      uint8_t tag;
+      Location loc;
+      // operator, flag or literal value, depending on the tag.
+      uint64_t value = 0;
+      std::string name;
+      // length of the node's list of children, e.g. call arguments.
+      size_t count = 0;
+      std::vector<std::string> paramNames;
+      std::vector<ASTNodePtr> children;
+    };
+
+    template <typename T> static std::unique_ptr<T> take(ASTNodePtr &node)
+    {
+      return std::unique_ptr<T>(static_cast<T *>(node.release()));
+    }
+
+    static bool isExpected(uint8_t tag, Expected expected)
+    {
+      switch (expected)
+      {
+      case TYPE:
+        return tag >= INT_TYPE_TAG && tag <= FUNCTION_TYPE_TAG;
+      case EXPR:
+        return tag >= BINARY_EXPR_TAG && tag <= FLOAT2INT_TAG;
+      case STMT:
+      case OPTIONAL_STMT:
+        return tag >= ASSIGNMENT_STMT_TAG && tag <= BLOCK_STMT_TAG;
+      }
+      return false;
+    }
+
+    [[noreturn]] void failExpected(Expected expected)
+    {
+      switch (expected)
+      {
+      case TYPE:
+        fail("expected a type.");
+      case EXPR:
+        fail("expected an expression.");
+      default:
+        fail("expected a statement.");
+      }
+    }
+
+    // reads the fields stored before a node's children.
+    void getFields(PendingNode &node)
+    {
+      switch (node.tag)
+      {
+      case FUNCTION_TYPE_TAG:
+      case BLOCK_STMT_TAG:
+      case TRANSLATION_UNIT_TAG:
+        node.count = getCount();
+        break;
+      case BINARY_EXPR_TAG:
+        node.value = getVarint();
+        if (node.value > BinaryExprNode::LE)
+        {
+          fail("invalid binary operator.");
+        }
+        break;
+      case UNARY_EXPR_TAG:
+        node.value = getVarint();
+        if (node.value > UnaryExprNode::NOT)
+        {
+          fail("invalid unary operator.");
+        }
+        break;
+      case FUNCTION_CALL_TAG:
+      case FUNC_DECL_STMT_TAG:
+        node.name = getId();
+        node.count = getCount();
+        break;
+      case ID_EXPR_TAG:
+        node.name = getId();
+        node.value = getBool();
+        break;
+      case BOOL_LITERAL_TAG:
+      case ARRAY_ACCESS_TAG:
+        node.value = getBool();
+        break;
+      case INT_LITERAL_TAG:
+      case FLOAT_LITERAL_TAG:
+      case COLOUR_LITERAL_TAG:
+        node.value = getVarint();
+        break;
+      case VARIABLE_DECL_STMT_TAG:
+        node.name = getId();
+        break;
+      }
+    }
+
+    static size_t arity(const PendingNode &node)
+    {
+      switch (node.tag)
+      {
+      case ARRAY_TYPE_TAG:
+      case UNARY_EXPR_TAG:
+      case RANDI_EXPR_TAG:
+      case FLOAT2INT_TAG:
+      case PRINT_STMT_TAG:
+      case DELAY_STMT_TAG:
+      case RETURN_STMT_TAG:
+      case PUT_CHAR_STMT_TAG:
+        return 1;
+      case BINARY_EXPR_TAG:
+      case READ_EXPR_TAG:
+      case NEW_ARR_EXPR_TAG:
+      case ARRAY_ACCESS_TAG:
+      case ASSIGNMENT_STMT_TAG:
+      case VARIABLE_DECL_STMT_TAG:
+      case WHILE_STMT_TAG:
+        return 2;
+      case PIXEL_STMT_TAG:
+      case IF_ELSE_STMT_TAG:
+        return 3;
+      case FOR_STMT_TAG:
+        return 4;
+      case PIXELR_STMT_TAG:
+        return 5;
+      case FUNCTION_TYPE_TAG:
+        return 1 + node.count;
+      case FUNC_DECL_STMT_TAG:
+        return node.count + 2;
+      case FUNCTION_CALL_TAG:
+      case BLOCK_STMT_TAG:
+      case TRANSLATION_UNIT_TAG:
+        return node.count;
+      default:
+        return 0;
+      }
+    }
+
+    static Expected expectedChild(const PendingNode &node, size_t i)
+    {
+      switch (node.tag)
+      {
+      case ARRAY_TYPE_TAG:
+      case FUNCTION_TYPE_TAG:
+        return TYPE;
+      case NEW_ARR_EXPR_TAG:
+      case VARIABLE_DECL_STMT_TAG:
+        return i == 0 ? TYPE : EXPR;
+      case IF_ELSE_STMT_TAG:
+        return i == 0 ? EXPR : i == 1 ? STMT : OPTIONAL_STMT;
+      case FOR_STMT_TAG:
+        return i == 1 ? EXPR : STMT;
+      case WHILE_STMT_TAG:
+        return i == 0 ? EXPR : STMT;
+      case FUNC_DECL_STMT_TAG:
+        return i <= node.count ? TYPE : STMT;
+      case BLOCK_STMT_TAG:
+      case TRANSLATION_UNIT_TAG:
+        return STMT;
+      default:
+        return EXPR;
+      }
+    }
+
+    // constructs a node once all its children have been read.
+    static ASTNodePtr build(PendingNode &node)
+    {
+      std::vector<ASTNodePtr> &c = node.children;
+      Location loc = node.loc;
+
+      switch (node.tag)
+      {
+      case INT_TYPE_TAG:
+        return std::make_unique<IntTypeNode>(loc);
+      case FLOAT_TYPE_TAG:
+        return std::make_unique<FloatTypeNode>(loc);
+      case COLOUR_TYPE_TAG:
+        return std::make_unique<ColourTypeNode>(loc);
+      case BOOL_TYPE_TAG:
+        return std::make_unique<BoolTypeNode>(loc);
+      case ARRAY_TYPE_TAG:
+        return std::make_unique<ArrayTypeNode>(take<TypeNode>(c[0]), loc);
+      case FUNCTION_TYPE_TAG:
+      {
+        std::vector<TypeNodePtr> argTypes;
+        for (size_t i = 1; i < c.size(); i++)
+        {
+          argTypes.push_back(take<TypeNode>(c[i]));
+        }
+        return std::make_unique<FunctionTypeNode>(take<TypeNode>(c[0]),
+                                                  std::move(argTypes), loc);
+      }
+
+      case BINARY_EXPR_TAG:
+        return std::make_unique<BinaryExprNode>(
+            static_cast<BinaryExprNode::BinaryOp>(node.value),
+            take<ExprNode>(c[0]), take<ExprNode>(c[1]), loc);
+      case UNARY_EXPR_TAG:
+        return std::make_unique<UnaryExprNode>(
+            static_cast<UnaryExprNode::UnaryOp>(node.value),
+            take<ExprNode>(c[0]), loc);
+      case FUNCTION_CALL_TAG:
+      {
+        std::vector<ExprNodePtr> args;
+        for (ASTNodePtr &arg : c)
+        {
+          args.push_back(take<ExprNode>(arg));
+        }
+        return std::make_unique<FunctionCallNode>(node.name, std::move(args),
+                                                  loc);
+      }
+      case ID_EXPR_TAG:
+        return std::make_unique<IdExprNode>(node.name, node.value, loc);
+      case BOOL_LITERAL_TAG:
+        return std::make_unique<BoolLiteralExprNode>(node.value, loc);
+      case INT_LITERAL_TAG:
+        return std::make_unique<IntLiteralExprNode>(unzigzag(node.value), loc);
+      case FLOAT_LITERAL_TAG:
+      {
+        uint32_t bits = node.value;
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return std::make_unique<FloatLiteralExprNode>(x, loc);
+      }
+      case COLOUR_LITERAL_TAG:
+        return std::make_unique<ColourLiteralExprNode>(node.value, loc);
+      case PAD_WIDTH_TAG:
+        return std::make_unique<PadWidthExprNode>(loc);
+      case PAD_HEIGHT_TAG:
+        return std::make_unique<PadHeightExprNode>(loc);
+      case READ_EXPR_TAG:
+        return std::make_unique<ReadExprNode>(take<ExprNode>(c[0]),
+                                              take<ExprNode>(c[1]), loc);
+      case RANDI_EXPR_TAG:
+        return std::make_unique<RandiExprNode>(take<ExprNode>(c[0]), loc);
+      case NEW_ARR_EXPR_TAG:
+        return std::make_unique<NewArrExprNode>(take<TypeNode>(c[0]),
+                                                take<ExprNode>(c[1]), loc);
+      case ARRAY_ACCESS_TAG:
+        return std::make_unique<ArrayAccessNode>(
+            take<ExprNode>(c[0]), take<ExprNode>(c[1]), node.value, loc);
+      case GET_CHAR_TAG:
+        return std::make_unique<GetCharNode>(loc);
+      case FLOAT2INT_TAG:
+        return std::make_unique<Float2IntNode>(take<ExprNode>(c[0]), loc);
+
+      case ASSIGNMENT_STMT_TAG:
+        return std::make_unique<AssignmentStmt>(take<ExprNode>(c[0]),
+                                                take<ExprNode>(c[1]), loc);
+      case VARIABLE_DECL_STMT_TAG:
+        return std::make_unique<VariableDeclStmt>(
+            node.name, take<TypeNode>(c[0]), take<ExprNode>(c[1]), loc);
+      case PRINT_STMT_TAG:
+        return std::make_unique<PrintStmt>(take<ExprNode>(c[0]), loc);
+      case DELAY_STMT_TAG:
+        return std::make_unique<DelayStmt>(take<ExprNode>(c[0]), loc);
+      case PIXEL_STMT_TAG:
+        return std::make_unique<PixelStmt>(take<ExprNode>(c[0]),
+                                           take<ExprNode>(c[1]),
+                                           take<ExprNode>(c[2]), loc);
+      case PIXELR_STMT_TAG:
+        return std::make_unique<PixelRStmt>(
+            take<ExprNode>(c[0]), take<ExprNode>(c[1]), take<ExprNode>(c[2]),
+            take<ExprNode>(c[3]), take<ExprNode>(c[4]), loc);
+      case RETURN_STMT_TAG:
+        return std::make_unique<ReturnStmt>(take<ExprNode>(c[0]), loc);
+      case PUT_CHAR_STMT_TAG:
+        return std::make_unique<PutCharStmt>(take<ExprNode>(c[0]), loc);
+      case IF_ELSE_STMT_TAG:
+        return std::make_unique<IfElseStmt>(take<ExprNode>(c[0]),
+                                            take<StmtNode>(c[1]),
+                                            take<StmtNode>(c[2]), loc);
+      case FOR_STMT_TAG:
+        return std::make_unique<ForStmt>(
+            take<StmtNode>(c[0]), take<ExprNode>(c[1]), take<StmtNode>(c[2]),
+            take<StmtNode>(c[3]), loc);
+      case WHILE_STMT_TAG:
+        return std::make_unique<WhileStmt>(take<ExprNode>(c[0]),
+                                           take<StmtNode>(c[1]), loc);
+      case FUNC_DECL_STMT_TAG:
+      {
+        std::vector<FormalParam> params;
+        for (size_t i = 0; i < node.count; i++)
+        {
+          params.emplace_back(node.paramNames[i], take<TypeNode>(c[i]));
+        }
+        return std::make_unique<FuncDeclStmt>(
+            node.name, std::move(params), take<TypeNode>(c[node.count]),
+            take<StmtNode>(c[node.count + 1]), loc);
+      }
+      case BLOCK_STMT_TAG:
+      case TRANSLATION_UNIT_TAG:
+      {
+        std::vector<StmtNodePtr> stmts;
+        for (ASTNodePtr &stmt : c)
+        {
+          stmts.push_back(take<StmtNode>(stmt));
+        }
+        if (node.tag == BLOCK_STMT_TAG)
+        {
+          return std::make_unique<BlockStmt>(std::move(stmts), loc);
+        }
+        return std::make_unique<TranslationUnit>(std::move(stmts), loc);
+      }
+      }
+      throw std::logic_error("Unknown binary AST tag.");
+    }
+
+    // reads the nodes below a translation unit whose tag has been read.
+    // Nodes whose children are still being read wait on an explicit stack, so
+    // deeply nested ASTs can't overflow the native stack.
+    std::unique_ptr<TranslationUnit> getTranslationUnit()
+    {
+      std::vector<PendingNode> pending;
+      pending.push_back({TRANSLATION_UNIT_TAG, getLocation()});
+      getFields(pending.back());
+
+      while (true)
+      {
+        PendingNode &node = pending.back();
+        size_t i = node.children.size();
+
+        if (i == arity(node))
+        {
+          ASTNodePtr built = build(node);
+          pending.pop_back();
+          if (pending.empty())
+          {
+            return take<TranslationUnit>(built);
+          }
+          pending.back().children.push_back(std::move(built));
+          continue;
+        }
+
+        // each parameter's name precedes its type.
+        if (node.tag == FUNC_DECL_STMT_TAG && i < node.count)
+        {
+          node.paramNames.push_back(getId());
+        }
+
+        Expected expected = expectedChild(node, i);
+        size_t tagPos = pos;
+        uint8_t tag = getByte();
+        if (tag == NULL_TAG && expected == OPTIONAL_STMT)
+        {
+          node.children.push_back(nullptr);
+          continue;
+        }
+
+        PendingNode child{tag, getLocation()};
+        if (!isExpected(tag, expected))
+        {
+          pos = tagPos;
+          failExpected(expected);
+        }
+        getFields(child);
+        pending.push_back(std::move(child));
+      }
+    }
+
+  public:
+    BinaryASTReader(std::string_view data) : data(data) {}
+
+    std::unique_ptr<TranslationUnit> read()
+    {
+      if (!isBinaryAST(data))
+      {
+        fail("missing magic.");
+      }
+      pos = MAGIC.size();
+
+      if (getByte() != FORMAT_VERSION)
+      {
+        pos--;
+        fail("unsupported format version.");
+      }
+
+      size_t nIds = getCount();
+      ids.reserve(nIds);
+      for (size_t i = 0; i < nIds; i++)
+      {
+        size_t len = getVarint();
+        if (len > data.size() - pos)
+        {
+          fail("identifier exceeds remaining data.");
+        }
+        ids.emplace_back(data.substr(pos, len));
+        pos += len;
+      }
+
+      if (getByte() != TRANSLATION_UNIT_TAG)
+      {
+        pos--;
+        fail("expected a translation unit.");
+      }
+      std::unique_ptr<TranslationUnit> tu = getTranslationUnit();
+
+      if (pos != data.size())
+      {
+        fail("trailing data.");
+      }
+      return tu;
+    }
+  };
+
+  void writeBinaryAST(TranslationUnit &tu, BufferedWriter &w)
+  {
+    BinaryASTWriter writer;
+    tu.accept(&writer);
+    writer.write(w);
+  }
+
+  bool isBinaryAST(std::string_view data)
+  {
+    return data.substr(0, MAGIC.size()) == MAGIC;
+  }
+
+  std::unique_ptr<TranslationUnit> readBinaryAST(std::string_view data)
+  {
+    return BinaryASTReader(data).read();
+  }
+
+} // namespace ast
@@ -0,0 +1,38 @@
+#ifndef AST_BINARY_H_
+#define AST_BINARY_H_
+
+#include "ast.hh"
+#include "writer.hh"
+
+#include <memory>
+#include <string_view>
+
+namespace ast
+{
+
+  // Compact binary encoding of an AST, used to store parsed programs so they
+  // can be compiled again without lexing and parsing.
+  //
+  // Layout:
+  //   magic ("\0PXAST"), format version (1 byte)
+  //   identifier table: count, then each identifier as length + bytes
+  //   nodes in preorder: kind tag (1 byte), location, node-specific fields,
+  //   then the node's children
+  //
+  // All integers are LEB128 varints (zigzag encoded if signed). Identifiers
+  // are referred to by their index in the table. Locations store their start
+  // line relative to the previous node's and their end line relative to
+  // their own start line, so most fit in four bytes.
+  void writeBinaryAST(TranslationUnit &tu, BufferedWriter &w);
+
+  // whether data starts with the binary AST magic. Never true for source
+  // code, as source code can't contain NUL bytes.
+  bool isBinaryAST(std::string_view data);
+
+  // reconstructs an AST written by writeBinaryAST. Throws CompilationError if
+  // data is malformed or was written by an incompatible version.
+  std::unique_ptr<TranslationUnit> readBinaryAST(std::string_view data);
+
+} // namespace ast
+
+#endif // AST_BINARY_H_
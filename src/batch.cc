@@ -0,0 +1,135 @@
+#include "batch.hh"
+#include "compiler.hh"
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+std::vector<std::string> readManifest(const std::string &path)
+{
+  std::ifstream manifest{path};
+  if (!manifest)
+  {
+    throw CompilationError("Could not open manifest " + path + ".");
+  }
+
+  std::vector<std::string> sources;
+  std::string line;
+  while (std::getline(manifest, line))
+  {
+    // trim surrounding whitespace
+    size_t start = line.find_first_not_of(" \t\r");
+    size_t end = line.find_last_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#')
+    {
+      continue;
+    }
+    sources.push_back(line.substr(start, end - start + 1));
+  }
+  return sources;
+}
+
+// path of an output file for source, with the given extension, placed in dir
+// (or next to the source if no directory was given).
+static std::string outputPath(const std::string &source,
+                              const std::optional<std::string> &dir,
+                              const std::string &extension)
+{
+  std::filesystem::path path{source};
+  path.replace_extension(extension);
+  if (dir)
+  {
+    path = std::filesystem::path{dir.value()} / path.filename();
+  }
+  return path.string();
+}
+
+size_t compileBatch(const std::vector<std::string> &sources,
+                    const BatchOptions &opts, std::ostream &diagnostics)
+{
+  for (const std::optional<std::string> &dir :
+       {opts.outDir, opts.xmlOutDir, opts.astOutDir})
+  {
+    if (dir)
+    {
+      std::filesystem::create_directories(dir.value());
+    }
+  }
+
+  // one slot per source, so workers never contend on the diagnostics.
+  std::vector<std::string> errors(sources.size());
+
+  std::vector<CompilerOptions> tuOpts(sources.size(), opts.compilerOpts);
+  // the source writing each output file. A source whose outputs would be
+  // written for an earlier one too (e.g. sources with the same name compiled
+  // to one directory, or a source listed twice) fails instead of racing it.
+  std::map<std::filesystem::path, size_t> writers;
+  for (size_t i = 0; i < sources.size(); i++)
+  {
+    tuOpts[i].infile = sources[i];
+    tuOpts[i].outfile = outputPath(sources[i], opts.outDir, ".pixardis");
+    if (opts.xmlOutDir)
+    {
+      tuOpts[i].generateXml = true;
+      tuOpts[i].xmlOutfile = outputPath(sources[i], opts.xmlOutDir, ".xml");
+    }
+    tuOpts[i].generateBinaryAst = opts.astOutDir.has_value();
+    tuOpts[i].binaryAstOutfile =
+        opts.astOutDir
+            ? std::optional(outputPath(sources[i], opts.astOutDir, ".past"))
+            : std::nullopt;
+
+    for (const std::optional<std::string> &output :
+         {tuOpts[i].outfile, tuOpts[i].xmlOutfile, tuOpts[i].binaryAstOutfile})
+    {
+      if (!output)
+      {
+        continue;
+      }
+      std::filesystem::path path =
+          std::filesystem::absolute(output.value()).lexically_normal();
+      auto [writer, inserted] = writers.insert({path, i});
+      if (!inserted && errors[i].empty())
+      {
+        errors[i] = "Output " + output.value() + " is also written for " +
+                    sources[writer->second] + ".";
+      }
+    }
+  }
+
+  ThreadPool pool{std::min(opts.jobs ? opts.jobs : ThreadPool::hardwareThreads(),
+                           std::max<size_t>(sources.size(), 1))};
+
+  pool.parallelFor(
+      sources.size(),
+      [&](size_t i)
+      {
+        if (!errors[i].empty())
+        {
+          return;
+        }
+
+        try
+        {
+          Compiler compiler{tuOpts[i]};
+          compiler.compile();
+        }
+        catch (std::exception &e)
+        {
+          errors[i] = e.what();
+        }
+      });
+
+  size_t failed = 0;
+  for (size_t i = 0; i < sources.size(); i++)
+  {
+    if (!errors[i].empty())
+    {
+      diagnostics << sources[i] << ": " << errors[i] << std::endl;
+      failed++;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,43 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "compiler.hh"
+
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct BatchOptions
+{
+  // applied to every translation unit. infile, outfile, xmlOutfile and
+  // binaryAstOutfile are filled in per source.
+  CompilerOptions compilerOpts;
+
+  // directories receiving <stem>.pixardis and <stem>.xml for each source. By
+  // default assembly is written next to its source, and XML is only
+  // generated if xmlOutDir is set.
+  std::optional<std::string> outDir = std::nullopt;
+  std::optional<std::string> xmlOutDir = std::nullopt;
+  // directory receiving <stem>.past, the binary AST of each source.
+  std::optional<std::string> astOutDir = std::nullopt;
+
+  // number of worker threads; 0 uses one per hardware thread.
+  size_t jobs = 0;
+};
+
+// reads a manifest file listing one source path per line. Blank lines and
+// lines starting with # are ignored.
+std::vector<std::string> readManifest(const std::string &path);
+
+// compiles every source as an independent translation unit on a pool of
+// worker threads. Diagnostics are written to diagnostics in source order once
+// all sources are done. A source whose output files would also be written
+// for an earlier source, e.g. one with the same name compiled to the same
+// directory, fails without being compiled. Returns the number of sources that
+// failed to compile.
+size_t compileBatch(const std::vector<std::string> &sources,
+                    const BatchOptions &opts, std::ostream &diagnostics);
+
+#endif // BATCH_H_
@@ -0,0 +1,187 @@
+#include "cache.hh"
+#include "compiler.hh"
+#include "framing.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// bumped whenever the layout of cache entries changes.
+static const std::string ENTRY_MAGIC = "pixelc-cache-1";
+static const std::string TMP_PREFIX = "tmp-";
+
+// 128-bit FNV-1a.
+static std::string hashKey(const std::string &data)
+{
+  using u128 = unsigned __int128;
+  const u128 prime = (u128(0x0000000001000000) << 64) | 0x000000000000013B;
+  u128 hash = (u128(0x6c62272e07bb0142) << 64) | 0x62b821756295c58d;
+
+  for (unsigned char c : data)
+  {
+    hash ^= c;
+    hash *= prime;
+  }
+
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(32, '0');
+  for (int i = 31; i >= 0; i--, hash >>= 4)
+  {
+    hex[i] = digits[static_cast<unsigned>(hash & 0xf)];
+  }
+  return hex;
+}
+
+CompilationCache::CompilationCache(std::filesystem::path dir,
+                                   uintmax_t maxBytes)
+    : dir(std::move(dir)), maxBytes(maxBytes)
+{
+  std::filesystem::create_directories(this->dir);
+}
+
+std::string CompilationCache::makeKey(const std::string &source,
+                                      const CompilerOptions &opts)
+{
+  std::stringstream ss;
+  framing::writeField(ss, PIXELC_VERSION);
+  framing::writeField(ss, optionsFingerprint(opts));
+  framing::writeField(ss, source);
+  return hashKey(ss.str());
+}
+
+std::filesystem::path CompilationCache::entryPath(const std::string &key) const
+{
+  return dir / key;
+}
+
+std::optional<CacheEntry> CompilationCache::lookup(const std::string &key)
+{
+  std::filesystem::path path = entryPath(key);
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+  {
+    return std::nullopt;
+  }
+
+  CacheEntry entry;
+  std::string magic, storedKey;
+  try
+  {
+    if (!framing::readField(file, magic) || magic != ENTRY_MAGIC ||
+        !framing::readField(file, storedKey) || storedKey != key ||
+        !framing::readField(file, entry.asmOutput) ||
+        !framing::readField(file, entry.xmlOutput))
+    {
+      return std::nullopt;
+    }
+  }
+  catch (framing::FramingError &)
+  {
+    // treat corrupt entries as misses; they are replaced on the next store.
+    return std::nullopt;
+  }
+
+  // mark the entry as recently used. Failure only affects eviction order.
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+
+  return entry;
+}
+
+void CompilationCache::store(const std::string &key, const CacheEntry &entry)
+{
+  // unique temporary name, so concurrent writers never share a file.
+  std::random_device rd;
+  std::stringstream tmpName;
+  tmpName << TMP_PREFIX << key << "-" << std::hex << rd() << rd() << "-"
+          << std::hash<std::thread::id>{}(std::this_thread::get_id());
+  std::filesystem::path tmpPath = dir / tmpName.str();
+
+  {
+    std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+    framing::writeField(file, ENTRY_MAGIC);
+    framing::writeField(file, key);
+    framing::writeField(file, entry.asmOutput);
+    framing::writeField(file, entry.xmlOutput);
+    if (!file.flush())
+    {
+      std::error_code ec;
+      std::filesystem::remove(tmpPath, ec);
+      return;
+    }
+  }
+
+  // rename() atomically replaces any entry written concurrently for the same
+  // key; both hold identical outputs.
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, entryPath(key), ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmpPath, ec);
+    return;
+  }
+
+  evict();
+}
+
+void CompilationCache::evict()
+{
+  struct CachedFile
+  {
+    std::filesystem::path path;
+    std::filesystem::file_time_type lastUsed;
+    uintmax_t size;
+  };
+
+  std::vector<CachedFile> files;
+  uintmax_t total = 0;
+
+  std::error_code ec;
+  for (const std::filesystem::directory_entry &dirEntry :
+       std::filesystem::directory_iterator(dir, ec))
+  {
+    if (dirEntry.path().filename().string().rfind(TMP_PREFIX, 0) == 0)
+    {
+      continue;
+    }
+
+    // entries may disappear under us if another process is evicting too.
+    std::error_code statEc;
+    uintmax_t size = dirEntry.file_size(statEc);
+    std::filesystem::file_time_type lastUsed =
+        dirEntry.last_write_time(statEc);
+    if (statEc)
+    {
+      continue;
+    }
+
+    files.push_back({dirEntry.path(), lastUsed, size});
+    total += size;
+  }
+
+  if (total <= maxBytes)
+  {
+    return;
+  }
+
+  std::sort(files.begin(), files.end(),
+            [](const CachedFile &a, const CachedFile &b)
+            { return a.lastUsed < b.lastUsed; });
+
+  for (const CachedFile &file : files)
+  {
+    if (total <= maxBytes)
+    {
+      break;
+    }
+    if (std::filesystem::remove(file.path, ec))
+    {
+      total -= file.size;
+    }
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+struct CompilerOptions;
+
+struct CacheEntry
+{
+  std::string asmOutput;
+  std::string xmlOutput;
+};
+
+// On-disk cache of compiler outputs, addressed by a hash of the source, the
+// compiler version and the options affecting the output.
+//
+// Entries are written to a temporary file and renamed into place, so
+// concurrent writers (e.g. parallel CI jobs sharing a cache directory) never
+// expose partially written entries. Hits refresh an entry's modification time,
+// and stores evict the least recently used entries once the cache grows past
+// its size limit.
+class CompilationCache
+{
+private:
+  std::filesystem::path dir;
+  uintmax_t maxBytes;
+
+  std::filesystem::path entryPath(const std::string &key) const;
+  void evict();
+
+public:
+  static const uintmax_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+  CompilationCache(std::filesystem::path dir,
+                   uintmax_t maxBytes = DEFAULT_MAX_BYTES);
+
+  // key identifying the output of compiling source with opts.
+  static std::string makeKey(const std::string &source,
+                             const CompilerOptions &opts);
+
+  std::optional<CacheEntry> lookup(const std::string &key);
+  void store(const std::string &key, const CacheEntry &entry);
+};
+
+#endif // CACHE_H_
@@ -0,0 +1,290 @@
+#include "call_graph.hh"
+
+#include "cfg.hh"
+#include "ssa.hh"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    // parses a non-negative integer which is small enough not to overflow.
+    std::optional<long long> smallInt(const std::string &s)
+    {
+      if (s.empty() || s.size() > 9 ||
+          s.find_first_not_of("0123456789") != std::string::npos)
+      {
+        return std::nullopt;
+      }
+      return std::stoll(s);
+    }
+
+    // the depth of a frame slot, as in PUSH [index:depth], or nullopt if the
+    // string isn't one.
+    std::optional<long long> slotDepth(const std::string &s)
+    {
+      if (s.size() < 3 || s.front() != '[' || s.back() != ']')
+      {
+        return std::nullopt;
+      }
+      size_t colon = s.find(':');
+      if (colon == std::string::npos)
+      {
+        return 0;
+      }
+      return smallInt(s.substr(colon + 1, s.size() - colon - 2));
+    }
+
+    // whether the code of a function, not counting the functions it calls,
+    // is pure. Its own frames are that of its arguments and those it opens.
+    bool hasNoEffects(const PixIRFunction &func)
+    {
+      if (func.blocks.empty())
+      {
+        return false;
+      }
+      ControlFlowGraph cfg{func};
+      std::optional<std::vector<int>> opened = openFrames(func, cfg);
+      if (!opened)
+      {
+        return false;
+      }
+
+      for (size_t block : cfg.reversePostorder())
+      {
+        SSABlock ssa{*func.blocks[block]};
+        if (!ssa.valid())
+        {
+          return false;
+        }
+        long long frames = (*opened)[block] + 1;
+        for (const SSABlock::Node &node : ssa.nodes())
+        {
+          const PixIRInstruction &instr = node.instr;
+          // the rest of the block is never run.
+          if (instr.opcode == PixIROpcode::RET)
+          {
+            break;
+          }
+          switch (instr.opcode)
+          {
+          case PixIROpcode::PUSH:
+            if (std::holds_alternative<std::string>(instr.data))
+            {
+              std::optional<long long> depth =
+                  slotDepth(std::get<std::string>(instr.data));
+              if (depth && *depth >= frames)
+              {
+                return false;
+              }
+            }
+            break;
+          case PixIROpcode::ST:
+          {
+            const std::optional<std::string> &constant =
+                ssa.value(node.operands[0]).constant;
+            std::optional<long long> depth =
+                constant ? smallInt(*constant) : std::nullopt;
+            if (!depth || *depth >= frames)
+            {
+              return false;
+            }
+            break;
+          }
+          case PixIROpcode::OFRAME:
+            frames++;
+            break;
+          case PixIROpcode::CFRAME:
+            frames--;
+            break;
+          case PixIROpcode::PIXEL:
+          case PixIROpcode::PIXELR:
+          case PixIROpcode::CLEAR:
+          case PixIROpcode::READ:
+          case PixIROpcode::PRINT:
+          case PixIROpcode::DELAY:
+          case PixIROpcode::GETCHAR:
+          case PixIROpcode::PUTCHAR:
+          case PixIROpcode::IRND:
+          case PixIROpcode::ALLOCA:
+          case PixIROpcode::STA:
+          case PixIROpcode::LDA:
+          case PixIROpcode::HALT:
+            return false;
+          default:
+            break;
+          }
+        }
+      }
+      return true;
+    }
+
+  } // namespace
+
+  CallGraph::CallGraph(const PixIRCode &code)
+      : canonical(code.size()), callees(code.size())
+  {
+    ids.reserve(code.size());
+    for (size_t func = 0; func < code.size(); func++)
+    {
+      canonical[func] = ids.insert({code[func]->funcName, func}).first->second;
+    }
+
+    // the last caller to add each callee, to skip duplicate edges.
+    std::vector<size_t> addedBy(code.size(), code.size());
+    for (size_t func = 0; func < code.size(); func++)
+    {
+      for (const std::string &label : code[func]->callees)
+      {
+        size_t callee = ids.at(label);
+        if (addedBy[callee] != func)
+        {
+          addedBy[callee] = func;
+          callees[func].push_back(callee);
+        }
+      }
+    }
+  }
+
+  std::vector<bool> CallGraph::reachableFrom(size_t root) const
+  {
+    std::vector<bool> reachable(size());
+    std::vector<size_t> workList{root};
+    reachable[root] = true;
+
+    while (!workList.empty())
+    {
+      size_t func = workList.back();
+      workList.pop_back();
+
+      for (size_t callee : callees[func])
+      {
+        if (!reachable[callee])
+        {
+          reachable[callee] = true;
+          workList.push_back(callee);
+        }
+      }
+    }
+
+    for (size_t func = 0; func < size(); func++)
+    {
+      reachable[func] = reachable[canonical[func]];
+    }
+    return reachable;
+  }
+
+  std::vector<bool> CallGraph::findRecursive() const
+  {
+    // Tarjan's strongly connected components, with an explicit stack so deep
+    // call chains don't overflow the native one. A function is recursive if
+    // its component has other functions in it, or if it calls itself.
+    const size_t unvisited = SIZE_MAX;
+    std::vector<size_t> index(size(), unvisited), lowLink(size());
+    std::vector<bool> onStack(size()), recursive(size());
+    std::vector<size_t> component;
+    // functions being visited, and how many of their callees have been.
+    std::vector<std::pair<size_t, size_t>> callStack;
+    size_t nextIndex = 0;
+
+    for (size_t root = 0; root < size(); root++)
+    {
+      if (index[root] != unvisited)
+      {
+        continue;
+      }
+      callStack.push_back({root, 0});
+
+      while (!callStack.empty())
+      {
+        auto &[func, next] = callStack.back();
+        if (next == 0)
+        {
+          index[func] = lowLink[func] = nextIndex++;
+          component.push_back(func);
+          onStack[func] = true;
+        }
+
+        if (next < callees[func].size())
+        {
+          size_t callee = callees[func][next++];
+          if (callee == func)
+          {
+            recursive[func] = true;
+          }
+          if (index[callee] == unvisited)
+          {
+            callStack.push_back({callee, 0});
+          }
+          else if (onStack[callee])
+          {
+            lowLink[func] = std::min(lowLink[func], index[callee]);
+          }
+          continue;
+        }
+
+        size_t done = func;
+        callStack.pop_back();
+        if (!callStack.empty())
+        {
+          size_t caller = callStack.back().first;
+          lowLink[caller] = std::min(lowLink[caller], lowLink[done]);
+        }
+
+        if (lowLink[done] == index[done])
+        {
+          bool cycle = component.back() != done;
+          size_t member;
+          do
+          {
+            member = component.back();
+            component.pop_back();
+            onStack[member] = false;
+            recursive[member] = recursive[member] || cycle;
+          } while (member != done);
+        }
+      }
+    }
+
+    return recursive;
+  }
+
+  std::vector<bool> CallGraph::findPure(const PixIRCode &code) const
+  {
+    std::vector<size_t> sharing(size());
+    for (size_t func = 0; func < size(); func++)
+    {
+      sharing[canonical[func]]++;
+    }
+
+    std::vector<bool> pure(size());
+    for (size_t func = 0; func < size(); func++)
+    {
+      pure[func] = sharing[canonical[func]] == 1 && hasNoEffects(*code[func]);
+    }
+
+    // calling an impure function is impure, until nothing changes.
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (size_t func = 0; func < size(); func++)
+      {
+        if (pure[func] &&
+            std::any_of(callees[func].begin(), callees[func].end(),
+                        [&](size_t callee)
+                        { return !pure[callee]; }))
+        {
+          pure[func] = false;
+          changed = true;
+        }
+      }
+    }
+    return pure;
+  }
+
+} // namespace codegen
@@ -0,0 +1,64 @@
+#ifndef CALL_GRAPH_H_
+#define CALL_GRAPH_H_
+
+#include "codegen.hh"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace codegen
+{
+
+  // Calls between the functions of a PixIRCode, built from the callees
+  // recorded by the CodeGenerator. Functions are identified by their index in
+  // the code, so the graph has to be rebuilt once functions are added or
+  // removed.
+  //
+  // Nested functions in different scopes may share a label. Calls can't tell
+  // them apart, so a label refers to the first function with it, and the
+  // others are its aliases.
+  class CallGraph
+  {
+  private:
+    std::unordered_map<std::string, size_t> ids;
+    // the function each function's label refers to.
+    std::vector<size_t> canonical;
+    // adjacency lists, without duplicates, in the order of the first call.
+    std::vector<std::vector<size_t>> callees;
+
+  public:
+    explicit CallGraph(const PixIRCode &code);
+
+    size_t size() const { return callees.size(); }
+
+    // the function a label refers to. Throws std::out_of_range if there is
+    // none.
+    size_t idOf(const std::string &label) const { return ids.at(label); }
+    size_t canonicalOf(size_t func) const { return canonical[func]; }
+
+    const std::vector<size_t> &calleesOf(size_t func) const
+    {
+      return callees[func];
+    }
+
+    // whether each function can be reached by calls from root, including
+    // root itself. Aliases share the reachability of the function they alias.
+    std::vector<bool> reachableFrom(size_t root) const;
+
+    // whether each function can call itself, directly or through others.
+    std::vector<bool> findRecursive() const;
+
+    // whether each function of code, which the graph was built from, is
+    // pure: it has no effect besides returning a value which only depends on
+    // its arguments. It doesn't draw, read the canvas, print, wait, read
+    // characters, draw random numbers or use arrays, only stores to and loads
+    // from the frames it opens itself, and only calls pure functions. Labels
+    // shared by several functions aren't pure, as calls can't tell which one
+    // they make.
+    std::vector<bool> findPure(const PixIRCode &code) const;
+  };
+
+} // namespace codegen
+
+#endif // CALL_GRAPH_H_
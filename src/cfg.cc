@@ -0,0 +1,303 @@
+#include "cfg.hh"
+
+#include <algorithm>
+#include <iterator>
+
+namespace codegen
+{
+
+  const BasicBlock *ControlFlowGraph::jumpTarget(const BasicBlock &block)
+  {
+    if (block.instrs.size() < 2)
+    {
+      return nullptr;
+    }
+    auto jump = std::prev(block.instrs.end());
+    auto push = std::prev(jump);
+    if ((jump->opcode == PixIROpcode::JMP ||
+         jump->opcode == PixIROpcode::CJMP ||
+         jump->opcode == PixIROpcode::CJMP2) &&
+        push->opcode == PixIROpcode::PUSH &&
+        std::holds_alternative<BasicBlock *>(push->data))
+    {
+      return std::get<BasicBlock *>(push->data);
+    }
+    return nullptr;
+  }
+
+  ControlFlowGraph::ControlFlowGraph(const PixIRFunction &func)
+      : succs(func.blocks.size()), preds(func.blocks.size()),
+        rpoIndex(func.blocks.size(), NONE)
+  {
+    ids.reserve(func.blocks.size());
+    for (size_t block = 0; block < func.blocks.size(); block++)
+    {
+      ids.insert({func.blocks[block].get(), block});
+    }
+
+    for (size_t block = 0; block < func.blocks.size(); block++)
+    {
+      const BasicBlock &b = *func.blocks[block];
+
+      bool exits = std::any_of(b.instrs.begin(), b.instrs.end(),
+                               [](const PixIRInstruction &instr)
+                               {
+                                 return instr.opcode == PixIROpcode::RET ||
+                                        instr.opcode == PixIROpcode::HALT;
+                               });
+      if (exits)
+      {
+        continue;
+      }
+
+      bool fallsThrough = true;
+      if (const BasicBlock *target = jumpTarget(b))
+      {
+        succs[block].push_back(ids.at(target));
+        fallsThrough = b.instrs.back().opcode != PixIROpcode::JMP;
+      }
+      if (fallsThrough && block + 1 < func.blocks.size() &&
+          (succs[block].empty() || succs[block][0] != block + 1))
+      {
+        succs[block].push_back(block + 1);
+      }
+
+      for (size_t succ : succs[block])
+      {
+        preds[succ].push_back(block);
+      }
+    }
+
+    if (func.blocks.empty())
+    {
+      return;
+    }
+
+    // depth-first search from the entry, recording blocks as they finish.
+    std::vector<size_t> postorder;
+    std::vector<bool> visited(size());
+    // blocks being visited, and how many of their successors have been.
+    std::vector<std::pair<size_t, size_t>> stack{{0, 0}};
+    visited[0] = true;
+    while (!stack.empty())
+    {
+      auto &[block, next] = stack.back();
+      if (next < succs[block].size())
+      {
+        size_t succ = succs[block][next++];
+        if (!visited[succ])
+        {
+          visited[succ] = true;
+          stack.push_back({succ, 0});
+        }
+        continue;
+      }
+      postorder.push_back(block);
+      stack.pop_back();
+    }
+
+    rpo.assign(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < rpo.size(); i++)
+    {
+      rpoIndex[rpo[i]] = i;
+    }
+  }
+
+  DominatorTree::DominatorTree(const ControlFlowGraph &cfg)
+      : idom(cfg.size(), ControlFlowGraph::NONE),
+        pre(cfg.size(), ControlFlowGraph::NONE),
+        post(cfg.size(), ControlFlowGraph::NONE)
+  {
+    const std::vector<size_t> &rpo = cfg.reversePostorder();
+    if (rpo.empty())
+    {
+      return;
+    }
+
+    auto intersect = [&](size_t a, size_t b)
+    {
+      while (a != b)
+      {
+        while (cfg.rpoIndexOf(a) > cfg.rpoIndexOf(b))
+        {
+          a = idom[a];
+        }
+        while (cfg.rpoIndexOf(b) > cfg.rpoIndexOf(a))
+        {
+          b = idom[b];
+        }
+      }
+      return a;
+    };
+
+    idom[rpo[0]] = rpo[0];
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (size_t i = 1; i < rpo.size(); i++)
+      {
+        size_t block = rpo[i];
+        size_t newIdom = ControlFlowGraph::NONE;
+        for (size_t pred : cfg.predecessors(block))
+        {
+          if (idom[pred] == ControlFlowGraph::NONE)
+          {
+            continue;
+          }
+          newIdom = newIdom == ControlFlowGraph::NONE ? pred
+                                                      : intersect(pred, newIdom);
+        }
+        if (idom[block] != newIdom)
+        {
+          idom[block] = newIdom;
+          changed = true;
+        }
+      }
+    }
+
+    // number the tree. Children are listed in reverse postorder.
+    std::vector<std::vector<size_t>> children(cfg.size());
+    for (size_t i = 1; i < rpo.size(); i++)
+    {
+      children[idom[rpo[i]]].push_back(rpo[i]);
+    }
+
+    size_t preCount = 0, postCount = 0;
+    std::vector<std::pair<size_t, size_t>> stack{{rpo[0], 0}};
+    pre[rpo[0]] = preCount++;
+    while (!stack.empty())
+    {
+      auto &[block, next] = stack.back();
+      if (next < children[block].size())
+      {
+        size_t child = children[block][next++];
+        pre[child] = preCount++;
+        stack.push_back({child, 0});
+        continue;
+      }
+      post[block] = postCount++;
+      stack.pop_back();
+    }
+  }
+
+  bool DominatorTree::dominates(size_t a, size_t b) const
+  {
+    return pre[a] != ControlFlowGraph::NONE &&
+           pre[b] != ControlFlowGraph::NONE && pre[a] <= pre[b] &&
+           post[b] <= post[a];
+  }
+
+  LoopInfo::LoopInfo(const ControlFlowGraph &cfg, const DominatorTree &domTree)
+      : innermost(cfg.size(), NONE)
+  {
+    // headers in reverse postorder, so enclosing loops come first.
+    for (size_t block : cfg.reversePostorder())
+    {
+      const std::vector<size_t> &preds = cfg.predecessors(block);
+      if (std::any_of(preds.begin(), preds.end(), [&](size_t pred)
+                      { return domTree.dominates(block, pred); }))
+      {
+        loopList.push_back({block, {}, NONE, 1});
+      }
+    }
+
+    std::vector<bool> inLoop(cfg.size());
+    for (size_t loop = 0; loop < loopList.size(); loop++)
+    {
+      Loop &l = loopList[loop];
+
+      // walk back from the sources of the back edges until the header.
+      std::vector<size_t> body{l.header};
+      std::vector<size_t> workList;
+      inLoop[l.header] = true;
+      for (size_t pred : cfg.predecessors(l.header))
+      {
+        if (domTree.dominates(l.header, pred) && !inLoop[pred])
+        {
+          inLoop[pred] = true;
+          body.push_back(pred);
+          workList.push_back(pred);
+        }
+      }
+      while (!workList.empty())
+      {
+        size_t block = workList.back();
+        workList.pop_back();
+        for (size_t pred : cfg.predecessors(block))
+        {
+          if (cfg.isReachable(pred) && !inLoop[pred])
+          {
+            inLoop[pred] = true;
+            body.push_back(pred);
+            workList.push_back(pred);
+          }
+        }
+      }
+
+      std::sort(body.begin(), body.end(), [&](size_t a, size_t b)
+                { return cfg.rpoIndexOf(a) < cfg.rpoIndexOf(b); });
+      for (size_t block : body)
+      {
+        inLoop[block] = false;
+      }
+
+      // enclosing loops have been assigned already.
+      l.parent = innermost[l.header];
+      l.depth = l.parent == NONE ? 1 : loopList[l.parent].depth + 1;
+      for (size_t block : body)
+      {
+        innermost[block] = loop;
+      }
+      l.blocks = std::move(body);
+    }
+  }
+
+  std::optional<std::vector<int>> openFrames(const PixIRFunction &func,
+                                             const ControlFlowGraph &cfg)
+  {
+    std::vector<int> open(cfg.size());
+    std::vector<bool> known(cfg.size());
+    if (cfg.size() > 0)
+    {
+      known[0] = true;
+    }
+
+    for (size_t block : cfg.reversePostorder())
+    {
+      int frames = open[block];
+      for (const PixIRInstruction &instr : func.blocks[block]->instrs)
+      {
+        // the rest of the block is never run.
+        if (instr.opcode == PixIROpcode::RET ||
+            instr.opcode == PixIROpcode::HALT)
+        {
+          break;
+        }
+        if (instr.opcode == PixIROpcode::OFRAME)
+        {
+          frames++;
+        }
+        else if (instr.opcode == PixIROpcode::CFRAME && --frames < 0)
+        {
+          return std::nullopt;
+        }
+      }
+
+      for (size_t succ : cfg.successors(block))
+      {
+        if (!known[succ])
+        {
+          known[succ] = true;
+          open[succ] = frames;
+        }
+        else if (open[succ] != frames)
+        {
+          return std::nullopt;
+        }
+      }
+    }
+    return open;
+  }
+
+} // namespace codegen
@@ -0,0 +1,130 @@
+#ifndef CFG_H_
+#define CFG_H_
+
+#include "codegen.hh"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace codegen
+{
+
+  // Control-flow graph of a function that hasn't been linearized yet. Blocks
+  // are identified by their index in the function, and block 0 is the entry.
+  //
+  // A block ends at its first RET or HALT, which leave the function. Otherwise
+  // it may end with PUSH <block> and JMP, which jumps to that block, or PUSH
+  // <block> and CJMP/CJMP2, which jumps to it or falls through to the next
+  // block. Any other block falls through.
+  //
+  // The graph is a snapshot: it has to be rebuilt once blocks or jumps change.
+  class ControlFlowGraph
+  {
+  private:
+    std::unordered_map<const BasicBlock *, size_t> ids;
+    std::vector<std::vector<size_t>> succs;
+    std::vector<std::vector<size_t>> preds;
+    std::vector<size_t> rpo;
+    // position of each block in rpo, or NONE if it is unreachable.
+    std::vector<size_t> rpoIndex;
+
+  public:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    explicit ControlFlowGraph(const PixIRFunction &func);
+
+    size_t size() const { return succs.size(); }
+    size_t idOf(const BasicBlock *block) const { return ids.at(block); }
+
+    // jump targets come before the block fallen through to.
+    const std::vector<size_t> &successors(size_t block) const
+    {
+      return succs[block];
+    }
+    const std::vector<size_t> &predecessors(size_t block) const
+    {
+      return preds[block];
+    }
+
+    // the blocks reachable from the entry, each before its successors except
+    // along back edges.
+    const std::vector<size_t> &reversePostorder() const { return rpo; }
+    size_t rpoIndexOf(size_t block) const { return rpoIndex[block]; }
+    bool isReachable(size_t block) const { return rpoIndex[block] != NONE; }
+
+    // the block jumped to by the end of block, if any.
+    static const BasicBlock *jumpTarget(const BasicBlock &block);
+  };
+
+  // Dominators of the reachable blocks of a ControlFlowGraph, computed with
+  // the algorithm of Cooper, Harvey and Kennedy.
+  class DominatorTree
+  {
+  private:
+    std::vector<size_t> idom;
+    // preorder and postorder numbers in the tree, so dominance can be checked
+    // in constant time.
+    std::vector<size_t> pre, post;
+
+  public:
+    explicit DominatorTree(const ControlFlowGraph &cfg);
+
+    // the entry is its own immediate dominator. Unreachable blocks have none.
+    size_t immediateDominator(size_t block) const { return idom[block]; }
+
+    // whether every path from the entry to b goes through a. Each block
+    // dominates itself. False if either block is unreachable.
+    bool dominates(size_t a, size_t b) const;
+  };
+
+  // Natural loops of a ControlFlowGraph, found from the back edges to blocks
+  // which dominate their source. Loops sharing a header are merged.
+  class LoopInfo
+  {
+  public:
+    struct Loop
+    {
+      size_t header;
+      // the blocks of the loop, including those of nested loops, in reverse
+      // postorder.
+      std::vector<size_t> blocks;
+      // the innermost enclosing loop, or NONE.
+      size_t parent;
+      // 1 for outermost loops.
+      size_t depth;
+    };
+
+  private:
+    // outer loops come before the loops nested in them.
+    std::vector<Loop> loopList;
+    std::vector<size_t> innermost;
+
+  public:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    LoopInfo(const ControlFlowGraph &cfg, const DominatorTree &domTree);
+
+    const std::vector<Loop> &loops() const { return loopList; }
+
+    // the innermost loop containing block, or NONE.
+    size_t loopOf(size_t block) const { return innermost[block]; }
+
+    // the number of loops containing block.
+    size_t depthOf(size_t block) const
+    {
+      return innermost[block] == NONE ? 0 : loopList[innermost[block]].depth;
+    }
+  };
+
+  // the number of frames a function has opened with OFRAME and not closed
+  // yet when each block is entered, or nullopt if it differs between paths
+  // to a block, or a block closes more frames than are open. Unreachable
+  // blocks have 0.
+  std::optional<std::vector<int>> openFrames(const PixIRFunction &func,
+                                             const ControlFlowGraph &cfg);
+
+} // namespace codegen
+
+#endif // CFG_H_
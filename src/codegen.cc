@@ -1,12 +1,32 @@
 #include "codegen.hh"
 #include "ast.hh"
+#include "cfg.hh"
+#include "thread_pool.hh"
 
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
 #include <iomanip>
+#include <optional>
 #include <sstream>
 
 namespace codegen
 {
 
+  void CodeGenerator::pushFrameIndexMap(
+      std::map<std::string, FrameIndexMap::FrameIndex> &&frameIndices)
+  {
+    frameIndexMaps.push_back(
+        std::make_unique<FrameIndexMap>(std::move(frameIndices), frameIndexMap));
+    frameIndexMap = frameIndexMaps.back().get();
+  }
+
+  void CodeGenerator::popFrameIndexMap()
+  {
+    frameIndexMap = frameIndexMap->parent;
+    frameIndexMaps.pop_back();
+  }
+
   void CodeGenerator::enterFuncDefFrame(ast::FuncDeclStmt &node)
   {
     frameLevels.push(0);
@@ -43,10 +63,7 @@ namespace codegen
       }
     }
 
-    // NOTE: Fragile release/reset ordering that relies on applicative-order
-    // evaluation.
-    frameIndexMap.reset(
-        new FrameIndexMap(std::move(frameIndices), frameIndexMap.release()));
+    pushFrameIndexMap(std::move(frameIndices));
 
     int allocSize = frameIndex - node.params.size();
     if (allocSize > 0)
@@ -62,7 +79,7 @@ namespace codegen
     frameLevels.pop();
     currentScope = currentScope->parent;
 
-    frameIndexMap.reset(frameIndexMap->parent);
+    popFrameIndexMap();
   }
 
   void CodeGenerator::enterMainFrame(ast::TranslationUnit &node)
@@ -83,8 +100,7 @@ namespace codegen
       }
     }
 
-    frameIndexMap.reset(
-        new FrameIndexMap(std::move(frameIndices), frameIndexMap.release()));
+    pushFrameIndexMap(std::move(frameIndices));
 
     if (frameIndex > 0)
     {
@@ -98,7 +114,7 @@ namespace codegen
     frameLevels.pop();
     currentScope = currentScope->parent;
 
-    frameIndexMap.reset(frameIndexMap->parent);
+    popFrameIndexMap();
 
     addInstr({PixIROpcode::HALT});
   }
@@ -123,8 +139,7 @@ namespace codegen
       }
     }
 
-    frameIndexMap.reset(
-        new FrameIndexMap(std::move(frameIndices), frameIndexMap.release()));
+    pushFrameIndexMap(std::move(frameIndices));
 
     addInstr({PixIROpcode::PUSH, std::to_string(frameIndex)});
     addInstr({PixIROpcode::OFRAME});
@@ -137,7 +152,7 @@ namespace codegen
 
     addInstr({PixIROpcode::CFRAME});
 
-    frameIndexMap.reset(frameIndexMap->parent);
+    popFrameIndexMap();
   }
 
   BasicBlock *CodeGenerator::terminateBlock()
@@ -166,71 +181,74 @@ namespace codegen
 
   void CodeGenerator::endFunc() { blockStack.pop(); }
 
-  void CodeGenerator::visit(ast::BinaryExprNode &node)
+  static PixIROpcode binaryOpcode(ast::BinaryExprNode::BinaryOp op)
   {
-    rvisitChildren(&node);
-    switch (node.op)
+    switch (op)
     {
     case ast::BinaryExprNode::BinaryOp::ADD:
-      addInstr({PixIROpcode::ADD});
-      break;
+      return PixIROpcode::ADD;
     case ast::BinaryExprNode::BinaryOp::SUB:
-      addInstr({PixIROpcode::SUB});
-      break;
+      return PixIROpcode::SUB;
     case ast::BinaryExprNode::BinaryOp::DIV:
-      addInstr({PixIROpcode::DIV});
-      break;
+      return PixIROpcode::DIV;
     case ast::BinaryExprNode::BinaryOp::MUL:
-      addInstr({PixIROpcode::MUL});
-      break;
+      return PixIROpcode::MUL;
     case ast::BinaryExprNode::BinaryOp::AND:
-      addInstr({PixIROpcode::AND});
-      break;
+      return PixIROpcode::AND;
     case ast::BinaryExprNode::BinaryOp::OR:
-      addInstr({PixIROpcode::OR});
-      break;
+      return PixIROpcode::OR;
     case ast::BinaryExprNode::BinaryOp::GREATER:
-      addInstr({PixIROpcode::GT});
-      break;
+      return PixIROpcode::GT;
     case ast::BinaryExprNode::BinaryOp::LESS:
-      addInstr({PixIROpcode::LT});
-      break;
+      return PixIROpcode::LT;
     case ast::BinaryExprNode::BinaryOp::EQ:
-      addInstr({PixIROpcode::EQ});
-      break;
+      return PixIROpcode::EQ;
     case ast::BinaryExprNode::BinaryOp::NEQ:
-      addInstr({PixIROpcode::NEQ});
-      break;
+      return PixIROpcode::NEQ;
     case ast::BinaryExprNode::BinaryOp::GE:
-      addInstr({PixIROpcode::GE});
-      break;
+      return PixIROpcode::GE;
     case ast::BinaryExprNode::BinaryOp::LE:
-      addInstr({PixIROpcode::LE});
-      break;
+      return PixIROpcode::LE;
     }
+    throw std::logic_error("Unknown binary operator.");
+  }
+
+  void CodeGenerator::visit(ast::BinaryExprNode &node)
+  {
+    rvisitChildren(&node);
+    schedule([this, &node]
+             { addInstr({binaryOpcode(node.op)}); });
   }
 
   void CodeGenerator::visit(ast::UnaryExprNode &node)
   {
     rvisitChildren(&node);
-    switch (node.op)
-    {
-    case ast::UnaryExprNode::UnaryOp::NOT:
-      addInstr({PixIROpcode::NOT});
-      break;
-    case ast::UnaryExprNode::UnaryOp::MINUS:
-      addInstr({PixIROpcode::PUSH, "0"});
-      addInstr({PixIROpcode::SUB});
-      break;
-    }
+    schedule([this, &node]
+             {
+               switch (node.op)
+               {
+               case ast::UnaryExprNode::UnaryOp::NOT:
+                 addInstr({PixIROpcode::NOT});
+                 break;
+               case ast::UnaryExprNode::UnaryOp::MINUS:
+                 addInstr({PixIROpcode::PUSH, "0"});
+                 addInstr({PixIROpcode::SUB});
+                 break;
+               }
+             });
   }
 
   void CodeGenerator::visit(ast::FunctionCallNode &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PUSH, std::to_string(node.children().size())});
-    addInstr({PixIROpcode::PUSH, "." + node.funcName});
-    addInstr({PixIROpcode::CALL});
+    schedule([this, &node]
+             {
+               std::string label = "." + node.funcName;
+               blockStack.top()->parentFunc->callees.push_back(label);
+               addInstr({PixIROpcode::PUSH, std::to_string(node.args.size())});
+               addInstr({PixIROpcode::PUSH, std::move(label)});
+               addInstr({PixIROpcode::CALL});
+             });
   }
 
   void CodeGenerator::visit(ast::IdExprNode &node)
@@ -292,25 +310,29 @@ namespace codegen
   void CodeGenerator::visit(ast::ReadExprNode &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::READ});
+    schedule([this]
+             { addInstr({PixIROpcode::READ}); });
   }
 
   void CodeGenerator::visit(ast::RandiExprNode &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::IRND});
+    schedule([this]
+             { addInstr({PixIROpcode::IRND}); });
   }
 
   void CodeGenerator::visit(ast::NewArrExprNode &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::ALLOCA});
+    schedule([this]
+             { addInstr({PixIROpcode::ALLOCA}); });
   }
 
   void CodeGenerator::visit(ast::ArrayAccessNode &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::LDA});
+    schedule([this]
+             { addInstr({PixIROpcode::LDA}); });
   }
 
   void CodeGenerator::visit(ast::GetCharNode &)
@@ -323,21 +345,25 @@ namespace codegen
     rvisitChildren(&node);
     // while the Pixel VM only uses IEEE754 floating point numbers, we still need to round
     // the number to a whole number.
-    addInstr({PixIROpcode::ROUND});
+    schedule([this]
+             { addInstr({PixIROpcode::ROUND}); });
   }
 
   void CodeGenerator::visit(ast::AssignmentStmt &node)
   {
     rvisitChildren(&node);
-    if (dynamic_cast<ast::ArrayAccessNode *>(node.lvalue.get()) != nullptr)
-    {
-      popInstr();
-      addInstr({PixIROpcode::STA});
-    }
-    else if (dynamic_cast<ast::IdExprNode *>(node.lvalue.get()) != nullptr)
-    {
-      addInstr({PixIROpcode::ST});
-    }
+    schedule([this, &node]
+             {
+               if (node.lvalue->is<ast::ArrayAccessNode>())
+               {
+                 popInstr();
+                 addInstr({PixIROpcode::STA});
+               }
+               else if (node.lvalue->is<ast::IdExprNode>())
+               {
+                 addInstr({PixIROpcode::ST});
+               }
+             });
   }
 
   // nothing to generate here. Space for variables is allocated when entering a
@@ -349,163 +375,1148 @@ namespace codegen
     auto [depth, index] = frameIndexMap->getDepthAndIndex(node.id);
 
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PUSH, std::to_string(index)});
-    addInstr({PixIROpcode::PUSH, std::to_string(depth)});
-    addInstr({PixIROpcode::ST});
+    schedule([this, depth = depth, index = index]
+             {
+               addInstr({PixIROpcode::PUSH, std::to_string(index)});
+               addInstr({PixIROpcode::PUSH, std::to_string(depth)});
+               addInstr({PixIROpcode::ST});
+             });
   }
 
   void CodeGenerator::visit(ast::PrintStmt &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PRINT});
+    schedule([this]
+             { addInstr({PixIROpcode::PRINT}); });
   }
 
   void CodeGenerator::visit(ast::DelayStmt &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::DELAY});
+    schedule([this]
+             { addInstr({PixIROpcode::DELAY}); });
   }
 
   void CodeGenerator::visit(ast::PixelStmt &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PIXEL});
+    schedule([this]
+             { addInstr({PixIROpcode::PIXEL}); });
   }
 
   void CodeGenerator::visit(ast::PixelRStmt &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PIXELR});
+    schedule([this]
+             { addInstr({PixIROpcode::PIXELR}); });
   }
 
   void CodeGenerator::visit(ast::ReturnStmt &node)
   {
     rvisitChildren(&node);
-    for (int i = frameLevels.top(); i > 0; i--)
-    {
-      addInstr({PixIROpcode::CFRAME});
-    }
-    addInstr({PixIROpcode::RET});
+    schedule([this]
+             {
+               for (int i = frameLevels.top(); i > 0; i--)
+               {
+                 addInstr({PixIROpcode::CFRAME});
+               }
+               addInstr({PixIROpcode::RET});
+             });
   }
 
   void CodeGenerator::visit(ast::PutCharStmt &node)
   {
     rvisitChildren(&node);
-    addInstr({PixIROpcode::PUTCHAR});
+    schedule([this]
+             { addInstr({PixIROpcode::PUTCHAR}); });
   }
 
   void CodeGenerator::visit(ast::IfElseStmt &node)
   {
-    BasicBlock *head, *ifBlock, *elseBlock, *after;
-
     terminateBlock();
-    node.cond->accept(this);
+    schedule(node.cond.get());
 
-    head = terminateBlock();
+    // head
+    schedule([this]
+             { pendingBlocks.push(terminateBlock()); });
     if (node.elseBody != nullptr)
     {
-      node.elseBody->accept(this);
+      schedule(node.elseBody.get());
     }
 
-    elseBlock = terminateBlock();
+    // else block, then the if block
+    schedule([this]
+             {
+               pendingBlocks.push(terminateBlock());
+               pendingBlocks.push(blockStack.top());
+             });
+    schedule(node.ifBody.get());
+
+    schedule([this]
+             {
+               terminateBlock();
+
+               BasicBlock *after = blockStack.top();
+               BasicBlock *ifBlock = popPendingBlock();
+               BasicBlock *elseBlock = popPendingBlock();
+               BasicBlock *head = popPendingBlock();
+
+               head->instrs.push_back({PixIROpcode::PUSH, ifBlock});
+               head->instrs.push_back({PixIROpcode::CJMP2});
+
+               elseBlock->instrs.push_back({PixIROpcode::PUSH, after});
+               elseBlock->instrs.push_back({PixIROpcode::JMP});
+             });
+  }
 
-    ifBlock = blockStack.top();
-    node.ifBody->accept(this);
-    terminateBlock();
+  void CodeGenerator::generateLoop(ast::ExprNode *cond, ast::StmtNode *body,
+                                   ast::StmtNode *update, size_t copies)
+  {
+    schedule([this]
+             { terminateBlock(); });
+    schedule(cond);
+    schedule([this]
+             {
+               // !cond.
+               addInstr({PixIROpcode::PUSH, "1"});
+               addInstr({PixIROpcode::SUB});
+
+               // head, then the first block of the rotated loop body.
+               pendingBlocks.push(terminateBlock());
+               if (opts.rotateLoops)
+               {
+                 pendingBlocks.push(blockStack.top());
+               }
+             });
+
+    for (size_t i = 0; i < copies; i++)
+    {
+      schedule(body);
+      if (update != nullptr)
+      {
+        schedule(update);
+      }
+    }
+
+    if (opts.rotateLoops)
+    {
+      schedule(cond);
+      schedule([this]
+               {
+                 addInstr({PixIROpcode::PUSH, popPendingBlock()});
+                 addInstr({PixIROpcode::CJMP2});
+               });
+    }
+    else
+    {
+      schedule([this]
+               {
+                 addInstr({PixIROpcode::PUSH, pendingBlocks.top()});
+                 addInstr({PixIROpcode::JMP});
+               });
+    }
+
+    // after block
+    schedule([this]
+             {
+               terminateBlock();
+               BasicBlock *after = blockStack.top();
+               BasicBlock *head = popPendingBlock();
+
+               head->instrs.push_back({PixIROpcode::PUSH, after});
+               head->instrs.push_back({PixIROpcode::CJMP2});
+             });
+  }
 
-    after = blockStack.top();
+  // integer variables which are initialized with a constant and never
+  // assigned, keyed by the function declaring them (null for main) and name.
+  using ConstantVars =
+      std::map<std::pair<const ast::FuncDeclStmt *, std::string>, long long>;
 
-    head->instrs.push_back({PixIROpcode::PUSH, ifBlock});
-    head->instrs.push_back({PixIROpcode::CJMP2});
+  // the value of an integer expression made of literals and constant
+  // variables of func, if it is small enough not to overflow.
+  static std::optional<long long> constantValue(ast::ExprNode *expr,
+                                                const ast::FuncDeclStmt *func,
+                                                const ConstantVars &vars)
+  {
+    std::optional<long long> value;
+    if (auto *literal = expr->as<ast::IntLiteralExprNode>())
+    {
+      value = literal->x;
+    }
+    else if (auto *id = expr->as<ast::IdExprNode>())
+    {
+      auto it = vars.find({func, id->id});
+      if (it != vars.end())
+      {
+        value = it->second;
+      }
+    }
+    else if (auto *unary = expr->as<ast::UnaryExprNode>())
+    {
+      std::optional<long long> operand =
+          constantValue(unary->operand.get(), func, vars);
+      if (operand && unary->op == ast::UnaryExprNode::UnaryOp::MINUS)
+      {
+        value = -*operand;
+      }
+    }
+    else if (auto *binary = expr->as<ast::BinaryExprNode>())
+    {
+      std::optional<long long> left =
+          constantValue(binary->left.get(), func, vars);
+      std::optional<long long> right =
+          constantValue(binary->right.get(), func, vars);
+      if (left && right)
+      {
+        switch (binary->op)
+        {
+        case ast::BinaryExprNode::ADD:
+          value = *left + *right;
+          break;
+        case ast::BinaryExprNode::SUB:
+          value = *left - *right;
+          break;
+        case ast::BinaryExprNode::MUL:
+          value = *left * *right;
+          break;
+        default:
+          break;
+        }
+      }
+    }
+    if (value && (*value > INT32_MAX || *value < INT32_MIN))
+    {
+      return std::nullopt;
+    }
+    return value;
+  }
 
-    elseBlock->instrs.push_back({PixIROpcode::PUSH, after});
-    elseBlock->instrs.push_back({PixIROpcode::JMP});
+  static bool isId(ast::ExprNode *expr, const std::string &id)
+  {
+    auto *idExpr = expr->as<ast::IdExprNode>();
+    return idExpr != nullptr && idExpr->id == id;
   }
 
-  void CodeGenerator::visit(ast::ForStmt &node)
+  // loops running more times than this aren't counted.
+  static const long long MAX_TRIP_COUNT = 1 << 16;
+
+  // the number of iterations of a loop like
+  //   for (let i: int = a; i < b; i = i + c) { ... }
+  // where a, b and c are constants, the comparison is any but ==, and the
+  // update adds or subtracts. The body mustn't assign i. Loops which don't
+  // end, or run more than MAX_TRIP_COUNT times, have no count.
+  static std::optional<long long> tripCount(ast::ForStmt &node,
+                                            const ast::FuncDeclStmt *func,
+                                            const ConstantVars &vars)
   {
-    enterFrame(&node);
+    auto *decl = node.varDecl ? node.varDecl->as<ast::VariableDeclStmt>()
+                              : nullptr;
+    auto *cond = node.cond->as<ast::BinaryExprNode>();
+    auto *update = node.assignment
+                       ? node.assignment->as<ast::AssignmentStmt>()
+                       : nullptr;
+    if (!decl || !decl->type->is<ast::IntTypeNode>() || !cond || !update ||
+        cond->op == ast::BinaryExprNode::EQ)
+    {
+      return std::nullopt;
+    }
+    const std::string &id = decl->id;
 
-    BasicBlock *head, *body, *after;
+    std::optional<long long> start =
+        constantValue(decl->initExpr.get(), func, vars);
+    std::optional<long long> bound =
+        constantValue(cond->right.get(), func, vars);
+    if (!start || !bound || !isId(cond->left.get(), id))
+    {
+      return std::nullopt;
+    }
 
-    // loop entry
-    terminateBlock();
-    node.varDecl->accept(this);
+    auto *step = update->expr->as<ast::BinaryExprNode>();
+    if (!isId(update->lvalue.get(), id) || !step)
+    {
+      return std::nullopt;
+    }
+    std::optional<long long> stride;
+    if (step->op == ast::BinaryExprNode::ADD && isId(step->left.get(), id))
+    {
+      stride = constantValue(step->right.get(), func, vars);
+    }
+    else if (step->op == ast::BinaryExprNode::ADD &&
+             isId(step->right.get(), id))
+    {
+      stride = constantValue(step->left.get(), func, vars);
+    }
+    else if (step->op == ast::BinaryExprNode::SUB &&
+             isId(step->left.get(), id))
+    {
+      stride = constantValue(step->right.get(), func, vars);
+      if (stride)
+      {
+        stride = -*stride;
+      }
+    }
+    if (!stride || *stride == 0)
+    {
+      return std::nullopt;
+    }
 
-    terminateBlock();
-    node.cond->accept(this);
-    // !node.cond.
-    addInstr({PixIROpcode::PUSH, "1"});
-    addInstr({PixIROpcode::SUB});
+    // the body may not assign the variable, or declare functions, which
+    // would be generated once per copy.
+    std::vector<ast::ASTNode *> pending{node.body.get()};
+    while (!pending.empty())
+    {
+      ast::ASTNode *n = pending.back();
+      pending.pop_back();
+      if (n == nullptr)
+      {
+        continue;
+      }
+      if (n->is<ast::FuncDeclStmt>())
+      {
+        return std::nullopt;
+      }
+      auto *assignment = n->as<ast::AssignmentStmt>();
+      if (assignment && isId(assignment->lvalue.get(), id))
+      {
+        return std::nullopt;
+      }
+      for (ast::ASTNode *child : n->children())
+      {
+        pending.push_back(child);
+      }
+    }
 
-    if (opts.rotateLoops)
+    auto holds = [&](long long i)
     {
-      // rotated loop body
-      head = terminateBlock();
-      body = blockStack.top();
-      node.body->accept(this);
-      node.assignment->accept(this);
+      switch (cond->op)
+      {
+      case ast::BinaryExprNode::LESS:
+        return i < *bound;
+      case ast::BinaryExprNode::LE:
+        return i <= *bound;
+      case ast::BinaryExprNode::GREATER:
+        return i > *bound;
+      case ast::BinaryExprNode::GE:
+        return i >= *bound;
+      case ast::BinaryExprNode::NEQ:
+        return i != *bound;
+      default:
+        return false;
+      }
+    };
 
-      node.cond->accept(this);
-      addInstr({PixIROpcode::PUSH, body});
-      addInstr({PixIROpcode::CJMP2});
+    long long trips = 0;
+    for (long long i = *start; holds(i); i += *stride)
+    {
+      if (++trips > MAX_TRIP_COUNT)
+      {
+        return std::nullopt;
+      }
     }
-    else
+    return trips;
+  }
+
+  std::map<const ast::ForStmt *, long long>
+  CodeGenerator::countLoopTrips(ast::TranslationUnit &tu)
+  {
+    // names declared more than once could refer to different variables, and
+    // assigned ones aren't constant.
+    std::map<std::string, int> declarations;
+    std::set<std::string> assigned;
+    std::vector<ast::ASTNode *> pending{&tu};
+    while (!pending.empty())
     {
-      // regular loop body
-      head = terminateBlock();
-      node.body->accept(this);
-      node.assignment->accept(this);
-      addInstr({PixIROpcode::PUSH, head});
-      addInstr({PixIROpcode::JMP});
+      ast::ASTNode *node = pending.back();
+      pending.pop_back();
+      if (node == nullptr)
+      {
+        continue;
+      }
+      if (auto *decl = node->as<ast::VariableDeclStmt>())
+      {
+        declarations[decl->id]++;
+      }
+      else if (auto *func = node->as<ast::FuncDeclStmt>())
+      {
+        for (const ast::FormalParam &param : func->params)
+        {
+          declarations[param.first]++;
+        }
+      }
+      else if (auto *assignment = node->as<ast::AssignmentStmt>())
+      {
+        if (auto *id = assignment->lvalue->as<ast::IdExprNode>())
+        {
+          assigned.insert(id->id);
+        }
+      }
+      for (ast::ASTNode *child : node->children())
+      {
+        pending.push_back(child);
+      }
     }
 
-    // after block
-    terminateBlock();
-    after = blockStack.top();
+    // visit the program in order, so a constant is known from its
+    // declaration on. Constants are only used within the function declaring
+    // them, whose code runs in order too, unlike calls to it.
+    std::map<const ast::ForStmt *, long long> counts;
+    ConstantVars vars;
+    std::vector<std::pair<ast::ASTNode *, const ast::FuncDeclStmt *>> stack{
+        {&tu, nullptr}};
+    while (!stack.empty())
+    {
+      auto [node, func] = stack.back();
+      stack.pop_back();
+      if (node == nullptr)
+      {
+        continue;
+      }
 
-    head->instrs.push_back({PixIROpcode::PUSH, after});
-    head->instrs.push_back({PixIROpcode::CJMP2});
+      if (auto *decl = node->as<ast::VariableDeclStmt>())
+      {
+        std::optional<long long> value;
+        if (declarations[decl->id] == 1 && !assigned.count(decl->id) &&
+            decl->type->is<ast::IntTypeNode>() &&
+            (value = constantValue(decl->initExpr.get(), func, vars)))
+        {
+          vars[{func, decl->id}] = *value;
+        }
+      }
+      else if (auto *loop = node->as<ast::ForStmt>())
+      {
+        if (std::optional<long long> trips = tripCount(*loop, func, vars))
+        {
+          counts[loop] = *trips;
+        }
+      }
+      else if (auto *decl = node->as<ast::FuncDeclStmt>())
+      {
+        func = decl;
+      }
 
-    exitFrame();
+      std::vector<ast::ASTNode *> children = node->children();
+      for (auto child = children.rbegin(); child != children.rend(); ++child)
+      {
+        stack.push_back({*child, func});
+      }
+    }
+    return counts;
   }
 
-  void CodeGenerator::visit(ast::WhileStmt &node)
+  // the number of nodes in the subtree rooted at node, as an estimate of the
+  // size of its code.
+  static size_t subtreeSize(ast::ASTNode *node)
   {
-    BasicBlock *head, *body, *after;
+    size_t size = 0;
+    std::vector<ast::ASTNode *> pending{node};
+    while (!pending.empty())
+    {
+      ast::ASTNode *n = pending.back();
+      pending.pop_back();
+      if (n == nullptr)
+      {
+        continue;
+      }
+      size++;
+      for (ast::ASTNode *child : n->children())
+      {
+        pending.push_back(child);
+      }
+    }
+    return size;
+  }
 
-    terminateBlock();
-    node.cond->accept(this);
-    // !node.cond.
-    addInstr({PixIROpcode::PUSH, "1"});
-    addInstr({PixIROpcode::SUB});
+  // the most AST nodes the copies of an unrolled loop's body and update may
+  // add up to.
+  static const size_t UNROLL_BUDGET = 256;
+  // the most iterations of a loop which is unrolled completely.
+  static const long long MAX_FULL_UNROLL = 32;
+  // the most copies of the body in a partially unrolled loop.
+  static const size_t MAX_UNROLL_FACTOR = 8;
+
+  // whether expr has no side effects and its value only depends on the
+  // variables it reads, so it can be evaluated once in place of many times.
+  // Divisions are left out, as their results needn't be whole numbers.
+  static bool isSimpleExpr(ast::ExprNode *expr)
+  {
+    std::vector<ast::ASTNode *> pending{expr};
+    while (!pending.empty())
+    {
+      ast::ASTNode *node = pending.back();
+      pending.pop_back();
+      switch (node->kind)
+      {
+      case ast::IdExprNode::KIND:
+      case ast::IntLiteralExprNode::KIND:
+      case ast::FloatLiteralExprNode::KIND:
+      case ast::BoolLiteralExprNode::KIND:
+      case ast::ColourLiteralExprNode::KIND:
+      case ast::PadWidthExprNode::KIND:
+      case ast::PadHeightExprNode::KIND:
+      case ast::UnaryExprNode::KIND:
+      case ast::Float2IntNode::KIND:
+        break;
+      case ast::BinaryExprNode::KIND:
+        if (node->as<ast::BinaryExprNode>()->op == ast::BinaryExprNode::DIV)
+        {
+          return false;
+        }
+        break;
+      default:
+        return false;
+      }
+      for (ast::ASTNode *child : node->children())
+      {
+        pending.push_back(child);
+      }
+    }
+    return true;
+  }
 
-    if (opts.rotateLoops)
+  static bool mentions(ast::ASTNode *node, const std::string &id)
+  {
+    std::vector<ast::ASTNode *> pending{node};
+    while (!pending.empty())
+    {
+      ast::ASTNode *n = pending.back();
+      pending.pop_back();
+      if (n == nullptr)
+      {
+        continue;
+      }
+      auto *idExpr = n->as<ast::IdExprNode>();
+      if (idExpr != nullptr && idExpr->id == id)
+      {
+        return true;
+      }
+      for (ast::ASTNode *child : n->children())
+      {
+        pending.push_back(child);
+      }
+    }
+    return false;
+  }
+
+  // whether two simple expressions are written the same way, so they have
+  // the same value where no variable is assigned between them.
+  static bool sameExpr(ast::ExprNode *a, ast::ExprNode *b)
+  {
+    std::vector<std::pair<ast::ASTNode *, ast::ASTNode *>> pending{{a, b}};
+    while (!pending.empty())
+    {
+      auto [x, y] = pending.back();
+      pending.pop_back();
+      if (x->kind != y->kind)
+      {
+        return false;
+      }
+
+      bool same = true;
+      switch (x->kind)
+      {
+      case ast::IdExprNode::KIND:
+        same = x->as<ast::IdExprNode>()->id == y->as<ast::IdExprNode>()->id;
+        break;
+      case ast::IntLiteralExprNode::KIND:
+        same = x->as<ast::IntLiteralExprNode>()->x ==
+               y->as<ast::IntLiteralExprNode>()->x;
+        break;
+      case ast::FloatLiteralExprNode::KIND:
+        same = x->as<ast::FloatLiteralExprNode>()->x ==
+               y->as<ast::FloatLiteralExprNode>()->x;
+        break;
+      case ast::BoolLiteralExprNode::KIND:
+        same = x->as<ast::BoolLiteralExprNode>()->x ==
+               y->as<ast::BoolLiteralExprNode>()->x;
+        break;
+      case ast::ColourLiteralExprNode::KIND:
+        same = x->as<ast::ColourLiteralExprNode>()->colour ==
+               y->as<ast::ColourLiteralExprNode>()->colour;
+        break;
+      case ast::UnaryExprNode::KIND:
+        same = x->as<ast::UnaryExprNode>()->op ==
+               y->as<ast::UnaryExprNode>()->op;
+        break;
+      case ast::BinaryExprNode::KIND:
+        same = x->as<ast::BinaryExprNode>()->op ==
+               y->as<ast::BinaryExprNode>()->op;
+        break;
+      default:
+        break;
+      }
+      if (!same)
+      {
+        return false;
+      }
+
+      std::vector<ast::ASTNode *> xs = x->children(), ys = y->children();
+      for (size_t i = 0; i < xs.size(); i++)
+      {
+        pending.push_back({xs[i], ys[i]});
+      }
+    }
+    return true;
+  }
+
+  struct PixelSpan
+  {
+    // an int expression plus a constant, where a null expression stands
+    // for 0.
+    struct Affine
+    {
+      ast::ExprNode *expr = nullptr;
+      long long offset = 0;
+
+      bool sameBase(const Affine &other) const
+      {
+        return expr == nullptr ? other.expr == nullptr
+                               : other.expr != nullptr &&
+                                     sameExpr(expr, other.expr);
+      }
+    };
+
+    // end - start + offset, where null expressions stand for 0.
+    struct Extent
+    {
+      ast::ExprNode *end = nullptr;
+      ast::ExprNode *start = nullptr;
+      long long offset = 0;
+
+      bool isConstant() const { return end == nullptr && start == nullptr; }
+      bool isUnit() const { return isConstant() && offset == 1; }
+    };
+
+    Affine x, y;
+    Extent w, h;
+    ast::ExprNode *colour;
+  };
+
+  // splits the integer literals added to or subtracted from expr off it.
+  static PixelSpan::Affine affine(ast::ExprNode *expr)
+  {
+    PixelSpan::Affine result{expr, 0};
+    while (result.expr != nullptr)
+    {
+      if (auto *literal = result.expr->as<ast::IntLiteralExprNode>())
+      {
+        result.offset += literal->x;
+        result.expr = nullptr;
+        break;
+      }
+      auto *binary = result.expr->as<ast::BinaryExprNode>();
+      if (binary == nullptr)
+      {
+        break;
+      }
+      auto *left = binary->left->as<ast::IntLiteralExprNode>();
+      auto *right = binary->right->as<ast::IntLiteralExprNode>();
+      if (binary->op == ast::BinaryExprNode::ADD && right)
+      {
+        result.offset += right->x;
+        result.expr = binary->left.get();
+      }
+      else if (binary->op == ast::BinaryExprNode::ADD && left)
+      {
+        result.offset += left->x;
+        result.expr = binary->right.get();
+      }
+      else if (binary->op == ast::BinaryExprNode::SUB && right)
+      {
+        result.offset -= right->x;
+        result.expr = binary->left.get();
+      }
+      else
+      {
+        break;
+      }
+    }
+    return result;
+  }
+
+  // the pixels drawn by a run of pixel statements of a single colour, as
+  // vertical spans and then horizontal ones. As the colour is the same, the
+  // order they are drawn in doesn't matter.
+  static std::vector<PixelSpan>
+  pixelSpans(const std::vector<ast::PixelStmt *> &pixels)
+  {
+    struct Point
+    {
+      PixelSpan::Affine x, y;
+      bool drawn;
+    };
+    std::vector<Point> points;
+    for (ast::PixelStmt *pixel : pixels)
+    {
+      points.push_back({affine(pixel->x.get()), affine(pixel->y.get()), false});
+    }
+
+    std::vector<PixelSpan> spans;
+    ast::ExprNode *colour = pixels.front()->colour.get();
+    const PixelSpan::Extent unit{nullptr, nullptr, 1};
+    // joins the pixels not drawn yet in line with points[i] along the y axis,
+    // or the x axis, into spans. Single pixels are only drawn if single is
+    // set.
+    auto join = [&](size_t i, bool vertical, bool single)
+    {
+      auto along = [vertical](auto &p) -> PixelSpan::Affine &
+      {
+        return vertical ? p.y : p.x;
+      };
+      auto across = [vertical](auto &p) -> PixelSpan::Affine &
+      {
+        return vertical ? p.x : p.y;
+      };
+
+      std::set<long long> offsets;
+      std::vector<size_t> line;
+      for (size_t j = i; j < points.size(); j++)
+      {
+        Point &p = points[j];
+        if (!p.drawn && across(p).sameBase(across(points[i])) &&
+            across(p).offset == across(points[i]).offset &&
+            along(p).sameBase(along(points[i])))
+        {
+          offsets.insert(along(p).offset);
+          line.push_back(j);
+        }
+      }
+
+      for (auto it = offsets.begin(); it != offsets.end();)
+      {
+        long long first = *it, last = *it;
+        while (++it != offsets.end() && *it == last + 1)
+        {
+          last = *it;
+        }
+        if (first == last && !single)
+        {
+          continue;
+        }
+
+        PixelSpan span{points[i].x, points[i].y, unit, unit, colour};
+        along(span) = {along(points[i]).expr, first};
+        (vertical ? span.h : span.w) = {nullptr, nullptr, last - first + 1};
+        spans.push_back(span);
+        for (size_t j : line)
+        {
+          if (along(points[j]).offset >= first &&
+              along(points[j]).offset <= last)
+          {
+            points[j].drawn = true;
+          }
+        }
+      }
+    };
+
+    for (size_t i = 0; i < points.size(); i++)
     {
-      // rotated loop body
-      head = terminateBlock();
-      body = blockStack.top();
-      node.body->accept(this);
+      if (!points[i].drawn)
+      {
+        join(i, true, false);
+      }
+    }
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      if (!points[i].drawn)
+      {
+        join(i, false, true);
+      }
+    }
+    return spans;
+  }
 
-      node.cond->accept(this);
-      addInstr({PixIROpcode::PUSH, body});
-      addInstr({PixIROpcode::CJMP2});
+  // whether stmt is a pixel statement with simple operands, drawn in the
+  // same colour as first unless first is null.
+  static bool isSimplePixel(ast::PixelStmt *pixel, ast::PixelStmt *first)
+  {
+    return pixel != nullptr && isSimpleExpr(pixel->x.get()) &&
+           isSimpleExpr(pixel->y.get()) && isSimpleExpr(pixel->colour.get()) &&
+           (first == nullptr ||
+            sameExpr(pixel->colour.get(), first->colour.get()));
+  }
+
+  static std::optional<std::vector<PixelSpan>> loopSpans(ast::ForStmt &node);
+
+  // the spans drawn by stmts, if they are a loop drawing spans or a run of
+  // pixels of a single colour.
+  static std::optional<std::vector<PixelSpan>>
+  stmtsSpans(const std::vector<ast::StmtNode *> &stmts)
+  {
+    if (stmts.size() == 1)
+    {
+      if (auto *loop = stmts[0]->as<ast::ForStmt>())
+      {
+        return loopSpans(*loop);
+      }
+    }
+
+    std::vector<ast::PixelStmt *> pixels;
+    for (ast::StmtNode *stmt : stmts)
+    {
+      auto *pixel = stmt->as<ast::PixelStmt>();
+      if (!isSimplePixel(pixel, pixels.empty() ? nullptr : pixels[0]))
+      {
+        return std::nullopt;
+      }
+      pixels.push_back(pixel);
+    }
+    if (pixels.empty())
+    {
+      return std::nullopt;
+    }
+    return pixelSpans(pixels);
+  }
+
+  // the spans drawn by a loop like
+  //   for (let i: int = a; i < b; i = i + 1) { __pixel i, y, c; }
+  // where a, b, y and c are simple and only the x or y coordinate depends on
+  // i. The body may also be a few such pixels of one colour, or a loop
+  // drawing spans, each of which i moves along. The comparison may also be
+  // <=.
+  static std::optional<std::vector<PixelSpan>> loopSpans(ast::ForStmt &node)
+  {
+    auto *decl = node.varDecl ? node.varDecl->as<ast::VariableDeclStmt>()
+                              : nullptr;
+    auto *cond = node.cond->as<ast::BinaryExprNode>();
+    auto *update = node.assignment
+                       ? node.assignment->as<ast::AssignmentStmt>()
+                       : nullptr;
+    if (!decl || !decl->type->is<ast::IntTypeNode>() || !cond || !update ||
+        (cond->op != ast::BinaryExprNode::LESS &&
+         cond->op != ast::BinaryExprNode::LE))
+    {
+      return std::nullopt;
+    }
+    const std::string &id = decl->id;
+
+    if (!isId(cond->left.get(), id) || !isSimpleExpr(cond->right.get()) ||
+        mentions(cond->right.get(), id) ||
+        !isSimpleExpr(decl->initExpr.get()) ||
+        mentions(decl->initExpr.get(), id))
+    {
+      return std::nullopt;
+    }
+
+    auto *step = update->expr->as<ast::BinaryExprNode>();
+    if (!isId(update->lvalue.get(), id) || !step ||
+        step->op != ast::BinaryExprNode::ADD)
+    {
+      return std::nullopt;
+    }
+    auto *left = step->left->as<ast::IntLiteralExprNode>();
+    auto *right = step->right->as<ast::IntLiteralExprNode>();
+    if (!(isId(step->left.get(), id) && right && right->x == 1) &&
+        !(isId(step->right.get(), id) && left && left->x == 1))
+    {
+      return std::nullopt;
+    }
+
+    std::vector<ast::StmtNode *> stmts;
+    if (auto *block = node.body->as<ast::BlockStmt>())
+    {
+      for (ast::StmtNodePtr &stmt : block->stmts)
+      {
+        stmts.push_back(stmt.get());
+      }
     }
     else
     {
-      // regular loop body
-      head = terminateBlock();
-      node.body->accept(this);
-      addInstr({PixIROpcode::PUSH, head});
-      addInstr({PixIROpcode::JMP});
+      stmts.push_back(node.body.get());
+    }
+    std::optional<std::vector<PixelSpan>> spans = stmtsSpans(stmts);
+    if (!spans)
+    {
+      return std::nullopt;
     }
 
-    // after block
+    PixelSpan::Affine start = affine(decl->initExpr.get());
+    PixelSpan::Affine end = affine(cond->right.get());
+    PixelSpan::Extent extent{end.expr, start.expr, end.offset - start.offset};
+    if (cond->op == ast::BinaryExprNode::LE)
+    {
+      extent.offset++;
+    }
+    if (start.sameBase(end))
+    {
+      extent.end = extent.start = nullptr;
+    }
+
+    // i must be the x or y coordinate of each span, which is one pixel
+    // across in that direction, and the rest of the span mustn't depend on
+    // it.
+    auto independent = [&](const PixelSpan::Affine &coord,
+                           const PixelSpan::Extent &extent)
+    {
+      return !(coord.expr && mentions(coord.expr, id)) &&
+             !(extent.end && mentions(extent.end, id)) &&
+             !(extent.start && mentions(extent.start, id));
+    };
+    for (PixelSpan &span : *spans)
+    {
+      bool horizontal = span.x.expr && isId(span.x.expr, id) &&
+                        span.w.isUnit() && independent(span.y, span.h);
+      bool vertical = span.y.expr && isId(span.y.expr, id) &&
+                      span.h.isUnit() && independent(span.x, span.w);
+      if (!(horizontal || vertical) || mentions(span.colour, id))
+      {
+        return std::nullopt;
+      }
+
+      PixelSpan::Affine &coord = horizontal ? span.x : span.y;
+      coord = {start.expr, start.offset + coord.offset};
+      (horizontal ? span.w : span.h) = extent;
+    }
+    return spans;
+  }
+
+  void CodeGenerator::generatePixelSpan(const PixelSpan &span)
+  {
+    auto pushConstant = [this](long long value)
+    {
+      schedule([this, value]
+               {
+                 addInstr({PixIROpcode::PUSH, std::to_string(std::abs(value))});
+                 if (value < 0)
+                 {
+                   addInstr({PixIROpcode::PUSH, "0"});
+                   addInstr({PixIROpcode::SUB});
+                 }
+               });
+    };
+    // an offset is pushed before the expression it is added to, without its
+    // sign, which decides whether addOffset adds or subtracts it.
+    auto pushOffset = [this](long long offset)
+    {
+      if (offset != 0)
+      {
+        std::string operand = std::to_string(std::abs(offset));
+        schedule([this, operand]
+                 { addInstr({PixIROpcode::PUSH, operand}); });
+      }
+    };
+    auto addOffset = [this](long long offset)
+    {
+      if (offset != 0)
+      {
+        PixIROpcode opcode = offset > 0 ? PixIROpcode::ADD : PixIROpcode::SUB;
+        schedule([this, opcode]
+                 { addInstr({opcode}); });
+      }
+    };
+    auto generateCoord = [&](const PixelSpan::Affine &coord)
+    {
+      if (coord.expr == nullptr)
+      {
+        pushConstant(coord.offset);
+        return;
+      }
+      pushOffset(coord.offset);
+      schedule(coord.expr);
+      addOffset(coord.offset);
+    };
+    auto generateExtent = [&](const PixelSpan::Extent &extent)
+    {
+      if (extent.isConstant())
+      {
+        pushConstant(extent.offset);
+        return;
+      }
+      pushOffset(extent.offset);
+      if (extent.start)
+      {
+        schedule(extent.start);
+      }
+      if (extent.end)
+      {
+        schedule(extent.end);
+      }
+      else
+      {
+        schedule([this]
+                 { addInstr({PixIROpcode::PUSH, "0"}); });
+      }
+      if (extent.start)
+      {
+        schedule([this]
+                 { addInstr({PixIROpcode::SUB}); });
+      }
+      addOffset(extent.offset);
+    };
+
+    if ((span.w.isConstant() && span.w.offset <= 0) ||
+        (span.h.isConstant() && span.h.offset <= 0))
+    {
+      return;
+    }
+
+    if (span.w.isUnit() && span.h.isUnit())
+    {
+      schedule(span.colour);
+      generateCoord(span.y);
+      generateCoord(span.x);
+      schedule([this]
+               { addInstr({PixIROpcode::PIXEL}); });
+      return;
+    }
+    // spans whose extent is only known at run time may be empty, and are
+    // jumped over then, as the VM checks the bounds of even an empty
+    // rectangle. Extents are simple expressions, so computing them again has
+    // no effect.
+    bool guarded = !span.w.isConstant() || !span.h.isConstant();
+    if (guarded)
+    {
+      size_t conds = 0;
+      for (const PixelSpan::Extent *extent : {&span.h, &span.w})
+      {
+        if (!extent->isConstant())
+        {
+          schedule([this]
+                   { addInstr({PixIROpcode::PUSH, "0"}); });
+          generateExtent(*extent);
+          schedule([this]
+                   { addInstr({PixIROpcode::GT}); });
+          conds++;
+        }
+      }
+      schedule([this, conds]
+               {
+                 if (conds == 2)
+                 {
+                   addInstr({PixIROpcode::AND});
+                 }
+                 // !cond.
+                 addInstr({PixIROpcode::PUSH, "1"});
+                 addInstr({PixIROpcode::SUB});
+                 pendingBlocks.push(terminateBlock());
+               });
+    }
+
+    schedule(span.colour);
+    generateExtent(span.h);
+    generateExtent(span.w);
+    generateCoord(span.y);
+    generateCoord(span.x);
+    schedule([this]
+             { addInstr({PixIROpcode::PIXELR}); });
+
+    if (guarded)
+    {
+      schedule([this]
+               {
+                 terminateBlock();
+                 BasicBlock *after = blockStack.top();
+                 BasicBlock *head = popPendingBlock();
+
+                 head->instrs.push_back({PixIROpcode::PUSH, after});
+                 head->instrs.push_back({PixIROpcode::CJMP2});
+               });
+    }
+  }
+
+  size_t CodeGenerator::schedulePixelRun(std::vector<ast::StmtNodePtr> &stmts,
+                                         size_t i)
+  {
+    if (!opts.coalescePixels)
+    {
+      return 0;
+    }
+
+    std::vector<ast::PixelStmt *> pixels;
+    for (size_t j = i; j < stmts.size(); j++)
+    {
+      auto *pixel = stmts[j]->as<ast::PixelStmt>();
+      if (!isSimplePixel(pixel, pixels.empty() ? nullptr : pixels[0]))
+      {
+        break;
+      }
+      pixels.push_back(pixel);
+    }
+    if (pixels.size() < 2)
+    {
+      return 0;
+    }
+
+    for (const PixelSpan &span : pixelSpans(pixels))
+    {
+      generatePixelSpan(span);
+    }
+    return pixels.size();
+  }
+
+  void CodeGenerator::visit(ast::ForStmt &node)
+  {
+    // loops drawing a span don't need their own frame, as nothing in them
+    // but the loop variable is declared, and it isn't used once drawn.
+    if (opts.coalescePixels)
+    {
+      if (std::optional<std::vector<PixelSpan>> spans = loopSpans(node))
+      {
+        for (const PixelSpan &span : *spans)
+        {
+          generatePixelSpan(span);
+        }
+        return;
+      }
+    }
+
+    enterFrame(&node);
+
+    // loop entry
     terminateBlock();
-    after = blockStack.top();
+    schedule(node.varDecl.get());
+
+    std::optional<long long> trips;
+    if (tripCounts != nullptr && tripCounts->count(&node))
+    {
+      trips = tripCounts->at(&node);
+    }
+    size_t size =
+        subtreeSize(node.body.get()) + subtreeSize(node.assignment.get());
+
+    // small loops are replaced by copies of their body, as the condition is
+    // known to hold each time.
+    if (trips && *trips <= MAX_FULL_UNROLL && *trips * size <= UNROLL_BUDGET)
+    {
+      for (long long i = 0; i < *trips; i++)
+      {
+        schedule(node.body.get());
+        schedule(node.assignment.get());
+      }
+      schedule([this]
+               { exitFrame(); });
+      return;
+    }
 
-    head->instrs.push_back({PixIROpcode::PUSH, after});
-    head->instrs.push_back({PixIROpcode::CJMP2});
+    // larger ones check the condition once every few iterations, after the
+    // iterations left over are peeled off.
+    size_t copies = 1;
+    if (trips)
+    {
+      for (size_t factor = MAX_UNROLL_FACTOR; factor > 1; factor /= 2)
+      {
+        if (factor * size <= UNROLL_BUDGET && (long long)factor <= *trips)
+        {
+          copies = factor;
+          break;
+        }
+      }
+      for (long long i = 0; i < *trips % (long long)copies; i++)
+      {
+        schedule(node.body.get());
+        schedule(node.assignment.get());
+      }
+    }
+    generateLoop(node.cond.get(), node.body.get(), node.assignment.get(),
+                 copies);
+
+    schedule([this]
+             { exitFrame(); });
+  }
+
+  void CodeGenerator::visit(ast::WhileStmt &node)
+  {
+    generateLoop(node.cond.get(), node.body.get(), nullptr);
   }
 
   void CodeGenerator::visit(ast::FuncDeclStmt &node)
@@ -513,88 +1524,214 @@ namespace codegen
     beginFunc(node.funcName);
     enterFuncDefFrame(node);
     visitChildren(&node);
-    exitFuncDefFrame();
-    endFunc();
+    schedule([this]
+             {
+               exitFuncDefFrame();
+               endFunc();
+             });
   }
 
   void CodeGenerator::visit(ast::BlockStmt &node)
   {
     enterFrame(&node);
-    visitChildren(&node);
-    exitFrame();
+    for (size_t i = 0; i < node.stmts.size(); i++)
+    {
+      if (size_t run = schedulePixelRun(node.stmts, i))
+      {
+        i += run - 1;
+        continue;
+      }
+      schedule(node.stmts[i].get());
+    }
+    schedule([this]
+             { exitFrame(); });
   }
 
-  void CodeGenerator::visit(ast::TranslationUnit &node)
+  void CodeGenerator::generateDeferredFuncs()
   {
-    beginFunc(MAIN_FUNC_NAME);
-    enterMainFrame(node);
-    visitChildren(&node);
-    exitMainFrame();
-    endFunc();
+    // every function gets its own generator, so workers only share the main
+    // frame's map and scope, which are no longer modified.
+    std::vector<PixIRCode> funcCode(deferredFuncs.size());
+    std::vector<std::exception_ptr> errors(deferredFuncs.size());
+
+    auto generate = [&](size_t i)
+    {
+      try
+      {
+        CodeGenerator generator{symbolTable, CodeGeneratorOptions{opts}};
+        generator.frameIndexMap = frameIndexMap;
+        generator.currentScope = currentScope;
+        generator.tripCounts = tripCounts;
+        deferredFuncs[i]->accept(&generator);
+        funcCode[i] = std::move(generator.pixIRCode);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    };
+
+    if (pool != nullptr && deferredFuncs.size() > 1)
+    {
+      pool->parallelFor(deferredFuncs.size(), generate);
+    }
+    else
+    {
+      for (size_t i = 0; i < deferredFuncs.size(); i++)
+      {
+        generate(i);
+        if (errors[i])
+        {
+          break;
+        }
+      }
+    }
+
+    for (std::exception_ptr &error : errors)
+    {
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+
+    // splice each function's code in place of its null entry.
+    PixIRCode merged;
+    size_t next = 0;
+    for (std::unique_ptr<PixIRFunction> &func : pixIRCode)
+    {
+      if (func)
+      {
+        merged.push_back(std::move(func));
+        continue;
+      }
+      for (std::unique_ptr<PixIRFunction> &generated : funcCode[next++])
+      {
+        merged.push_back(std::move(generated));
+      }
+    }
+    pixIRCode = std::move(merged);
+    deferredFuncs.clear();
   }
 
-  void linearizeCode(PixIRCode &pixIRCode)
+  void CodeGenerator::visit(ast::TranslationUnit &node)
   {
-    for (std::unique_ptr<PixIRFunction> &func : pixIRCode)
+    if (opts.unrollLoops)
     {
-      int offset = 0;
-      std::map<BasicBlock *, int> offsets;
+      using TripCounts = std::map<const ast::ForStmt *, long long>;
+      tripCounts = std::make_shared<const TripCounts>(countLoopTrips(node));
+    }
+
+    beginFunc(MAIN_FUNC_NAME);
+    enterMainFrame(node);
 
-      // compute local offsets for each block
-      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+    // top-level functions only refer to the main frame, which is complete once
+    // entered, so they are lowered after the main function, independently of
+    // each other.
+    for (size_t i = 0; i < node.stmts.size(); i++)
+    {
+      if (auto *func = node.stmts[i]->as<ast::FuncDeclStmt>())
+      {
+        schedule([this, func]
+                 {
+                   deferredFuncs.push_back(func);
+                   pixIRCode.push_back(nullptr);
+                 });
+      }
+      else if (size_t run = schedulePixelRun(node.stmts, i))
       {
-        offsets.insert({block.get(), offset});
-        offset += block->instrs.size();
+        i += run - 1;
       }
+      else
+      {
+        schedule(node.stmts[i].get());
+      }
+    }
+    schedule([this]
+             {
+               generateDeferredFuncs();
+               exitMainFrame();
+               endFunc();
+             });
+  }
+
+  void linearizeCode(PixIRFunction &func)
+  {
+    ControlFlowGraph cfg{func};
+    int offset = 0;
+    std::vector<int> offsets;
+    offsets.reserve(func.blocks.size());
+
+    // compute local offsets for each block
+    for (std::unique_ptr<BasicBlock> &block : func.blocks)
+    {
+      offsets.push_back(offset);
+      offset += block->instrs.size();
+    }
 
-      // use local offsets to convert BasicBlock * references in push instructions
-      // to PC offsets.
-      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+    // use local offsets to convert BasicBlock * references in push instructions
+    // to PC offsets.
+    for (size_t blockId = 0; blockId < func.blocks.size(); blockId++)
+    {
+      std::unique_ptr<BasicBlock> &block = func.blocks[blockId];
+      auto instrs_it = block->instrs.begin();
+      for (size_t i = 0; instrs_it != block->instrs.end(); i++, ++instrs_it)
       {
-        auto instrs_it = block->instrs.begin();
-        for (size_t i = 0; instrs_it != block->instrs.end(); i++, ++instrs_it)
+        PixIRInstruction &instr = *instrs_it;
+        if (instr.opcode == PixIROpcode::PUSH &&
+            std::holds_alternative<BasicBlock *>(instr.data))
         {
-          PixIRInstruction &instr = *instrs_it;
-          if (instr.opcode == PixIROpcode::PUSH &&
-              std::holds_alternative<BasicBlock *>(instr.data))
-          {
-            int pc_offset = offsets.at(std::get<BasicBlock *>(instr.data)) -
-                            offsets.at(block.get()) - i;
-            instr.data = std::string("#PC") + (pc_offset >= 0 ? "+" : "") +
-                         std::to_string(pc_offset);
-          }
+          int pc_offset =
+              offsets[cfg.idOf(std::get<BasicBlock *>(instr.data))] -
+              offsets[blockId] - i;
+          instr.data = std::string("#PC") + (pc_offset >= 0 ? "+" : "") +
+                       std::to_string(pc_offset);
         }
       }
+    }
 
-      // remove empty blocks in one pass. This works because an empty block has
-      // the same offset as the next block.
-      for (auto it = func->blocks.begin(); it != func->blocks.end(); ++it)
+    // remove empty blocks in one pass. This works because an empty block has
+    // the same offset as the next block.
+    for (auto it = func.blocks.begin(); it != func.blocks.end(); ++it)
+    {
+      if ((*it)->instrs.size() == 0)
       {
-        if ((*it)->instrs.size() == 0)
-        {
-          --it;
-          func->blocks.erase(it + 1);
-        }
+        --it;
+        func.blocks.erase(it + 1);
       }
     }
   }
 
-  void dumpCode(PixIRCode &pixIRCode, std::ostream &s)
+  void linearizeCode(PixIRCode &pixIRCode)
+  {
+    for (std::unique_ptr<PixIRFunction> &func : pixIRCode)
+    {
+      linearizeCode(*func);
+    }
+  }
+
+  void dumpCode(PixIRCode &pixIRCode, BufferedWriter &w)
   {
     for (const std::unique_ptr<codegen::PixIRFunction> &func : pixIRCode)
     {
-      s << func->funcName << std::endl;
+      w << func->funcName << '\n';
       for (const std::unique_ptr<codegen::BasicBlock> &block : func->blocks)
       {
         for (const codegen::PixIRInstruction &instr : block->instrs)
         {
-          s << "\t" << instr.to_string() << std::endl;
+          w << '\t' << instr.to_string() << '\n';
         }
-        s << std::endl;
+        w << '\n';
       }
     }
   }
 
+  void dumpCode(PixIRCode &pixIRCode, std::ostream &s)
+  {
+    BufferedWriter w{s};
+    dumpCode(pixIRCode, w);
+  }
+
   std::string to_string(const PixIROpcode type)
   {
     switch (type)
@@ -4,6 +4,7 @@
 #include "ast.hh"
 #include "semantic_visitor.hh"
 #include "visitor.hh"
+#include "writer.hh"
 
 #include <algorithm>
 #include <iostream>
@@ -17,6 +18,8 @@
 #include <variant>
 #include <vector>
 
+class ThreadPool;
+
 namespace codegen
 {
 
@@ -112,6 +115,9 @@ namespace codegen
     // unique_ptr is used so we can reference blocks without worrying about the
     // vector reallocating its memory.
     std::vector<std::unique_ptr<BasicBlock>> blocks;
+    // labels of the functions called, in the order the calls were generated.
+    // May contain duplicates. See CallGraph.
+    std::vector<std::string> callees;
   };
 
   // std::unique_ptr is used so we can reference functions without worrying
@@ -131,16 +137,17 @@ namespace codegen
 
     // gets the depth (number of scopes traversed to obtain the symbol) and
     // index (in the std::map) of a symbol.
-    std::pair<int, FrameIndex> getDepthAndIndex(std::string symbol,
-                                                int initDepth = 0) const
+    std::pair<int, FrameIndex> getDepthAndIndex(const std::string &symbol) const
     {
-      if (frameIndices.count(symbol))
-      {
-        return {initDepth, frameIndices.at(symbol)};
-      }
-      if (parent != nullptr)
+      int depth = 0;
+      for (const FrameIndexMap *map = this; map != nullptr;
+           map = map->parent, depth++)
       {
-        return parent->getDepthAndIndex(symbol, initDepth + 1);
+        auto it = map->frameIndices.find(symbol);
+        if (it != map->frameIndices.end())
+        {
+          return {depth, it->second};
+        }
       }
       throw std::logic_error("Symbol " + symbol + " not found");
     }
@@ -149,26 +156,54 @@ namespace codegen
   struct CodeGeneratorOptions
   {
     bool rotateLoops = false;
+    // unrolls for loops whose number of iterations is known, see
+    // CodeGenerator::visit(ast::ForStmt &).
+    bool unrollLoops = false;
+    // draws loops and runs of pixels of a single colour as rectangles, see
+    // CodeGenerator::visit(ast::ForStmt &).
+    bool coalescePixels = false;
   };
 
-  class CodeGenerator : public ast::AbstractVisitor
+  // a rectangle of pixels of a single colour, drawn by a loop or by a run of
+  // pixel statements. Defined in codegen.cc.
+  struct PixelSpan;
+
+  class CodeGenerator final : public ast::Visitor<CodeGenerator>
   {
   private:
     CodeGeneratorOptions opts;
 
     const ast::SymbolTable &symbolTable;
+    // generates the top-level functions in parallel, if given.
+    ThreadPool *pool;
 
     PixIRCode pixIRCode;
 
     // scratch space for the generator
     std::stack<BasicBlock *> blockStack;
-    std::unique_ptr<FrameIndexMap> frameIndexMap;
+    // maps of the frames entered by this generator, innermost last.
+    std::vector<std::unique_ptr<FrameIndexMap>> frameIndexMaps;
+    // the innermost map. For generators lowering a single function, the
+    // outermost map's parent is the main frame's map, owned by another
+    // generator.
+    FrameIndexMap *frameIndexMap = nullptr;
 
     std::stack<int> frameLevels;
 
     // current Scope and frame number.
     const ast::Scope *currentScope;
 
+    // blocks created while generating a statement whose jumps are only known
+    // once the rest of the statement has been generated.
+    std::stack<BasicBlock *> pendingBlocks;
+
+    BasicBlock *popPendingBlock()
+    {
+      BasicBlock *block = pendingBlocks.top();
+      pendingBlocks.pop();
+      return block;
+    }
+
     void addInstr(PixIRInstruction instr)
     {
       blockStack.top()->instrs.push_back(instr);
@@ -176,6 +211,10 @@ namespace codegen
 
     void popInstr() { blockStack.top()->instrs.pop_back(); }
 
+    void pushFrameIndexMap(
+        std::map<std::string, FrameIndexMap::FrameIndex> &&frameIndices);
+    void popFrameIndexMap();
+
     void enterFuncDefFrame(ast::FuncDeclStmt &node);
     void exitFuncDefFrame();
 
@@ -192,10 +231,37 @@ namespace codegen
     void beginFunc(std::string funcName);
     void endFunc();
 
+    // schedules the code for a loop. update runs after each iteration of the
+    // body, and may be null. The body and update are repeated copies times
+    // between checks of the condition.
+    void generateLoop(ast::ExprNode *cond, ast::StmtNode *body,
+                      ast::StmtNode *update, size_t copies = 1);
+
+    // top-level functions, lowered once the main function has been. Each one
+    // is generated into its own PixIRCode by a separate generator, and takes
+    // the place of a null entry left in pixIRCode so functions keep the order
+    // of their declarations.
+    std::vector<ast::FuncDeclStmt *> deferredFuncs;
+    void generateDeferredFuncs();
+
+    // the number of iterations of the for loops whose count is known before
+    // they run, if loops are unrolled. Shared with the generators of
+    // functions.
+    std::shared_ptr<const std::map<const ast::ForStmt *, long long>>
+        tripCounts;
+    static std::map<const ast::ForStmt *, long long>
+    countLoopTrips(ast::TranslationUnit &tu);
+
+    void generatePixelSpan(const PixelSpan &span);
+    // schedules the code for the run of pixel statements starting at
+    // stmts[i] as spans, if pixels are coalesced. Returns the number of
+    // statements scheduled, 0 if there isn't a run of them.
+    size_t schedulePixelRun(std::vector<ast::StmtNodePtr> &stmts, size_t i);
+
   public:
     CodeGenerator(const ast::SymbolTable &symbolTable,
-                  CodeGeneratorOptions &&opts)
-        : opts(std::move(opts)), symbolTable(symbolTable) {}
+                  CodeGeneratorOptions &&opts, ThreadPool *pool = nullptr)
+        : opts(std::move(opts)), symbolTable(symbolTable), pool(pool) {}
 
     // nothing to generate for types.
     void visit(ast::IntTypeNode &node) override {}
@@ -243,7 +309,9 @@ namespace codegen
   // Multiple responsibilities:
   // 1. convert BasicBlock references in PUSH instructions to PC offsets
   // 2. remove empty blocks produced in code generation.
+  void linearizeCode(PixIRFunction &func);
   void linearizeCode(PixIRCode &pixIRCode);
+  void dumpCode(PixIRCode &pixIRCode, BufferedWriter &w);
   void dumpCode(PixIRCode &pixIRCode, std::ostream &s);
 
 } // namespace codegen
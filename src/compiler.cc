@@ -0,0 +1,202 @@
+#include "compiler.hh"
+#include "ast.hh"
+#include "ast_binary.hh"
+#include "deadcode.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "pass_manager.hh"
+#include "peephole.hh"
+#include "semantic_visitor.hh"
+#include "ssa.hh"
+#include "thread_pool.hh"
+#include "xml_visitor.hh"
+
+#include <memory>
+#include <sstream>
+
+namespace pixelc
+{
+
+  // runs the whole pipeline over a single translation unit. Every call gets a
+  // fresh lexer, parser and symbol table, so concurrent calls are independent.
+  static void runPipeline(std::string_view source, const CompilerOptions &opts,
+                          CompilationResult &result, BufferedWriter &xmlOut)
+  {
+    std::optional<ThreadPool> pool;
+    if (opts.threads != 1)
+    {
+      pool.emplace(opts.threads);
+    }
+
+    ast::SymbolTable symbolTable;
+    ast::SemanticVisitor semanticChecker{symbolTable,
+                                         pool ? &pool.value() : nullptr};
+    codegen::CodeGenerator codeGenerator{symbolTable,
+                                         {.rotateLoops = opts.rotateLoops,
+                                          .unrollLoops = opts.unrollLoops,
+                                          .coalescePixels =
+                                              opts.coalescePixels},
+                                         pool ? &pool.value() : nullptr};
+
+    // previously parsed programs skip lexing and parsing.
+    std::unique_ptr<ast::TranslationUnit> tu;
+    if (ast::isBinaryAST(source))
+    {
+      tu = ast::readBinaryAST(source);
+    }
+    else
+    {
+      std::istringstream src{std::string(source)};
+      lexer::Lexer lexer{src};
+      parser::Parser parser{lexer};
+      tu = parser.parse();
+    }
+    tu->accept(&semanticChecker);
+
+    if (opts.generateBinaryAst)
+    {
+      BufferedWriter astOut{result.binaryAst};
+      ast::writeBinaryAST(*tu, astOut);
+    }
+
+    if (opts.generateXml)
+    {
+      ast::XMLVisitor xmlVisitor{xmlOut, {.maxDepth = opts.xmlMaxDepth,
+                                          .function = opts.xmlFunction}};
+      tu->accept(&xmlVisitor);
+    }
+
+    tu->accept(&codeGenerator);
+    codegen::PixIRCode &code(codeGenerator.code());
+
+    // optimizations
+    codegen::PassManager passes{pool ? &pool.value() : nullptr};
+    if (opts.eliminateDeadCode)
+    {
+      passes.addModulePass([](codegen::PixIRCode &code)
+                           { codegen::DeadFunctionEliminator(code).eliminate(); });
+    }
+
+    // before the dead code passes, as loads replaced by constants leave more
+    // dead stores.
+    if (opts.ssaOptimize)
+    {
+      passes.addFunctionPass([](codegen::PixIRFunction &func)
+                             { codegen::propagateConstants(func); });
+    }
+
+    // after constant propagation, which finds more constant arguments. The
+    // originals of the functions specialized may no longer be called.
+    if (opts.specializeFunctions)
+    {
+      passes.addModulePass([](codegen::PixIRCode &code)
+                           { codegen::specializeFunctions(code); });
+      if (opts.eliminateDeadCode)
+      {
+        passes.addModulePass([](codegen::PixIRCode &code)
+                             { codegen::DeadFunctionEliminator(code).eliminate(); });
+      }
+    }
+
+    // after specialization, whose clones may have become pure.
+    if (opts.ssaOptimize)
+    {
+      passes.addModulePass([](codegen::PixIRCode &code)
+                           { codegen::eliminateCommonCalls(code); });
+    }
+
+    if (opts.eliminateDeadCode)
+    {
+      passes.addFunctionPass([](codegen::PixIRFunction &func)
+                             { codegen::eliminateDeadCodeAfterReturn(func); });
+      passes.addFunctionPass([](codegen::PixIRFunction &func)
+                             { codegen::eliminateUnreachableBlocks(func); });
+      passes.addFunctionPass([](codegen::PixIRFunction &func)
+                             { codegen::eliminateDeadStores(func); });
+    }
+
+    // after the dead code passes, so only the calls left are memoized, and
+    // the frames the tables are added to have been compacted already.
+    if (opts.memoizeCalls)
+    {
+      passes.addModulePass([](codegen::PixIRCode &code)
+                           { codegen::memoizePureCalls(code); });
+    }
+
+    if (opts.peepholeOptimize)
+    {
+      passes.addFunctionPass([](codegen::PixIRFunction &func)
+                             { codegen::peepholeOptimize(func); });
+    }
+
+    passes.addFunctionPass([](codegen::PixIRFunction &func)
+                           { codegen::linearizeCode(func); });
+    passes.run(code);
+
+    BufferedWriter asmOut{result.asmOutput};
+    codegen::dumpCode(code, asmOut);
+    asmOut.flush();
+    result.code = std::move(code);
+  }
+
+  CompilationResult compile(std::string_view source,
+                            const CompilerOptions &opts, BufferedWriter *xmlOut)
+  {
+    CompilationResult result;
+
+    std::optional<CompilationCache> cache;
+    std::string key;
+    // binary ASTs aren't cached, so they always need a full compilation.
+    if (opts.cacheDir && !opts.generateBinaryAst)
+    {
+      cache.emplace(opts.cacheDir.value(), opts.cacheMaxBytes);
+      key = CompilationCache::makeKey(std::string(source), opts);
+
+      if (std::optional<CacheEntry> entry = cache->lookup(key))
+      {
+        result.asmOutput = std::move(entry->asmOutput);
+        result.xmlOutput = std::move(entry->xmlOutput);
+        if (xmlOut)
+        {
+          *xmlOut << result.xmlOutput;
+          result.xmlOutput.clear();
+        }
+        return result;
+      }
+    }
+
+    try
+    {
+      // the cache needs the whole document, so it is only streamed to xmlOut
+      // once compilation has finished.
+      if (xmlOut && !cache)
+      {
+        runPipeline(source, opts, result, *xmlOut);
+      }
+      else
+      {
+        BufferedWriter xmlWriter{result.xmlOutput};
+        runPipeline(source, opts, result, xmlWriter);
+      }
+    }
+    catch (CompilationError &e)
+    {
+      result = CompilationResult();
+      result.success = false;
+      result.diagnostics = e.what();
+      return result;
+    }
+
+    if (cache)
+    {
+      cache->store(key, {result.asmOutput, result.xmlOutput});
+      if (xmlOut)
+      {
+        *xmlOut << result.xmlOutput;
+        result.xmlOutput.clear();
+      }
+    }
+    return result;
+  }
+
+} // namespace pixelc
@@ -1,22 +1,22 @@
 #ifndef COMPILER_H_
 #define COMPILER_H_
 
-#include "ast.hh"
+#include "cache.hh"
 #include "codegen.hh"
-#include "deadcode.hh"
-#include "lexer.hh"
-#include "parser.hh"
-#include "peephole.hh"
-#include "semantic_visitor.hh"
 #include "util.hh"
-#include "xml_visitor.hh"
+#include "writer.hh"
 
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <memory>
+#include <iterator>
 #include <optional>
 #include <string>
+#include <string_view>
+
+#ifndef PIXELC_VERSION
+#define PIXELC_VERSION "unknown"
+#endif
 
 struct CompilerOptions
 {
@@ -25,13 +25,129 @@ struct CompilerOptions
 
   bool generateXml = false;
   std::optional<std::string> xmlOutfile = std::nullopt;
+  // limits on the exported XML, see ast::XMLOptions.
+  std::optional<int> xmlMaxDepth = std::nullopt;
+  std::optional<std::string> xmlFunction = std::nullopt;
+
+  // see ast_binary.hh.
+  bool generateBinaryAst = false;
+  std::optional<std::string> binaryAstOutfile = std::nullopt;
 
   bool rotateLoops = false;
+  bool unrollLoops = false;
+  bool coalescePixels = false;
 
   bool eliminateDeadCode = false;
   bool peepholeOptimize = false;
+  bool ssaOptimize = false;
+  bool specializeFunctions = false;
+  bool memoizeCalls = false;
+
+  // worker threads used within a single compilation, e.g. to check, generate
+  // code for and optimize functions in parallel. 0 uses one per hardware
+  // thread. Doesn't affect the output.
+  size_t threads = 1;
+
+  // directory of the compilation cache, if caching is enabled.
+  std::optional<std::string> cacheDir = std::nullopt;
+  uintmax_t cacheMaxBytes = CompilationCache::DEFAULT_MAX_BYTES;
 };
 
+// the options which affect the compiler's output, used to key cached outputs.
+// Any new option which changes the generated assembly or XML must be added
+// here.
+inline std::string optionsFingerprint(const CompilerOptions &opts)
+{
+  return std::string(opts.generateXml ? "xml " : "") +
+         (opts.xmlMaxDepth ? "-xml-depth " + std::to_string(*opts.xmlMaxDepth) +
+                                 " "
+                           : "") +
+         (opts.xmlFunction ? "-xml-func " + *opts.xmlFunction + " " : "") +
+         (opts.rotateLoops ? "-frotate-loops " : "") +
+         (opts.unrollLoops ? "-funroll-loops " : "") +
+         (opts.coalescePixels ? "-fcoalesce-pixels " : "") +
+         (opts.eliminateDeadCode ? "-felim-dead-code " : "") +
+         (opts.peepholeOptimize ? "-fpeephole-optimize " : "") +
+         (opts.ssaOptimize ? "-fssa-optimize " : "") +
+         (opts.specializeFunctions ? "-fspecialize-calls " : "") +
+         (opts.memoizeCalls ? "-fmemoize-calls " : "");
+}
+
+// sets the optimization flag named by arg (e.g. -frotate-loops) in opts.
+// Returns false if arg is not an optimization flag.
+inline bool setOptimizationFlag(CompilerOptions &opts, const std::string &arg)
+{
+  if (arg == "-frotate-loops")
+  {
+    opts.rotateLoops = true;
+  }
+  else if (arg == "-funroll-loops")
+  {
+    opts.unrollLoops = true;
+  }
+  else if (arg == "-fcoalesce-pixels")
+  {
+    opts.coalescePixels = true;
+  }
+  else if (arg == "-felim-dead-code")
+  {
+    opts.eliminateDeadCode = true;
+  }
+  else if (arg == "-fpeephole-optimize")
+  {
+    opts.peepholeOptimize = true;
+  }
+  else if (arg == "-fssa-optimize")
+  {
+    opts.ssaOptimize = true;
+  }
+  else if (arg == "-fspecialize-calls")
+  {
+    opts.specializeFunctions = true;
+  }
+  else if (arg == "-fmemoize-calls")
+  {
+    opts.memoizeCalls = true;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+namespace pixelc
+{
+
+  struct CompilationResult
+  {
+    bool success = true;
+    std::string asmOutput;
+    // only generated if CompilerOptions::generateXml is set.
+    std::string xmlOutput;
+    // only generated if CompilerOptions::generateBinaryAst is set.
+    std::string binaryAst;
+    // the optimized, linearized PixIR. Left empty when the outputs were read
+    // from the compilation cache.
+    codegen::PixIRCode code;
+    // the compiler's error message if compilation failed.
+    std::string diagnostics;
+  };
+
+  // compiles source entirely in memory. source may also be a binary AST (see
+  // ast_binary.hh). opts.infile, opts.outfile, opts.xmlOutfile and
+  // opts.binaryAstOutfile are ignored. Errors in the program are reported through
+  // the result rather than thrown.
+  //
+  // If xmlOut is given, the XML is streamed to it while the AST is traversed
+  // instead of being collected in the result. Streamed XML may be incomplete
+  // if compilation fails.
+  CompilationResult compile(std::string_view source,
+                            const CompilerOptions &opts,
+                            BufferedWriter *xmlOut = nullptr);
+
+} // namespace pixelc
+
 class Compiler
 {
 private:
@@ -47,13 +163,6 @@ private:
   std::ostream &out;
   std::ostream &xmlOut;
 
-  lexer::Lexer lexer;
-  parser::Parser parser;
-  ast::XMLVisitor xmlVisitor;
-  ast::SymbolTable symbolTable;
-  ast::SemanticVisitor semanticChecker;
-  codegen::CodeGenerator codeGenerator;
-
   CompilerOptions opts;
 
 public:
@@ -71,9 +180,7 @@ public:
                        ? std::fstream{opts.xmlOutfile.value(),
                                       std::fstream::out | std::fstream::trunc}
                        : std::fstream()),
-        xmlOut(opts.xmlOutfile ? xmlOutfile : std::cout), lexer(in),
-        parser(lexer), semanticChecker(symbolTable),
-        codeGenerator(symbolTable, {.rotateLoops = opts.rotateLoops})
+        xmlOut(opts.xmlOutfile ? xmlOutfile : std::cout)
   {
     if (opts.infile && !std::filesystem::exists(opts.infile.value()))
     {
@@ -82,35 +189,34 @@ public:
     }
   }
 
+  // compile from and to streams owned by the caller (e.g. in-memory buffers
+  // used by the compile server). opts.infile, opts.outfile and
+  // opts.xmlOutfile are ignored.
+  Compiler(CompilerOptions &opts, std::istream &in, std::ostream &out,
+           std::ostream &xmlOut)
+      : opts(opts), in(in), out(out), xmlOut(xmlOut) {}
+
   void compile()
   {
-    std::unique_ptr<ast::TranslationUnit> tu{parser.parse()};
-    semanticChecker.visit(*tu);
+    std::string src{std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>()};
 
-    if (opts.generateXml)
+    BufferedWriter xmlWriter{xmlOut};
+    pixelc::CompilationResult result = pixelc::compile(src, opts, &xmlWriter);
+    xmlWriter.flush();
+    if (!result.success)
     {
-      xmlVisitor.visit(*tu);
-      xmlOut << xmlVisitor.xml();
+      throw CompilationError(result.diagnostics);
     }
 
-    codeGenerator.visit(*tu);
-    codegen::PixIRCode &code(codeGenerator.code());
+    out << result.asmOutput;
 
-    // optimizations
-    if (opts.eliminateDeadCode)
+    if (opts.binaryAstOutfile)
     {
-      codegen::DeadFunctionEliminator eliminator(code);
-      eliminator.eliminate();
-      codegen::eliminateDeadCodeAfterReturn(code);
+      std::ofstream astOut{opts.binaryAstOutfile.value(),
+                           std::ios::binary | std::ios::trunc};
+      astOut << result.binaryAst;
     }
-
-    if (opts.peepholeOptimize)
-    {
-      peepholeOptimize(code);
-    }
-
-    codegen::linearizeCode(code);
-    codegen::dumpCode(code, out);
   }
 };
 
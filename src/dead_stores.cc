@@ -0,0 +1,535 @@
+#include "cfg.hh"
+#include "deadcode.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    using InstrIt = std::list<PixIRInstruction>::iterator;
+
+    // frames are identified by the OFRAME instruction opening them. The
+    // function's own frame, which holds its parameters (or main's globals),
+    // has no such instruction.
+    const PixIRInstruction *const BASE_FRAME = nullptr;
+
+    // what an instruction does to the slots of frames.
+    struct Effect
+    {
+      enum Kind
+      {
+        NONE,
+        LOAD,
+        STORE,
+        // may read any slot, e.g. a call.
+        READ_ALL,
+        // leaves the function, ending all its frames.
+        EXIT,
+        OPEN,
+        CLOSE,
+      } kind = NONE;
+      // the slot loaded or stored, if the frame belongs to this function.
+      std::optional<size_t> slot;
+      // the frame opened or closed.
+      const PixIRInstruction *frame = BASE_FRAME;
+    };
+
+    struct Slot
+    {
+      const PixIRInstruction *frame;
+      int index;
+    };
+
+    std::optional<int> intOperand(const PixIRInstruction &instr)
+    {
+      if (instr.opcode != PixIROpcode::PUSH ||
+          !std::holds_alternative<std::string>(instr.data))
+      {
+        return std::nullopt;
+      }
+      const std::string &s = std::get<std::string>(instr.data);
+      if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+      {
+        return std::nullopt;
+      }
+      return std::stoi(s);
+    }
+
+    // parses the operand of PUSH [index:depth].
+    std::optional<std::pair<int, int>> loadOperand(const PixIRInstruction &instr)
+    {
+      if (instr.opcode != PixIROpcode::PUSH ||
+          !std::holds_alternative<std::string>(instr.data))
+      {
+        return std::nullopt;
+      }
+      const std::string &s = std::get<std::string>(instr.data);
+      if (s.size() < 3 || s.front() != '[' || s.back() != ']')
+      {
+        return std::nullopt;
+      }
+      size_t colon = s.find(':');
+      if (colon == std::string::npos)
+      {
+        return std::make_pair(std::stoi(s.substr(1)), 0);
+      }
+      return std::make_pair(std::stoi(s.substr(1, colon - 1)),
+                            std::stoi(s.substr(colon + 1)));
+    }
+
+    std::string formatLoad(int index, int depth)
+    {
+      return "[" + std::to_string(index) +
+             (depth == 0 ? "" : ":" + std::to_string(depth)) + "]";
+    }
+
+    // the number of values popped and pushed by an instruction without side
+    // effects, which can be removed if its result isn't used.
+    std::optional<std::pair<int, int>> pureStackEffect(const PixIRInstruction &instr)
+    {
+      switch (instr.opcode)
+      {
+      case PixIROpcode::PUSH:
+        if (std::holds_alternative<BasicBlock *>(instr.data))
+        {
+          return std::nullopt;
+        }
+        return std::make_pair(0, 1);
+      case PixIROpcode::WIDTH:
+      case PixIROpcode::HEIGHT:
+        return std::make_pair(0, 1);
+      case PixIROpcode::NOT:
+      case PixIROpcode::INC:
+      case PixIROpcode::DEC:
+      case PixIROpcode::ROUND:
+        return std::make_pair(1, 1);
+      case PixIROpcode::AND:
+      case PixIROpcode::OR:
+      case PixIROpcode::ADD:
+      case PixIROpcode::SUB:
+      case PixIROpcode::MUL:
+      case PixIROpcode::DIV:
+      case PixIROpcode::MAX:
+      case PixIROpcode::MIN:
+      case PixIROpcode::LT:
+      case PixIROpcode::LE:
+      case PixIROpcode::EQ:
+      case PixIROpcode::NEQ:
+      case PixIROpcode::GT:
+      case PixIROpcode::GE:
+        return std::make_pair(2, 1);
+      default:
+        return std::nullopt;
+      }
+    }
+
+    // Frame and slot analysis of one function. Only the reachable blocks are
+    // analysed, and the analysis gives up (valid() is false) if the frames
+    // open at a block depend on the path taken to it, or if a store's slot
+    // isn't given by constants.
+    class FrameAnalysis
+    {
+    public:
+      PixIRFunction &func;
+      ControlFlowGraph cfg;
+      bool valid = true;
+
+      std::vector<Slot> slots;
+      // effects of each instruction, in the order of each block's instrs.
+      std::vector<std::vector<Effect>> effects;
+      // the slots of each frame.
+      std::map<const PixIRInstruction *, std::vector<size_t>> frameSlots;
+      // frames open while a function is called, whose slots the callee might
+      // refer to.
+      std::map<const PixIRInstruction *, bool> escapes;
+
+      explicit FrameAnalysis(PixIRFunction &func)
+          : func(func), cfg(func), effects(func.blocks.size())
+      {
+        std::vector<std::optional<std::vector<const PixIRInstruction *>>>
+            entryFrames(func.blocks.size());
+        std::map<std::pair<const PixIRInstruction *, int>, size_t> slotIds;
+
+        auto slotOf = [&](const PixIRInstruction *frame, int index)
+        {
+          auto [it, inserted] = slotIds.insert({{frame, index}, slots.size()});
+          if (inserted)
+          {
+            slots.push_back({frame, index});
+            frameSlots[frame].push_back(it->second);
+          }
+          return it->second;
+        };
+
+        if (func.blocks.empty())
+        {
+          return;
+        }
+        entryFrames[0] = std::vector<const PixIRInstruction *>{BASE_FRAME};
+        escapes[BASE_FRAME] = false;
+
+        for (size_t block : cfg.reversePostorder())
+        {
+          if (!entryFrames[block])
+          {
+            valid = false;
+            return;
+          }
+          std::vector<const PixIRInstruction *> frames = *entryFrames[block];
+          std::list<PixIRInstruction> &instrs = func.blocks[block]->instrs;
+          effects[block].resize(instrs.size());
+
+          size_t i = 0;
+          for (auto it = instrs.begin(); it != instrs.end(); ++it, i++)
+          {
+            Effect &effect = effects[block][i];
+            switch (it->opcode)
+            {
+            case PixIROpcode::PUSH:
+              if (auto load = loadOperand(*it))
+              {
+                effect.kind = Effect::LOAD;
+                auto [index, depth] = *load;
+                if (depth < (int)frames.size())
+                {
+                  effect.slot = slotOf(frames[frames.size() - 1 - depth], index);
+                }
+              }
+              break;
+            case PixIROpcode::ST:
+            {
+              std::optional<int> index, depth;
+              if (i >= 2)
+              {
+                index = intOperand(*std::prev(it, 2));
+                depth = intOperand(*std::prev(it));
+              }
+              if (!index || !depth)
+              {
+                valid = false;
+                return;
+              }
+              effect.kind = Effect::STORE;
+              if (*depth < (int)frames.size())
+              {
+                effect.slot = slotOf(frames[frames.size() - 1 - *depth], *index);
+              }
+              break;
+            }
+            case PixIROpcode::CALL:
+              effect.kind = Effect::READ_ALL;
+              for (const PixIRInstruction *frame : frames)
+              {
+                escapes[frame] = true;
+              }
+              break;
+            case PixIROpcode::RET:
+            case PixIROpcode::HALT:
+              effect.kind = Effect::EXIT;
+              break;
+            case PixIROpcode::OFRAME:
+              effect.kind = Effect::OPEN;
+              effect.frame = &*it;
+              frames.push_back(&*it);
+              escapes.insert({&*it, false});
+              break;
+            case PixIROpcode::CFRAME:
+              if (frames.size() < 2)
+              {
+                valid = false;
+                return;
+              }
+              effect.kind = Effect::CLOSE;
+              effect.frame = frames.back();
+              frames.pop_back();
+              break;
+            default:
+              break;
+            }
+            if (effect.kind == Effect::EXIT)
+            {
+              break;
+            }
+          }
+
+          for (size_t succ : cfg.successors(block))
+          {
+            if (!entryFrames[succ])
+            {
+              entryFrames[succ] = frames;
+            }
+            else if (*entryFrames[succ] != frames)
+            {
+              valid = false;
+              return;
+            }
+          }
+        }
+      }
+
+      void kill(std::vector<bool> &live, const PixIRInstruction *frame) const
+      {
+        auto it = frameSlots.find(frame);
+        if (it != frameSlots.end())
+        {
+          for (size_t slot : it->second)
+          {
+            live[slot] = false;
+          }
+        }
+      }
+
+      // updates live, the slots live after an instruction, to those live
+      // before it.
+      void transfer(std::vector<bool> &live, const Effect &effect) const
+      {
+        switch (effect.kind)
+        {
+        case Effect::LOAD:
+          if (effect.slot)
+          {
+            live[*effect.slot] = true;
+          }
+          break;
+        case Effect::STORE:
+          if (effect.slot)
+          {
+            live[*effect.slot] = false;
+          }
+          break;
+        case Effect::READ_ALL:
+          live.assign(live.size(), true);
+          break;
+        case Effect::EXIT:
+          live.assign(live.size(), false);
+          break;
+        case Effect::OPEN:
+        case Effect::CLOSE:
+          kill(live, effect.frame);
+          break;
+        case Effect::NONE:
+          break;
+        }
+      }
+
+      // the slots live at the end of each block.
+      std::vector<std::vector<bool>> liveOut() const
+      {
+        std::vector<std::vector<bool>> in(func.blocks.size(),
+                                          std::vector<bool>(slots.size()));
+        std::vector<std::vector<bool>> out = in;
+
+        const std::vector<size_t> &rpo = cfg.reversePostorder();
+        bool changed = true;
+        while (changed)
+        {
+          changed = false;
+          for (auto block = rpo.rbegin(); block != rpo.rend(); ++block)
+          {
+            std::vector<bool> live(slots.size());
+            for (size_t succ : cfg.successors(*block))
+            {
+              for (size_t slot = 0; slot < slots.size(); slot++)
+              {
+                live[slot] = live[slot] || in[succ][slot];
+              }
+            }
+            out[*block] = live;
+
+            const std::vector<Effect> &blockEffects = effects[*block];
+            for (auto effect = blockEffects.rbegin();
+                 effect != blockEffects.rend(); ++effect)
+            {
+              transfer(live, *effect);
+            }
+            if (live != in[*block])
+            {
+              in[*block] = std::move(live);
+              changed = true;
+            }
+          }
+        }
+        return out;
+      }
+    };
+
+    // removes the stores whose value is never loaded, along with the
+    // computation of the value if it has no side effects. Returns whether any
+    // store was removed.
+    bool removeDeadStores(FrameAnalysis &analysis)
+    {
+      std::vector<std::vector<bool>> liveOut = analysis.liveOut();
+      bool removed = false;
+
+      for (size_t block : analysis.cfg.reversePostorder())
+      {
+        std::list<PixIRInstruction> &instrs = analysis.func.blocks[block]->instrs;
+        const std::vector<Effect> &blockEffects = analysis.effects[block];
+        std::vector<bool> live = liveOut[block];
+
+        // instructions are visited backwards, and stores are only removed
+        // once the whole block has been visited.
+        std::vector<std::pair<InstrIt, InstrIt>> dead;
+        auto it = std::next(instrs.begin(), blockEffects.size());
+        for (size_t i = blockEffects.size(); i-- > 0;)
+        {
+          --it;
+          const Effect &effect = blockEffects[i];
+          if (effect.kind == Effect::STORE && effect.slot && !live[*effect.slot])
+          {
+            // find the start of the value, from just before its slot.
+            InstrIt start = std::prev(it, 2);
+            int needed = 1;
+            bool pure = true;
+            while (needed > 0 && pure && start != instrs.begin())
+            {
+              --start;
+              auto stackEffect = pureStackEffect(*start);
+              if (!stackEffect)
+              {
+                pure = false;
+                break;
+              }
+              needed += stackEffect->first - stackEffect->second;
+            }
+            if (pure && needed == 0)
+            {
+              dead.push_back({start, std::next(it)});
+            }
+          }
+          analysis.transfer(live, effect);
+        }
+
+        // later stores' values come after earlier stores, so the ranges don't
+        // overlap, but one range may end where the next begins. Erasing them
+        // front to back keeps the end of each range valid.
+        for (auto range = dead.rbegin(); range != dead.rend(); ++range)
+        {
+          instrs.erase(range->first, range->second);
+          removed = true;
+        }
+      }
+      return removed;
+    }
+
+    // renumbers the slots of frames so the unused ones are dropped, and shrinks
+    // the frames. Frames open during calls are left alone, as callees may
+    // refer to their slots, and so are the parameters of functions.
+    void compactFrames(FrameAnalysis &analysis, bool isMain)
+    {
+      if (analysis.cfg.reversePostorder().size() != analysis.func.blocks.size())
+      {
+        return;
+      }
+
+      // the instruction pushing the size of each frame.
+      std::map<const PixIRInstruction *, PixIRInstruction *> sizes;
+      InstrIt mainAlloc;
+      bool hasMainAlloc = false;
+      for (std::unique_ptr<BasicBlock> &block : analysis.func.blocks)
+      {
+        for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+        {
+          if (it == block->instrs.begin())
+          {
+            continue;
+          }
+          if (it->opcode == PixIROpcode::OFRAME)
+          {
+            sizes[&*it] = &*std::prev(it);
+          }
+          else if (it->opcode == PixIROpcode::ALLOC && isMain && !hasMainAlloc)
+          {
+            mainAlloc = std::prev(it);
+            hasMainAlloc = true;
+            sizes[BASE_FRAME] = &*mainAlloc;
+          }
+        }
+      }
+
+      // new index of each slot, or none if the frame is left alone.
+      std::vector<std::optional<int>> renumbered(analysis.slots.size());
+      for (auto [frame, size] : sizes)
+      {
+        auto escapes = analysis.escapes.find(frame);
+        if (escapes == analysis.escapes.end() || escapes->second ||
+            !intOperand(*size))
+        {
+          continue;
+        }
+
+        auto frameSlots = analysis.frameSlots.find(frame);
+        std::vector<size_t> ordered;
+        if (frameSlots != analysis.frameSlots.end())
+        {
+          ordered = frameSlots->second;
+        }
+        std::sort(ordered.begin(), ordered.end(), [&](size_t a, size_t b)
+                  { return analysis.slots[a].index < analysis.slots[b].index; });
+        for (size_t i = 0; i < ordered.size(); i++)
+        {
+          renumbered[ordered[i]] = (int)i;
+        }
+        if (ordered.size() < (size_t)*intOperand(*size))
+        {
+          size->data = std::to_string(ordered.size());
+        }
+      }
+
+      for (size_t block = 0; block < analysis.func.blocks.size(); block++)
+      {
+        std::list<PixIRInstruction> &instrs = analysis.func.blocks[block]->instrs;
+        auto it = instrs.begin();
+        for (const Effect &effect : analysis.effects[block])
+        {
+          if (effect.slot && renumbered[*effect.slot])
+          {
+            int index = *renumbered[*effect.slot];
+            if (effect.kind == Effect::LOAD)
+            {
+              it->data = formatLoad(index, loadOperand(*it)->second);
+            }
+            else if (effect.kind == Effect::STORE)
+            {
+              std::prev(it, 2)->data = std::to_string(index);
+            }
+          }
+          ++it;
+        }
+      }
+
+      if (hasMainAlloc && intOperand(*mainAlloc) == 0)
+      {
+        std::list<PixIRInstruction> &instrs = analysis.func.blocks[0]->instrs;
+        instrs.erase(mainAlloc, std::next(mainAlloc, 2));
+      }
+    }
+
+  } // namespace
+
+  void eliminateDeadStores(PixIRFunction &func)
+  {
+    while (true)
+    {
+      FrameAnalysis analysis{func};
+      if (!analysis.valid)
+      {
+        return;
+      }
+      if (!removeDeadStores(analysis))
+      {
+        // the effects are still in step with the instructions.
+        compactFrames(analysis, func.funcName == "." MAIN_FUNC_NAME);
+        return;
+      }
+    }
+  }
+
+} // namespace codegen
@@ -1,23 +1,128 @@
 #include "deadcode.hh"
+#include "cfg.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
 
 namespace codegen
 {
+  void eliminateDeadCodeAfterReturn(PixIRFunction &func)
+  {
+    for (std::unique_ptr<BasicBlock> &block : func.blocks)
+    {
+      for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+      {
+        if (it->opcode == PixIROpcode::RET)
+        {
+          block->instrs.erase(++it, block->instrs.end());
+          break;
+        }
+      }
+    }
+  }
+
   void eliminateDeadCodeAfterReturn(PixIRCode &code)
   {
     for (std::unique_ptr<PixIRFunction> &func : code)
     {
-      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+      eliminateDeadCodeAfterReturn(*func);
+    }
+  }
+
+  // if block ends in a conditional jump on a constant, whether the jump is
+  // taken and the number of instructions computing the constant. CJMP jumps
+  // if the condition is 0, CJMP2 if it isn't.
+  static std::optional<std::pair<bool, size_t>>
+  constantCondition(const BasicBlock &block)
+  {
+    if (block.instrs.size() < 3 ||
+        (block.instrs.back().opcode != PixIROpcode::CJMP &&
+         block.instrs.back().opcode != PixIROpcode::CJMP2) ||
+        ControlFlowGraph::jumpTarget(block) == nullptr)
+    {
+      return std::nullopt;
+    }
+
+    auto isPush = [](const PixIRInstruction &instr, const char *operand)
+    {
+      return instr.opcode == PixIROpcode::PUSH &&
+             std::holds_alternative<std::string>(instr.data) &&
+             std::get<std::string>(instr.data) == operand;
+    };
+    auto isBool = [&](const PixIRInstruction &instr)
+    { return isPush(instr, "0") || isPush(instr, "1"); };
+    bool onZero = block.instrs.back().opcode == PixIROpcode::CJMP;
+
+    // the condition, then the jump target and the jump.
+    auto cond = std::prev(block.instrs.end(), 3);
+    if (isBool(*cond))
+    {
+      return std::make_pair((std::get<std::string>(cond->data) == "1") !=
+                                onZero,
+                            size_t{1});
+    }
+
+    // negated conditions of loop heads: PUSH c, PUSH 1, SUB.
+    if (block.instrs.size() >= 5 && cond->opcode == PixIROpcode::SUB)
+    {
+      auto one = std::prev(cond);
+      auto c = std::prev(one);
+      if (isBool(*c) && isPush(*one, "1"))
+      {
+        return std::make_pair((std::get<std::string>(c->data) == "0") !=
+                                  onZero,
+                              size_t{3});
+      }
+    }
+    return std::nullopt;
+  }
+
+  void eliminateUnreachableBlocks(PixIRFunction &func)
+  {
+    for (std::unique_ptr<BasicBlock> &block : func.blocks)
+    {
+      std::list<PixIRInstruction> &instrs = block->instrs;
+
+      auto exit = std::find_if(instrs.begin(), instrs.end(),
+                               [](const PixIRInstruction &instr)
+                               {
+                                 return instr.opcode == PixIROpcode::RET ||
+                                        instr.opcode == PixIROpcode::HALT;
+                               });
+      if (exit != instrs.end())
       {
-        for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+        instrs.erase(std::next(exit), instrs.end());
+        continue;
+      }
+
+      if (auto cond = constantCondition(*block))
+      {
+        auto [taken, length] = *cond;
+        auto jump = std::prev(instrs.end());
+        auto target = std::prev(jump);
+        instrs.erase(std::prev(target, length), target);
+        if (taken)
+        {
+          jump->opcode = PixIROpcode::JMP;
+        }
+        else
         {
-          if (it->opcode == PixIROpcode::RET)
-          {
-            block->instrs.erase(++it, block->instrs.end());
-            break;
-          }
+          instrs.erase(target, instrs.end());
         }
       }
     }
+
+    ControlFlowGraph cfg{func};
+    size_t kept = 0;
+    for (size_t block = 0; block < func.blocks.size(); block++)
+    {
+      if (cfg.isReachable(block))
+      {
+        func.blocks[kept++] = std::move(func.blocks[block]);
+      }
+    }
+    func.blocks.resize(kept);
   }
 
 } // end namespace codegen
@@ -1,97 +1,65 @@
 #ifndef DEADCODE_H_
 #define DEADCODE_H_
 
+#include "call_graph.hh"
 #include "codegen.hh"
 
-#include <set>
 #include <string>
-#include <unordered_map> // use unordered_* versions of sets/maps for hot vars.
-#include <unordered_set>
-#include <variant>
+#include <vector>
 
 namespace codegen
 {
 
+  // removes the functions which can't be reached by calls from main.
   class DeadFunctionEliminator
   {
   private:
-    std::vector<PixIRFunction *> workList;
-    // mostly for speeding things up.
-    std::unordered_map<std::string, PixIRFunction *> funcs;
     PixIRCode &code;
 
-    std::set<std::string> calleesOf(const PixIRFunction &func)
-    {
-      std::set<std::string> callees;
-
-      std::string funcName;
-      for (const std::unique_ptr<BasicBlock> &block : func.blocks)
-      {
-        for (const PixIRInstruction &instr : block->instrs)
-        {
-          if (instr.opcode == PixIROpcode::PUSH &&
-              std::holds_alternative<std::string>(instr.data) &&
-              (funcName = std::get<std::string>(instr.data)).rfind(".", 0) == 0)
-          {
-            callees.insert(funcName);
-          }
-        }
-      }
-      return callees;
-    }
-
   public:
-    DeadFunctionEliminator(PixIRCode &code) : code(code), funcs(code.size())
-    {
-      for (const std::unique_ptr<PixIRFunction> &func : code)
-      {
-        funcs.insert({func->funcName, func.get()});
-      }
-    }
+    DeadFunctionEliminator(PixIRCode &code) : code(code) {}
 
-    std::unordered_set<std::string> findReachable()
+    // whether each function of the code can be reached from main.
+    std::vector<bool> findReachable() const
     {
-      std::unordered_set<std::string> reachable{std::string(".") +
-                                                MAIN_FUNC_NAME};
-      workList = {funcs.at(std::string(".") + MAIN_FUNC_NAME)};
-
-      while (workList.size() > 0)
-      {
-        PixIRFunction *back = *--workList.end();
-        workList.pop_back();
-
-        for (const std::string &funcName : calleesOf(*back))
-        {
-          if (!reachable.count(funcName))
-          {
-            reachable.insert(funcName);
-            workList.push_back(funcs.at(funcName));
-          }
-        }
-      }
-
-      return reachable;
+      CallGraph graph{code};
+      return graph.reachableFrom(graph.idOf(std::string(".") + MAIN_FUNC_NAME));
     }
 
     void eliminate()
     {
-      std::unordered_set<std::string> reachable{findReachable()};
-      for (auto it = code.begin(); it != code.end(); ++it)
+      std::vector<bool> reachable = findReachable();
+      size_t kept = 0;
+      for (size_t func = 0; func < code.size(); func++)
       {
-        if (!reachable.count((*it)->funcName))
+        if (reachable[func])
         {
-          --it;
-          code.erase(it + 1);
+          code[kept++] = std::move(code[func]);
         }
       }
+      code.resize(kept);
     }
   };
 
   // another type of dead code elimination
   // Basically if we generate code after a return in a basic block, this is
   // dead code.
+  void eliminateDeadCodeAfterReturn(PixIRFunction &func);
   void eliminateDeadCodeAfterReturn(PixIRCode &code);
 
+  // removes the blocks which can't be reached from the entry of a function
+  // that hasn't been linearized yet. Conditional jumps on a constant, e.g. the
+  // head of while (true), are first turned into a JMP or dropped, and code
+  // after a RET or HALT is removed, as its jumps would refer to removed
+  // blocks.
+  void eliminateUnreachableBlocks(PixIRFunction &func);
+
+  // removes the stores to frame slots which are never loaded afterwards, as
+  // long as the value stored has no side effects, then drops the unused slots
+  // from the frames. Calls are assumed to load every slot, so frames open
+  // during a call keep their layout.
+  void eliminateDeadStores(PixIRFunction &func);
+
 } // end namespace codegen
 
 #endif // DEADCODE_H_
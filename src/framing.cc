@@ -0,0 +1,56 @@
+#include "framing.hh"
+
+namespace framing
+{
+
+  // guards against allocating absurd amounts of memory for a corrupt header.
+  static const size_t MAX_FIELD_SIZE = 64 * 1024 * 1024;
+
+  bool readField(std::istream &in, std::string &field)
+  {
+    std::string header;
+    if (!std::getline(in, header))
+    {
+      if (header.empty())
+      {
+        return false;
+      }
+      throw FramingError("Truncated field header.");
+    }
+
+    size_t size;
+    try
+    {
+      size_t pos;
+      size = std::stoull(header, &pos);
+      if (pos != header.size())
+      {
+        throw FramingError("Malformed field header \"" + header + "\".");
+      }
+    }
+    catch (std::logic_error &)
+    {
+      throw FramingError("Malformed field header \"" + header + "\".");
+    }
+
+    if (size > MAX_FIELD_SIZE)
+    {
+      throw FramingError("Field of " + std::to_string(size) +
+                         " bytes exceeds maximum field size.");
+    }
+
+    field.resize(size);
+    if (!in.read(field.data(), size))
+    {
+      throw FramingError("Truncated field.");
+    }
+    return true;
+  }
+
+  void writeField(std::ostream &out, const std::string &field)
+  {
+    out << field.size() << "\n";
+    out.write(field.data(), field.size());
+  }
+
+} // namespace framing
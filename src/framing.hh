@@ -0,0 +1,30 @@
+#ifndef FRAMING_H_
+#define FRAMING_H_
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace framing
+{
+
+  // Length-prefixed fields, each sent as
+  //
+  //   <length of field in bytes, in decimal>\n<field bytes>
+  //
+  // Used by the compile server's protocol and the compilation cache's entries.
+
+  class FramingError : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // reads a single field. Returns false if the stream ended cleanly before
+  // the field started, throws FramingError on a malformed or truncated field.
+  bool readField(std::istream &in, std::string &field);
+  void writeField(std::ostream &out, const std::string &field);
+
+} // namespace framing
+
+#endif // FRAMING_H_
@@ -1,6 +1,8 @@
 #include "lexer.hh"
 
+#include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -324,6 +326,11 @@ namespace lexer
     LexerState state = START;
     Token token;
 
+    if (line > UINT32_MAX || col > UINT32_MAX)
+    {
+      throw LexerError("Source file is too large.", line, col);
+    }
+
     token.loc.sline = line;
     token.loc.scol = col;
 
@@ -374,8 +381,8 @@ namespace lexer
     }
 
     token.type = tokenType(state);
-    token.loc.eline = line;
-    token.loc.ecol = col;
+    token.loc.eline = std::min<size_t>(line, UINT32_MAX);
+    token.loc.ecol = std::min<size_t>(col, UINT32_MAX);
     return token;
   }
 
@@ -2,23 +2,43 @@
 #define LOCATION_H_
 
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
 #include <string>
 
+// Locations are embedded in every token and AST node, so components are kept
+// to 32 bits. The lexer rejects sources with more lines or columns than that.
 struct Location
 {
-  size_t sline, scol, eline, ecol;
+  uint32_t sline = 0, scol = 0, eline = 0, ecol = 0;
 
-  Location merge(Location &other)
+  Location merge(const Location &other) const
   {
     return Location{
         std::min(this->sline, other.sline), std::min(this->scol, other.scol),
         std::max(this->eline, other.eline), std::max(this->ecol, other.ecol)};
   }
 
-  std::string to_string()
+  // formats the location as [sline:scol]-[eline:ecol].
+  std::string to_string() const
   {
-    return "[" + std::to_string(sline) + ":" + std::to_string(scol) + "]-[" +
-           std::to_string(eline) + ":" + std::to_string(ecol) + "]";
+    char buf[64];
+    char *p = buf;
+    char *end = buf + sizeof(buf);
+
+    *p++ = '[';
+    p = std::to_chars(p, end, sline).ptr;
+    *p++ = ':';
+    p = std::to_chars(p, end, scol).ptr;
+    *p++ = ']';
+    *p++ = '-';
+    *p++ = '[';
+    p = std::to_chars(p, end, eline).ptr;
+    *p++ = ':';
+    p = std::to_chars(p, end, ecol).ptr;
+    *p++ = ']';
+
+    return std::string(buf, p);
   }
 };
 
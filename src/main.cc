@@ -1,35 +1,93 @@
+#include "batch.hh"
 #include "compiler.hh"
+#include "server.hh"
 #include "util.hh"
 
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct DriverOptions
+{
+  CompilerOptions compilerOpts;
+
+  // run as a compile server instead of compiling a single source.
+  bool serve = false;
+  std::optional<std::string> serveSocket = std::nullopt;
+
+  // batch mode, used when more than one source (or a manifest) is given.
+  std::vector<std::string> sources;
+  bool batch = false;
+  // also used for a single source, if given.
+  std::optional<size_t> jobs = std::nullopt;
+};
 
 void print_usage()
 {
 
   const std::string helpMessage =
-      "./pixelc {<options>} [-o <outfile>] [-xml <outfile>] [src]\n"
+      "./pixelc {<options>} [-j <n>] [-o <outfile>] [-xml <outfile>] [src]\n"
+      "./pixelc {<options>} [-j <n>] [-o <outdir>] [-xml <outdir>] "
+      "{src | @manifest}\n"
+      "./pixelc [-cache-dir <dir>] --serve [<socket>]\n"
       "Options:\n"
       "  -o                  Specify output file. By default stdout is used.\n"
       "  -xml                Generate XML from the AST produced. An output "
       "file for the XML must also be specified.\n"
+      "  -xml-depth          Leave AST nodes nested deeper than the given\n"
+      "                      depth out of the XML.\n"
+      "  -xml-func           Only export the XML for the named function.\n"
+      "  -ast                Write the parsed program to the given file in a\n"
+      "                      compact binary format, which can be compiled\n"
+      "                      again in place of the source.\n"
       "  -frotate-loops      Rotates while/for loops when generating code.\n"
+      "  -funroll-loops      Unroll for loops with a known number of\n"
+      "                      iterations.\n"
+      "  -fcoalesce-pixels   Draw loops and runs of pixels of one colour as\n"
+      "                      rectangles.\n"
       "  -felim-dead-code    Eliminate dead code.\n"
       "  -fpeephole-optimize Enable the peephole optimizer.\n"
+      "  -fssa-optimize      Propagate constants and reuse values.\n"
+      "  -fspecialize-calls  Clone functions for calls with constant\n"
+      "                      arguments.\n"
+      "  -fmemoize-calls     Cache the results of pure functions called in\n"
+      "                      loops.\n"
+      "  -cache-dir          Cache compiler outputs in the given directory,\n"
+      "                      reusing them when the same source is compiled\n"
+      "                      again with the same options.\n"
+      "  -cache-size         Maximum size of the cache in bytes. Defaults to\n"
+      "                      64MiB.\n"
+      "  -j                  Number of worker threads used to compile\n"
+      "                      several sources at once. Defaults to one per\n"
+      "                      hardware thread. With a single source, the\n"
+      "                      threads check, generate code for and optimize\n"
+      "                      functions in parallel instead.\n"
       "  -h                  Print this help message and exit immediately.\n"
+      "  --serve             Run as a compile server, reading length-prefixed\n"
+      "                      requests from stdin (or from connections to a\n"
+      "                      Unix socket, if one is given) and writing\n"
+      "                      responses back.\n"
       "Args:\n"
-      "  src                 Specifies source file to compile.\n";
+      "  src                 Specifies source file to compile. If more than\n"
+      "                      one source is given, each is compiled to\n"
+      "                      <stem>.pixardis (and <stem>.xml), and -o,\n"
+      "                      -xml and -ast name output directories\n"
+      "                      instead.\n"
+      "  @manifest           Compile every source listed (one per line) in\n"
+      "                      the manifest file.\n";
 
   std::cout << helpMessage;
   exit(0);
 }
 
-CompilerOptions parseArgs(int argc, char *argv[])
+DriverOptions parseArgs(int argc, char *argv[])
 {
-  CompilerOptions options;
+  DriverOptions driverOptions;
+  CompilerOptions &options = driverOptions.compilerOpts;
 
   // arg processing
-  bool gotSource = false;
   for (int i = 1; i < argc; i++)
   {
     std::string arg{std::move(argv[i])};
@@ -58,42 +116,188 @@ CompilerOptions parseArgs(int argc, char *argv[])
       }
       options.xmlOutfile = std::string(std::move(argv[i]));
     }
-    else if (arg == "-frotate-loops")
+    else if (arg == "-ast")
     {
-      options.rotateLoops = true;
+      options.generateBinaryAst = true;
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected filename for binary AST output." << std::endl;
+        exit(-1);
+      }
+      options.binaryAstOutfile = std::string(std::move(argv[i]));
     }
-    else if (arg == "-felim-dead-code")
+    else if (arg == "-xml-depth")
     {
-      options.eliminateDeadCode = true;
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected maximum depth of XML." << std::endl;
+        exit(-1);
+      }
+      try
+      {
+        options.xmlMaxDepth = std::stoi(argv[i]);
+      }
+      catch (std::logic_error &)
+      {
+        std::cerr << "Invalid XML depth " << argv[i] << "." << std::endl;
+        exit(-1);
+      }
     }
-    else if (arg == "-fpeephole-optimize")
+    else if (arg == "-xml-func")
     {
-      options.peepholeOptimize = true;
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected function name for XML output." << std::endl;
+        exit(-1);
+      }
+      options.xmlFunction = std::string(std::move(argv[i]));
     }
-    else if (gotSource)
+    else if (setOptimizationFlag(options, arg))
     {
-      std::cerr << "Cannot process more than one source file at a time."
-                << std::endl;
-      exit(-1);
+      continue;
+    }
+    else if (arg == "--serve")
+    {
+      driverOptions.serve = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-')
+      {
+        i++;
+        driverOptions.serveSocket = std::string(std::move(argv[i]));
+      }
+    }
+    else if (arg == "-cache-dir")
+    {
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected directory for cache." << std::endl;
+        exit(-1);
+      }
+      options.cacheDir = std::string(std::move(argv[i]));
+    }
+    else if (arg == "-cache-size")
+    {
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected cache size." << std::endl;
+        exit(-1);
+      }
+      try
+      {
+        options.cacheMaxBytes = std::stoull(argv[i]);
+      }
+      catch (std::logic_error &)
+      {
+        std::cerr << "Invalid cache size " << argv[i] << "." << std::endl;
+        exit(-1);
+      }
+    }
+    else if (arg == "-j")
+    {
+      i++;
+      if (i >= argc)
+      {
+        std::cerr << "Expected number of jobs." << std::endl;
+        exit(-1);
+      }
+      try
+      {
+        driverOptions.jobs = std::stoul(argv[i]);
+      }
+      catch (std::logic_error &)
+      {
+        std::cerr << "Invalid number of jobs " << argv[i] << "." << std::endl;
+        exit(-1);
+      }
+    }
+    else if (arg[0] == '@')
+    {
+      try
+      {
+        std::vector<std::string> listed = readManifest(arg.substr(1));
+        driverOptions.sources.insert(driverOptions.sources.end(),
+                                     listed.begin(), listed.end());
+      }
+      catch (CompilationError &e)
+      {
+        std::cerr << e.what() << std::endl;
+        exit(-1);
+      }
+      driverOptions.batch = true;
     }
     else
     {
-      options.infile = arg;
-      gotSource = true;
+      driverOptions.sources.push_back(arg);
     }
   }
 
-  return options;
+  if (driverOptions.sources.size() > 1)
+  {
+    driverOptions.batch = true;
+  }
+  else if (!driverOptions.batch && driverOptions.sources.size() == 1)
+  {
+    options.infile = driverOptions.sources.front();
+  }
+
+  if (!driverOptions.batch && driverOptions.jobs)
+  {
+    options.threads = driverOptions.jobs.value();
+  }
+
+  return driverOptions;
 }
 
 int main(int argc, char *argv[])
 {
 
-  CompilerOptions options = parseArgs(argc, argv);
+  DriverOptions options = parseArgs(argc, argv);
+
+  if (options.serve)
+  {
+    try
+    {
+      if (options.serveSocket)
+      {
+        server::serveSocket(options.serveSocket.value(),
+                            options.compilerOpts);
+      }
+      else
+      {
+        server::serve(std::cin, std::cout, options.compilerOpts);
+      }
+    }
+    catch (std::runtime_error &e)
+    {
+      std::cerr << e.what() << std::endl;
+      exit(-1);
+    }
+    return 0;
+  }
+
+  if (options.batch)
+  {
+    BatchOptions batchOptions;
+    batchOptions.compilerOpts = options.compilerOpts;
+    batchOptions.outDir = options.compilerOpts.outfile;
+    batchOptions.xmlOutDir = options.compilerOpts.xmlOutfile;
+    batchOptions.astOutDir = options.compilerOpts.binaryAstOutfile;
+    batchOptions.jobs = options.jobs.value_or(0);
+
+    if (compileBatch(options.sources, batchOptions, std::cerr) > 0)
+    {
+      exit(-1);
+    }
+    return 0;
+  }
 
   try
   {
-    Compiler compiler{options};
+    Compiler compiler{options.compilerOpts};
     compiler.compile();
   }
   catch (CompilationError &e)
@@ -49,7 +49,7 @@ namespace parser
     }
   }
 
-  ast::ExprNodePtr Parser::parseArrayAccess(bool isLValue)
+  ast::ExprNodePtr Parser::parseLValueArrayAccess()
   {
     lexer::Token iden = consume();
 
@@ -67,7 +67,7 @@ namespace parser
     // pointer (the value of the identifier).
     ast::ExprNodePtr arrAccess = std::make_unique<ast::ArrayAccessNode>(
         std::make_unique<ast::IdExprNode>(iden.value, false, iden.loc),
-        std::move(idxExpr), isLValue, iden.loc.merge(rsqbrace.loc));
+        std::move(idxExpr), true, iden.loc.merge(rsqbrace.loc));
     Location loc = arrAccess->loc;
 
     while (peek(0).type == lexer::LSQBRACE_TOK)
@@ -80,45 +80,14 @@ namespace parser
 
       loc = loc.merge(rsqbrace.loc);
       arrAccess = std::make_unique<ast::ArrayAccessNode>(
-          std::move(arrAccess), std::move(idxExpr), isLValue, loc);
+          std::move(arrAccess), std::move(idxExpr), true, loc);
     }
 
     return arrAccess;
   }
 
-  ast::ExprNodePtr Parser::parseLValueArrayAccess()
-  {
-    return parseArrayAccess(true);
-  }
-
-  ast::ExprNodePtr Parser::parseRValueArrayAccess()
-  {
-    return parseArrayAccess(false);
-  }
-
-  ast::ExprNodePtr Parser::parseFunctionCall()
-  {
-    lexer::Token funcName = consume();
-
-    lexer::Token lbracket = consume();
-    CHECK_TOKEN(lbracket, lexer::LBRACKET_TOK);
-
-    std::vector<ast::ExprNodePtr> args;
-    while (peek(0).type != lexer::RBRACKET_TOK)
-    {
-      args.push_back(std::move(parseExpr()));
-      if (peek(0).type != lexer::RBRACKET_TOK)
-      {
-        consume(); // consume , token
-      }
-    }
-
-    Location endloc = consume().loc; // consume ) token.
-
-    return std::make_unique<ast::FunctionCallNode>(
-        funcName.value, std::move(args), funcName.loc.merge(endloc));
-  }
-
+  // parses a single operand without subexpressions. Brackets, prefix
+  // operators and operands with subexpressions are handled by parseExpr().
   ast::ExprNodePtr Parser::parseFactor()
   {
     switch (peek(0).type)
@@ -151,72 +120,9 @@ namespace parser
     }
 
     case lexer::IDENTIFIER:
-    {
-      switch (peek(1).type)
-      {
-      case lexer::LBRACKET_TOK:
-        return parseFunctionCall();
-      case lexer::LSQBRACE_TOK:
-        return parseRValueArrayAccess();
-      default:
-      {
-        lexer::Token tok = consume();
-        return std::make_unique<ast::IdExprNode>(tok.value, false, tok.loc);
-      }
-      }
-    }
-
-    case lexer::LBRACKET_TOK:
-    {
-      consume(); // consume (
-      ast::ExprNodePtr subexpr = parseExpr();
-      if (consume().type != lexer::RBRACKET_TOK)
-      {
-        // consume )
-        throw ParserError("Mismatched bracket", loc);
-      }
-      return subexpr;
-    }
-
-    case lexer::MINUS_TOK:
-    {
-      lexer::Token tok = consume();
-      ast::ExprNodePtr subexpr = parseFactor();
-      return std::make_unique<ast::UnaryExprNode>(
-          ast::UnaryExprNode::UnaryOp::MINUS, std::move(subexpr),
-          tok.loc.merge(subexpr->loc));
-    }
-
-    case lexer::NOT:
     {
       lexer::Token tok = consume();
-      ast::ExprNodePtr subexpr = parseFactor();
-      return std::make_unique<ast::UnaryExprNode>(
-          ast::UnaryExprNode::UnaryOp::NOT, std::move(subexpr),
-          tok.loc.merge(subexpr->loc));
-    }
-
-    case lexer::RANDI:
-    {
-      lexer::Token tok = consume();
-      ast::ExprNodePtr subexpr = parseExpr();
-      return std::make_unique<ast::RandiExprNode>(std::move(subexpr),
-                                                  tok.loc.merge(subexpr->loc));
-    }
-
-    case lexer::READ:
-    {
-      lexer::Token tok = consume();
-
-      ast::ExprNodePtr xExpr = parseExpr();
-
-      lexer::Token comma = consume();
-      CHECK_TOKEN(comma, lexer::COMMA_TOK);
-
-      ast::ExprNodePtr yExpr = parseExpr();
-
-      return std::make_unique<ast::ReadExprNode>(
-          std::move(xExpr), std::move(yExpr), tok.loc.merge(yExpr->loc));
+      return std::make_unique<ast::IdExprNode>(tok.value, false, tok.loc);
     }
 
     case lexer::PAD_HEIGHT:
@@ -225,101 +131,325 @@ namespace parser
     case lexer::PAD_WIDTH:
       return std::make_unique<ast::PadWidthExprNode>(consume().loc);
 
-    case lexer::NEWARR:
-    {
-      lexer::Token tok = consume();
-
-      ast::TypeNodePtr ofType = parseType();
-
-      lexer::Token comma = consume();
-      CHECK_TOKEN(comma, lexer::COMMA_TOK);
-
-      ast::ExprNodePtr arrSizeExpr = parseExpr();
-      Location loc = tok.loc.merge(arrSizeExpr->loc);
-
-      return std::make_unique<ast::NewArrExprNode>(std::move(ofType),
-                                                   std::move(arrSizeExpr), loc);
-    }
-
     case lexer::GETCHAR:
       return std::make_unique<ast::GetCharNode>(consume().loc);
 
-    case lexer::FLOAT2INT:
-    {
-      lexer::Token tok = consume();
-      ast::ExprNodePtr subexpr = parseExpr();
-      return std::make_unique<ast::Float2IntNode>(std::move(subexpr),
-                                                  tok.loc.merge(subexpr->loc));
-    }
-
     default:
       throw ParserError("Failed in parseFactor", consume().loc);
     }
   }
 
-  ast::ExprNodePtr Parser::parseTerm()
+  // binding power of binary operators, or 0 for tokens which aren't binary
+  // operators.
+  static int precedence(lexer::TokenType type)
   {
-    ast::ExprNodePtr left = parseFactor();
-
-    switch (peek(0).type)
+    switch (type)
     {
     case lexer::STAR_TOK:
     case lexer::DIV_TOK:
     case lexer::AND:
-    {
-      ast::BinaryExprNode::BinaryOp op = tokenTypeToBinaryOp(consume().type);
-      ast::ExprNodePtr right = parseTerm();
-
-      return std::make_unique<ast::BinaryExprNode>(
-          op, std::move(left), std::move(right), left->loc.merge(right->loc));
-    }
-    default:
-      return left;
-    }
-  }
-
-  ast::ExprNodePtr Parser::parseSimpleExpr()
-  {
-    ast::ExprNodePtr left = parseTerm();
-
-    switch (peek(0).type)
-    {
+      return 3;
     case lexer::PLUS_TOK:
     case lexer::MINUS_TOK:
     case lexer::OR:
-    {
-      ast::BinaryExprNode::BinaryOp op = tokenTypeToBinaryOp(consume().type);
-      ast::ExprNodePtr right = parseSimpleExpr();
-
-      return std::make_unique<ast::BinaryExprNode>(
-          op, std::move(left), std::move(right), left->loc.merge(right->loc));
-    }
+      return 2;
+    case lexer::GREATER_TOK:
+    case lexer::LESS_TOK:
+    case lexer::EQ_TOK:
+    case lexer::NEQ_TOK:
+    case lexer::GE:
+    case lexer::LE:
+      return 1;
     default:
-      return left;
+      return 0;
     }
   }
 
+  static const int RELATIONAL_PRECEDENCE = 1;
+
+  // Expressions are parsed by precedence climbing over explicit stacks, so
+  // long operator chains and deeply nested brackets, calls, indices and
+  // operands of builtins don't grow the native stack. The trees produced are
+  // those of the grammar
+  //
+  //   Expr       ::= SimpleExpr [ RelOp SimpleExpr ]
+  //   SimpleExpr ::= Term [ AddOp SimpleExpr ]
+  //   Term       ::= Factor [ MulOp Term ]
+  //   Factor     ::= ( Expr ) | - Factor | not Factor | ...
+  //
+  // i.e. binary operators are right associative, and there is at most one
+  // relational operator per bracket level.
   ast::ExprNodePtr Parser::parseExpr()
   {
-    ast::ExprNodePtr left = parseSimpleExpr();
+    struct PendingBinaryOp
+    {
+      ast::BinaryExprNode::BinaryOp op;
+      int prec;
+    };
 
-    switch (peek(0).type)
+    struct PendingUnaryOp
     {
-    case lexer::GREATER_TOK:
-    case lexer::LESS_TOK:
-    case lexer::EQ_TOK:
-    case lexer::NEQ_TOK:
-    case lexer::GE:
-    case lexer::LE:
+      ast::UnaryExprNode::UnaryOp op;
+      Location loc;
+    };
+
+    // one frame per subexpression being parsed, plus one for the expression
+    // itself.
+    struct Frame
     {
-      ast::BinaryExprNode::BinaryOp op = tokenTypeToBinaryOp(consume().type);
-      ast::ExprNodePtr right = parseSimpleExpr();
+      // what the subexpression is part of: the expression itself (END),
+      // an open bracket (LBRACKET_TOK), the arguments of a call
+      // (IDENTIFIER), an index (LSQBRACE_TOK) or the operands of a builtin.
+      lexer::TokenType kind;
+      lexer::Token tok;
+      // arguments of the call so far, the array indexed, the x of a __read
+      // or the type of a __newarr.
+      std::vector<ast::ExprNodePtr> args;
+      ast::ExprNodePtr base;
+      ast::TypeNodePtr type;
+
+      std::vector<ast::ExprNodePtr> operands;
+      std::vector<PendingBinaryOp> binaryOps;
+      // prefix operators applying to the next operand.
+      std::vector<PendingUnaryOp> unaryOps;
+      bool sawRelOp = false;
+
+      Frame(lexer::TokenType kind, lexer::Token tok = {})
+          : kind(kind), tok(std::move(tok))
+      {
+      }
 
-      return std::make_unique<ast::BinaryExprNode>(
-          op, std::move(left), std::move(right), left->loc.merge(right->loc));
-    }
-    default:
-      return left;
+      // combines operands joined by operators binding tighter than prec.
+      void reduce(int prec)
+      {
+        while (!binaryOps.empty() && binaryOps.back().prec > prec)
+        {
+          ast::ExprNodePtr right = std::move(operands.back());
+          operands.pop_back();
+          ast::ExprNodePtr left = std::move(operands.back());
+          operands.pop_back();
+
+          Location loc = left->loc.merge(right->loc);
+          operands.push_back(std::make_unique<ast::BinaryExprNode>(
+              binaryOps.back().op, std::move(left), std::move(right), loc));
+          binaryOps.pop_back();
+        }
+      }
+    };
+
+    std::vector<Frame> frames;
+    frames.emplace_back(lexer::END);
+
+    while (true)
+    {
+      // prefix operators and the openings of subexpressions, up to the next
+      // operand.
+      ast::ExprNodePtr operand;
+      while (!operand)
+      {
+        switch (peek(0).type)
+        {
+        case lexer::MINUS_TOK:
+          frames.back().unaryOps.push_back(
+              {ast::UnaryExprNode::UnaryOp::MINUS, consume().loc});
+          break;
+        case lexer::NOT:
+          frames.back().unaryOps.push_back(
+              {ast::UnaryExprNode::UnaryOp::NOT, consume().loc});
+          break;
+        case lexer::LBRACKET_TOK:
+          consume(); // consume (
+          frames.emplace_back(lexer::LBRACKET_TOK);
+          break;
+        case lexer::IDENTIFIER:
+          if (peek(1).type == lexer::LBRACKET_TOK)
+          {
+            lexer::Token funcName = consume();
+            consume(); // consume (
+            if (peek(0).type == lexer::RBRACKET_TOK)
+            {
+              Location endloc = consume().loc; // consume ) token.
+              operand = std::make_unique<ast::FunctionCallNode>(
+                  funcName.value, std::vector<ast::ExprNodePtr>{},
+                  funcName.loc.merge(endloc));
+              break;
+            }
+            frames.emplace_back(lexer::IDENTIFIER, std::move(funcName));
+          }
+          else if (peek(1).type == lexer::LSQBRACE_TOK)
+          {
+            lexer::Token iden = consume();
+            consume(); // consume [
+            // NOTE: see parseLValueArrayAccess().
+            ast::ExprNodePtr base =
+                std::make_unique<ast::IdExprNode>(iden.value, false, iden.loc);
+            frames.emplace_back(lexer::LSQBRACE_TOK, std::move(iden));
+            frames.back().base = std::move(base);
+          }
+          else
+          {
+            operand = parseFactor();
+          }
+          break;
+        case lexer::RANDI:
+        case lexer::READ:
+        case lexer::FLOAT2INT:
+        {
+          lexer::Token tok = consume();
+          frames.emplace_back(tok.type, std::move(tok));
+          break;
+        }
+        case lexer::NEWARR:
+        {
+          lexer::Token tok = consume();
+
+          ast::TypeNodePtr ofType = parseType();
+
+          lexer::Token comma = consume();
+          CHECK_TOKEN(comma, lexer::COMMA_TOK);
+
+          frames.emplace_back(lexer::NEWARR, std::move(tok));
+          frames.back().type = std::move(ofType);
+          break;
+        }
+        default:
+          operand = parseFactor();
+        }
+      }
+
+      // the operand is followed either by a binary operator, or by the end of
+      // its frame, which completes the subexpression the frame is part of.
+      while (operand)
+      {
+        Frame &frame = frames.back();
+
+        for (auto it = frame.unaryOps.rbegin(); it != frame.unaryOps.rend();
+             ++it)
+        {
+          Location loc = it->loc.merge(operand->loc);
+          operand = std::make_unique<ast::UnaryExprNode>(
+              it->op, std::move(operand), loc);
+        }
+        frame.unaryOps.clear();
+        frame.operands.push_back(std::move(operand));
+
+        int prec = precedence(peek(0).type);
+        if (prec == RELATIONAL_PRECEDENCE && frame.sawRelOp)
+        {
+          prec = 0;
+        }
+
+        frame.reduce(prec);
+        if (prec > 0)
+        {
+          frame.binaryOps.push_back({tokenTypeToBinaryOp(consume().type), prec});
+          frame.sawRelOp |= prec == RELATIONAL_PRECEDENCE;
+          break;
+        }
+
+        ast::ExprNodePtr subexpr = std::move(frame.operands.back());
+        Frame done = std::move(frame);
+        frames.pop_back();
+
+        switch (done.kind)
+        {
+        case lexer::END:
+          return subexpr;
+
+        case lexer::LBRACKET_TOK:
+          if (consume().type != lexer::RBRACKET_TOK)
+          {
+            // consume )
+            throw ParserError("Mismatched bracket", loc);
+          }
+          operand = std::move(subexpr);
+          break;
+
+        case lexer::IDENTIFIER:
+          done.args.push_back(std::move(subexpr));
+          if (peek(0).type != lexer::RBRACKET_TOK)
+          {
+            consume(); // consume , token
+          }
+          if (peek(0).type != lexer::RBRACKET_TOK)
+          {
+            // the next argument.
+            frames.emplace_back(lexer::IDENTIFIER, std::move(done.tok));
+            frames.back().args = std::move(done.args);
+          }
+          else
+          {
+            Location endloc = consume().loc; // consume ) token.
+            operand = std::make_unique<ast::FunctionCallNode>(
+                done.tok.value, std::move(done.args),
+                done.tok.loc.merge(endloc));
+          }
+          break;
+
+        case lexer::LSQBRACE_TOK:
+        {
+          lexer::Token rsqbrace = consume();
+          CHECK_TOKEN(rsqbrace, lexer::RSQBRACE_TOK);
+
+          Location loc = done.base->loc.merge(rsqbrace.loc);
+          operand = std::make_unique<ast::ArrayAccessNode>(
+              std::move(done.base), std::move(subexpr), false, loc);
+          if (peek(0).type == lexer::LSQBRACE_TOK)
+          {
+            // the next index.
+            consume(); // consume [
+            frames.emplace_back(lexer::LSQBRACE_TOK, std::move(done.tok));
+            frames.back().base = std::move(operand);
+          }
+          break;
+        }
+
+        case lexer::RANDI:
+        {
+          Location loc = done.tok.loc.merge(subexpr->loc);
+          operand =
+              std::make_unique<ast::RandiExprNode>(std::move(subexpr), loc);
+          break;
+        }
+
+        case lexer::READ:
+          if (!done.base)
+          {
+            lexer::Token comma = consume();
+            CHECK_TOKEN(comma, lexer::COMMA_TOK);
+
+            // the y coordinate.
+            frames.emplace_back(lexer::READ, std::move(done.tok));
+            frames.back().base = std::move(subexpr);
+          }
+          else
+          {
+            Location loc = done.tok.loc.merge(subexpr->loc);
+            operand = std::make_unique<ast::ReadExprNode>(
+                std::move(done.base), std::move(subexpr), loc);
+          }
+          break;
+
+        case lexer::NEWARR:
+        {
+          Location loc = done.tok.loc.merge(subexpr->loc);
+          operand = std::make_unique<ast::NewArrExprNode>(
+              std::move(done.type), std::move(subexpr), loc);
+          break;
+        }
+
+        case lexer::FLOAT2INT:
+        {
+          Location loc = done.tok.loc.merge(subexpr->loc);
+          operand =
+              std::make_unique<ast::Float2IntNode>(std::move(subexpr), loc);
+          break;
+        }
+
+        default:
+          throw std::logic_error("Unexpected expression frame.");
+        }
+      }
     }
   }
 
@@ -513,76 +643,71 @@ namespace parser
                                               loc.merge(semicolon.loc));
   }
 
-  ast::StmtNodePtr Parser::parseIfElse()
+  void Parser::openBody(OpenStmt &stmt)
+  {
+    stmt.bodyLoc = consume().loc; // consume {.
+  }
+
+  Parser::OpenStmt Parser::openBlock()
+  {
+    OpenStmt stmt{lexer::LBRACE_TOK};
+    openBody(stmt);
+    return stmt;
+  }
+
+  Parser::OpenStmt Parser::openIfElse()
   {
-    Location loc = consume().loc; // consume if token.
+    OpenStmt stmt{lexer::IF, consume().loc}; // consume if token.
 
     lexer::Token lbracket = consume();
     CHECK_TOKEN(lbracket, lexer::LBRACKET_TOK);
 
-    ast::ExprNodePtr cond = parseExpr();
+    stmt.cond = parseExpr();
 
     lexer::Token rbracket = consume();
     CHECK_TOKEN(rbracket, lexer::RBRACKET_TOK);
 
-    ast::StmtNodePtr ifBody = parseBlock();
-
-    loc = loc.merge(ifBody->loc);
-
-    ast::StmtNodePtr elseBody = nullptr;
-    if (peek(0).type == lexer::ELSE)
-    {
-      consume(); // consume else token
-      elseBody = parseBlock();
-      loc = loc.merge(elseBody->loc);
-    }
-
-    return std::make_unique<ast::IfElseStmt>(std::move(cond), std::move(ifBody),
-                                             std::move(elseBody), loc);
+    openBody(stmt);
+    return stmt;
   }
 
-  ast::StmtNodePtr Parser::parseFor()
+  Parser::OpenStmt Parser::openFor()
   {
-    Location loc = consume().loc; // consume for token.
+    OpenStmt stmt{lexer::FOR, consume().loc}; // consume for token.
 
     lexer::Token lbracket = consume();
     CHECK_TOKEN(lbracket, lexer::LBRACKET_TOK);
 
-    ast::StmtNodePtr varDecl = parseVariableDecl();
+    stmt.varDecl = parseVariableDecl();
 
-    ast::ExprNodePtr cond = parseExpr();
+    stmt.cond = parseExpr();
 
     lexer::Token semicolon = consume();
     CHECK_TOKEN(semicolon, lexer::SEMICOLON_TOK);
 
-    ast::StmtNodePtr assignment = parseAssignment();
+    stmt.assignment = parseAssignment();
 
     lexer::Token rbracket = consume();
     CHECK_TOKEN(rbracket, lexer::RBRACKET_TOK);
 
-    ast::StmtNodePtr body = parseBlock();
-
-    return std::make_unique<ast::ForStmt>(std::move(varDecl), std::move(cond),
-                                          std::move(assignment), std::move(body),
-                                          loc.merge(body->loc));
+    openBody(stmt);
+    return stmt;
   }
 
-  ast::StmtNodePtr Parser::parseWhile()
+  Parser::OpenStmt Parser::openWhile()
   {
-    Location loc = consume().loc; // consume while token.
+    OpenStmt stmt{lexer::WHILE, consume().loc}; // consume while token.
 
     lexer::Token lbracket = consume();
     CHECK_TOKEN(lbracket, lexer::LBRACKET_TOK);
 
-    ast::ExprNodePtr cond = parseExpr();
+    stmt.cond = parseExpr();
 
     lexer::Token rbracket = consume();
     CHECK_TOKEN(rbracket, lexer::RBRACKET_TOK);
 
-    ast::StmtNodePtr body = parseBlock();
-
-    return std::make_unique<ast::WhileStmt>(std::move(cond), std::move(body),
-                                            loc.merge(body->loc));
+    openBody(stmt);
+    return stmt;
   }
 
   ast::StmtNodePtr Parser::parseReturn()
@@ -611,21 +736,20 @@ namespace parser
     return {iden.value, std::move(type)};
   }
 
-  ast::StmtNodePtr Parser::parseFun()
+  Parser::OpenStmt Parser::openFun()
   {
-    Location loc = consume().loc; // consume fun token
+    OpenStmt stmt{lexer::FUN, consume().loc}; // consume fun token
 
     lexer::Token iden = consume();
     CHECK_TOKEN(iden, lexer::IDENTIFIER);
+    stmt.funcName = std::move(iden.value);
 
     lexer::Token lbracket = consume();
     CHECK_TOKEN(lbracket, lexer::LBRACKET_TOK);
 
-    std::vector<ast::FormalParam> formalParams;
-
     while (peek(0).type != lexer::RBRACKET_TOK)
     {
-      formalParams.push_back(parseFormalParam());
+      stmt.params.push_back(parseFormalParam());
       if (peek(0).type == lexer::COMMA_TOK)
       {
         consume(); // consume , token.
@@ -637,63 +761,135 @@ namespace parser
     lexer::Token arrow = consume();
     CHECK_TOKEN(arrow, lexer::ARROW);
 
-    ast::TypeNodePtr type = parseType();
-
-    ast::StmtNodePtr body = parseBlock();
+    stmt.retType = parseType();
 
-    return std::make_unique<ast::FuncDeclStmt>(
-        iden.value, std::move(formalParams), std::move(type), std::move(body),
-        loc.merge(body->loc));
+    openBody(stmt);
+    return stmt;
   }
 
-  ast::StmtNodePtr Parser::parseBlock()
+  ast::StmtNodePtr Parser::closeBody(OpenStmt &stmt)
   {
-    Location loc = consume().loc;
+    Location endloc = consume().loc; // consume }.
 
-    std::vector<ast::StmtNodePtr> stmts;
+    ast::StmtNodePtr body = std::make_unique<ast::BlockStmt>(
+        std::move(stmt.stmts), stmt.bodyLoc.merge(endloc));
+    stmt.stmts.clear();
+    Location loc = stmt.loc.merge(body->loc);
 
-    while (peek(0).type != lexer::RBRACE_TOK)
+    switch (stmt.kind)
     {
-      stmts.push_back(std::move(parseStatement()));
-    }
+    case lexer::LBRACE_TOK:
+      return body;
 
-    Location endloc = consume().loc; // consume }.
+    case lexer::IF:
+      if (peek(0).type == lexer::ELSE)
+      {
+        consume(); // consume else token
+        stmt.kind = lexer::ELSE;
+        stmt.loc = loc;
+        stmt.ifBody = std::move(body);
+        openBody(stmt);
+        return nullptr;
+      }
+      return std::make_unique<ast::IfElseStmt>(
+          std::move(stmt.cond), std::move(body), nullptr, loc);
 
-    return std::make_unique<ast::BlockStmt>(std::move(stmts), loc.merge(endloc));
-  }
+    case lexer::ELSE:
+      return std::make_unique<ast::IfElseStmt>(
+          std::move(stmt.cond), std::move(stmt.ifBody), std::move(body), loc);
 
-  ast::StmtNodePtr Parser::parseStatement()
-  {
-    switch (peek(0).type)
-    {
-    case lexer::LET:
-      return parseVariableDecl();
-    case lexer::IDENTIFIER:
-      return parseAssignment();
-    case lexer::PRINT:
-      return parsePrint();
-    case lexer::DELAY:
-      return parseDelay();
-    case lexer::PIXEL:
-      return parsePixel();
-    case lexer::PIXELR:
-      return parsePixelR();
-    case lexer::PUTCHAR:
-      return parsePutChar();
-    case lexer::IF:
-      return parseIfElse();
     case lexer::FOR:
-      return parseFor();
+      return std::make_unique<ast::ForStmt>(
+          std::move(stmt.varDecl), std::move(stmt.cond),
+          std::move(stmt.assignment), std::move(body), loc);
+
     case lexer::WHILE:
-      return parseWhile();
-    case lexer::RETURN:
-      return parseReturn();
+      return std::make_unique<ast::WhileStmt>(std::move(stmt.cond),
+                                              std::move(body), loc);
+
     case lexer::FUN:
-      return parseFun();
-    case lexer::LBRACE_TOK:
-      return parseBlock();
+      return std::make_unique<ast::FuncDeclStmt>(
+          stmt.funcName, std::move(stmt.params), std::move(stmt.retType),
+          std::move(body), loc);
+
     default:
-      throw ParserError("Failed in parseStatement", consume().loc);
+      throw std::logic_error("Tokens of type " + std::to_string(stmt.kind) +
+                             " do not open a compound statement.");
+    }
+  }
+
+  ast::StmtNodePtr Parser::parseStatement()
+  {
+    // compound statements wait here while their bodies are parsed, so the
+    // depth of nesting isn't limited by the native stack.
+    std::vector<OpenStmt> open;
+
+    while (true)
+    {
+      ast::StmtNodePtr stmt;
+
+      switch (peek(0).type)
+      {
+      case lexer::LET:
+        stmt = parseVariableDecl();
+        break;
+      case lexer::IDENTIFIER:
+        stmt = parseAssignment();
+        break;
+      case lexer::PRINT:
+        stmt = parsePrint();
+        break;
+      case lexer::DELAY:
+        stmt = parseDelay();
+        break;
+      case lexer::PIXEL:
+        stmt = parsePixel();
+        break;
+      case lexer::PIXELR:
+        stmt = parsePixelR();
+        break;
+      case lexer::PUTCHAR:
+        stmt = parsePutChar();
+        break;
+      case lexer::RETURN:
+        stmt = parseReturn();
+        break;
+      case lexer::IF:
+        open.push_back(openIfElse());
+        continue;
+      case lexer::FOR:
+        open.push_back(openFor());
+        continue;
+      case lexer::WHILE:
+        open.push_back(openWhile());
+        continue;
+      case lexer::FUN:
+        open.push_back(openFun());
+        continue;
+      case lexer::LBRACE_TOK:
+        open.push_back(openBlock());
+        continue;
+      case lexer::RBRACE_TOK:
+        if (!open.empty())
+        {
+          stmt = closeBody(open.back());
+          if (stmt == nullptr)
+          {
+            continue; // the statement continues with an else branch.
+          }
+          open.pop_back();
+          break;
+        }
+        [[fallthrough]];
+      default:
+        throw ParserError("Failed in parseStatement", consume().loc);
+      }
+
+      if (open.empty())
+      {
+        return stmt;
+      }
+      open.back().stmts.push_back(std::move(stmt));
     }
   }
 
@@ -5,7 +5,10 @@
 #include "lexer.hh"
 #include "util.hh"
 
-#include <deque>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace parser
 {
@@ -14,59 +17,84 @@ namespace parser
   {
   public:
     ParserError(std::string errmsg, Location loc)
-        : CompilationError("Parser error at [" + std::to_string(loc.sline) + ":" +
-                           std::to_string(loc.scol) + "]-[" +
-                           std::to_string(loc.eline) + ":" +
-                           std::to_string(loc.ecol) + "]: " + errmsg) {}
+        : CompilationError("Parser error at " + loc.to_string() + ": " +
+                           errmsg) {}
   };
 
   class Parser
   {
   private:
     lexer::Lexer &lexer;
-    std::deque<lexer::Token> lookahead;
+
+    // the grammar never looks more than two tokens ahead, so lookahead lives
+    // in a small ring buffer. Tokens are moved in from the lexer and moved out
+    // by consume(), so their strings are never copied.
+    static const size_t MAX_LOOKAHEAD = 4;
+    std::array<lexer::Token, MAX_LOOKAHEAD> lookahead;
+    size_t lookaheadStart = 0;
+    size_t lookaheadSize = 0;
 
     Location loc;
 
-    lexer::Token peek(size_t i)
+    // the returned reference is invalidated by the next consume().
+    const lexer::Token &peek(size_t i)
     {
-      if (i + 1 > lookahead.size())
+      if (i >= MAX_LOOKAHEAD)
+      {
+        throw std::logic_error("Parser lookahead exceeds MAX_LOOKAHEAD.");
+      }
+      for (; lookaheadSize <= i; lookaheadSize++)
       {
-        for (int j = lookahead.size(); j < i + 1; ++j)
-        {
-          lookahead.push_back(lexer.getNextToken());
-        }
+        lookahead[(lookaheadStart + lookaheadSize) % MAX_LOOKAHEAD] =
+            lexer.getNextToken();
       }
-      return lookahead[i];
+      return lookahead[(lookaheadStart + i) % MAX_LOOKAHEAD];
     }
 
     lexer::Token consume()
     {
-      lexer::Token tok;
-      if (lookahead.size())
-      {
-        tok = lookahead.front();
-        lookahead.pop_front();
-      }
-      else
-      {
-        tok = lexer.getNextToken();
-      }
+      peek(0);
+      lexer::Token tok = std::move(lookahead[lookaheadStart]);
+      lookaheadStart = (lookaheadStart + 1) % MAX_LOOKAHEAD;
+      lookaheadSize--;
       loc = tok.loc;
       return tok;
     }
 
-    ast::ExprNodePtr parseArrayAccess(bool isLValue);
+    // a compound statement whose body is still being parsed.
+    struct OpenStmt
+    {
+      lexer::TokenType kind; // IF, ELSE, FOR, WHILE, FUN or LBRACE_TOK
+      Location loc;
+
+      ast::ExprNodePtr cond;
+      ast::StmtNodePtr varDecl, assignment, ifBody;
+      std::string funcName;
+      std::vector<ast::FormalParam> params;
+      ast::TypeNodePtr retType;
+
+      // the body parsed so far.
+      Location bodyLoc;
+      std::vector<ast::StmtNodePtr> stmts;
+    };
+
+    // parse a compound statement up to and including the { opening its body.
+    OpenStmt openIfElse();
+    OpenStmt openFor();
+    OpenStmt openWhile();
+    OpenStmt openFun();
+    OpenStmt openBlock();
+    void openBody(OpenStmt &stmt);
+
+    // consumes the } closing the body of stmt and completes it. Returns
+    // nullptr if stmt continues with an else branch, whose body is opened.
+    ast::StmtNodePtr closeBody(OpenStmt &stmt);
 
   public:
     Parser(lexer::Lexer &lexer) : lexer(lexer) {}
 
     ast::ExprNodePtr parseLValueArrayAccess();
-    ast::ExprNodePtr parseRValueArrayAccess();
-    ast::ExprNodePtr parseFunctionCall();
     ast::ExprNodePtr parseFactor();
-    ast::ExprNodePtr parseTerm();
-    ast::ExprNodePtr parseSimpleExpr();
     ast::ExprNodePtr parseExpr();
 
     ast::TypeNodePtr parseType();
@@ -80,12 +108,8 @@ namespace parser
     ast::StmtNodePtr parsePixel();
     ast::StmtNodePtr parsePixelR();
     ast::StmtNodePtr parsePutChar();
-    ast::StmtNodePtr parseIfElse();
-    ast::StmtNodePtr parseFor();
-    ast::StmtNodePtr parseWhile();
     ast::StmtNodePtr parseReturn();
-    ast::StmtNodePtr parseFun();
-    ast::StmtNodePtr parseBlock();
+    // parses a statement, including any statements nested inside it.
     ast::StmtNodePtr parseStatement();
 
     std::unique_ptr<ast::TranslationUnit> parse();
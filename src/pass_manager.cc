@@ -0,0 +1,86 @@
+#include "pass_manager.hh"
+#include "thread_pool.hh"
+
+#include <exception>
+
+namespace codegen
+{
+
+  void PassManager::addFunctionPass(FunctionPass pass)
+  {
+    passes.push_back({std::move(pass), nullptr});
+  }
+
+  void PassManager::addModulePass(ModulePass pass)
+  {
+    passes.push_back({nullptr, std::move(pass)});
+  }
+
+  void PassManager::runFunctionPasses(PixIRCode &code, size_t first,
+                                      size_t last)
+  {
+    std::vector<std::exception_ptr> errors(code.size());
+
+    auto optimize = [&](size_t i)
+    {
+      try
+      {
+        for (size_t pass = first; pass < last; pass++)
+        {
+          passes[pass].functionPass(*code[i]);
+        }
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    };
+
+    if (pool != nullptr && code.size() > 1)
+    {
+      pool->parallelFor(code.size(), optimize);
+    }
+    else
+    {
+      for (size_t i = 0; i < code.size(); i++)
+      {
+        optimize(i);
+        if (errors[i])
+        {
+          break;
+        }
+      }
+    }
+
+    for (std::exception_ptr &error : errors)
+    {
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  void PassManager::run(PixIRCode &code)
+  {
+    size_t pass = 0;
+    while (pass < passes.size())
+    {
+      if (passes[pass].modulePass)
+      {
+        passes[pass].modulePass(code);
+        pass++;
+        continue;
+      }
+
+      size_t last = pass;
+      while (last < passes.size() && passes[last].functionPass)
+      {
+        last++;
+      }
+      runFunctionPasses(code, pass, last);
+      pass = last;
+    }
+  }
+
+} // namespace codegen
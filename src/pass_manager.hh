@@ -0,0 +1,50 @@
+#ifndef PASS_MANAGER_H_
+#define PASS_MANAGER_H_
+
+#include "codegen.hh"
+
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+namespace codegen
+{
+
+  // transforms a single function without looking at any other.
+  using FunctionPass = std::function<void(PixIRFunction &)>;
+  // transforms the whole program, e.g. to remove functions.
+  using ModulePass = std::function<void(PixIRCode &)>;
+
+  // Runs optimization passes over PixIR in the order they were added.
+  //
+  // Consecutive function passes are run one function at a time, all of them
+  // on one function before moving on to the next, and functions are spread
+  // across the pool if one is given. Module passes are sync points: they start
+  // once every function pass before them has finished on every function.
+  class PassManager
+  {
+  private:
+    struct Pass
+    {
+      FunctionPass functionPass;
+      ModulePass modulePass;
+    };
+
+    std::vector<Pass> passes;
+    ThreadPool *pool;
+
+    void runFunctionPasses(PixIRCode &code, size_t first, size_t last);
+
+  public:
+    explicit PassManager(ThreadPool *pool = nullptr) : pool(pool) {}
+
+    void addFunctionPass(FunctionPass pass);
+    void addModulePass(ModulePass pass);
+
+    void run(PixIRCode &code);
+  };
+
+} // namespace codegen
+
+#endif // PASS_MANAGER_H_
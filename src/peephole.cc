@@ -49,26 +49,31 @@ namespace codegen
       {PixIRPattern({{PixIROpcode::PUSH, "0"}, {PixIROpcode::IRND}}),
        {{PixIROpcode::PUSH, "0"}}},
 
-      {PixIRPattern({{PixIROpcode::PUSH, "0"}, {PixIROpcode::DELAY}}), {{}}},
+      {PixIRPattern({{PixIROpcode::PUSH, "0"}, {PixIROpcode::DELAY}}), {}},
 
   };
 
-  void peepholeOptimize(PixIRCode &code)
+  void peepholeOptimize(PixIRFunction &func)
   {
-    for (std::unique_ptr<PixIRFunction> &func : code)
+    for (std::unique_ptr<BasicBlock> &block : func.blocks)
     {
-      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+      for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
       {
-        for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+        for (auto const &[pattern, substitute] : patterns)
         {
-          for (auto const &[pattern, substitute] : patterns)
-          {
-            it = pattern.match_and_replace(block->instrs, it, block->instrs.end(),
-                                           substitute);
-          }
+          it = pattern.match_and_replace(block->instrs, it, block->instrs.end(),
+                                         substitute);
         }
       }
     }
   }
 
+  void peepholeOptimize(PixIRCode &code)
+  {
+    for (std::unique_ptr<PixIRFunction> &func : code)
+    {
+      peepholeOptimize(*func);
+    }
+  }
+
 } // namespace codegen
@@ -65,6 +65,7 @@ namespace codegen
     }
   };
 
+  void peepholeOptimize(PixIRFunction &func);
   void peepholeOptimize(PixIRCode &code);
 
 } // end namespace codegen
@@ -0,0 +1,444 @@
+#include "call_graph.hh"
+#include "cfg.hh"
+#include "ssa.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    // the arguments memoized are the integers from 0 to MEMO_TABLE_SIZE - 1.
+    // A table holds their values, then whether each value has been stored,
+    // which is cleared when the table is made.
+    const int MEMO_TABLE_SIZE = 256;
+
+    // a call to memoize.
+    struct MemoSite
+    {
+      size_t block;
+      // the position of the PUSH of the number of arguments in the block.
+      size_t pos;
+      std::string callee;
+      // the number of frames opened since the function's entry.
+      int depth;
+    };
+
+    std::string slotOperand(int index, int depth)
+    {
+      return "[" + std::to_string(index) +
+             (depth == 0 ? "" : ":" + std::to_string(depth)) + "]";
+    }
+
+    bool isCount(const std::string &s)
+    {
+      return !s.empty() && s.size() <= 9 &&
+             s.find_first_not_of("0123456789") == std::string::npos;
+    }
+
+    // the calls of func in loops to one of callees, with one argument. The
+    // label and the number of arguments have to be pushed right before the
+    // call, so the call can be moved to another block with its argument.
+    std::vector<MemoSite> findMemoSites(const PixIRFunction &func,
+                                        const std::set<std::string> &callees)
+    {
+      if (func.blocks.empty())
+      {
+        return {};
+      }
+      ControlFlowGraph cfg{func};
+      DominatorTree domTree{cfg};
+      LoopInfo loops{cfg, domTree};
+      std::optional<std::vector<int>> opened = openFrames(func, cfg);
+      // the tables are made at the entry, which has to run once.
+      if (!opened || loops.depthOf(0) > 0)
+      {
+        return {};
+      }
+
+      std::vector<MemoSite> sites;
+      for (size_t block = 0; block < cfg.size(); block++)
+      {
+        if (loops.depthOf(block) == 0)
+        {
+          continue;
+        }
+        SSABlock ssa{*func.blocks[block]};
+        if (!ssa.valid())
+        {
+          continue;
+        }
+        const std::vector<SSABlock::Node> &nodes = ssa.nodes();
+        int depth = (*opened)[block];
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+          const PixIRInstruction &instr = nodes[n].instr;
+          if (instr.opcode == PixIROpcode::OFRAME)
+          {
+            depth++;
+          }
+          else if (instr.opcode == PixIROpcode::CFRAME)
+          {
+            depth--;
+          }
+          if (instr.opcode != PixIROpcode::CALL || n < 2)
+          {
+            continue;
+          }
+
+          const SSABlock::Value &label = ssa.value(nodes[n].operands[0]);
+          const SSABlock::Value &args = ssa.value(nodes[n].operands[1]);
+          if (label.def == n - 1 && args.def == n - 2 &&
+              nodes[n - 1].instr.opcode == PixIROpcode::PUSH &&
+              nodes[n - 2].instr.opcode == PixIROpcode::PUSH &&
+              label.constant && callees.count(*label.constant) &&
+              args.constant == "1")
+          {
+            sites.push_back({block, n - 2, *label.constant, depth});
+          }
+        }
+      }
+      return sites;
+    }
+
+    // splits the block of a call to memoize, keeping its argument in the slot
+    // arg and looking it up in the table held by the slot table.
+    void memoizeCall(PixIRFunction &func, const MemoSite &site, int arg,
+                     int table)
+    {
+      auto newBlock = [&]()
+      {
+        return std::make_unique<BasicBlock>(BasicBlock{&func, {}});
+      };
+      std::unique_ptr<BasicBlock> call = newBlock(), lookup = newBlock(),
+                                  miss = newBlock(), hit = newBlock(),
+                                  join = newBlock();
+
+      BasicBlock &block = *func.blocks[site.block];
+      auto at = std::next(block.instrs.begin(), site.pos);
+      // PUSH 1, PUSH <label> and CALL.
+      join->instrs.splice(join->instrs.end(), block.instrs, std::next(at, 3),
+                          block.instrs.end());
+      block.instrs.erase(at, block.instrs.end());
+
+      std::string n = slotOperand(arg, site.depth);
+      std::string tab = slotOperand(table, site.depth);
+      std::string size = std::to_string(MEMO_TABLE_SIZE);
+
+      // only integers in the table are looked up. Floats equal to one are
+      // rounded to it to index the table.
+      block.instrs.insert(
+          block.instrs.end(),
+          {{PixIROpcode::PUSH, std::to_string(arg)},
+           {PixIROpcode::PUSH, std::to_string(site.depth)},
+           {PixIROpcode::ST},
+           {PixIROpcode::PUSH, size},
+           {PixIROpcode::PUSH, n},
+           {PixIROpcode::LT},
+           {PixIROpcode::PUSH, "0"},
+           {PixIROpcode::PUSH, n},
+           {PixIROpcode::GE},
+           {PixIROpcode::AND},
+           {PixIROpcode::PUSH, n},
+           {PixIROpcode::ROUND},
+           {PixIROpcode::PUSH, n},
+           {PixIROpcode::EQ},
+           {PixIROpcode::AND},
+           {PixIROpcode::PUSH, lookup.get()},
+           {PixIROpcode::CJMP2}});
+      call->instrs = {{PixIROpcode::PUSH, n},
+                      {PixIROpcode::PUSH, "1"},
+                      {PixIROpcode::PUSH, site.callee},
+                      {PixIROpcode::CALL},
+                      {PixIROpcode::PUSH, join.get()},
+                      {PixIROpcode::JMP}};
+      lookup->instrs = {{PixIROpcode::PUSH, size},
+                        {PixIROpcode::PUSH, n},
+                        {PixIROpcode::ROUND},
+                        {PixIROpcode::ADD},
+                        {PixIROpcode::PUSH, tab},
+                        {PixIROpcode::LDA},
+                        {PixIROpcode::PUSH, hit.get()},
+                        {PixIROpcode::CJMP2}};
+      miss->instrs = {{PixIROpcode::PUSH, n},
+                      {PixIROpcode::PUSH, "1"},
+                      {PixIROpcode::PUSH, site.callee},
+                      {PixIROpcode::CALL},
+                      {PixIROpcode::DUP},
+                      {PixIROpcode::PUSH, n},
+                      {PixIROpcode::ROUND},
+                      {PixIROpcode::PUSH, tab},
+                      {PixIROpcode::STA},
+                      {PixIROpcode::PUSH, "1"},
+                      {PixIROpcode::PUSH, size},
+                      {PixIROpcode::PUSH, n},
+                      {PixIROpcode::ROUND},
+                      {PixIROpcode::ADD},
+                      {PixIROpcode::PUSH, tab},
+                      {PixIROpcode::STA},
+                      {PixIROpcode::PUSH, join.get()},
+                      {PixIROpcode::JMP}};
+      hit->instrs = {{PixIROpcode::PUSH, n},
+                     {PixIROpcode::ROUND},
+                     {PixIROpcode::PUSH, tab},
+                     {PixIROpcode::LDA}};
+
+      std::vector<std::unique_ptr<BasicBlock>> blocks;
+      blocks.push_back(std::move(call));
+      blocks.push_back(std::move(lookup));
+      blocks.push_back(std::move(miss));
+      blocks.push_back(std::move(hit));
+      blocks.push_back(std::move(join));
+      func.blocks.insert(func.blocks.begin() + site.block + 1,
+                         std::make_move_iterator(blocks.begin()),
+                         std::make_move_iterator(blocks.end()));
+      func.callees.push_back(site.callee);
+    }
+
+    // makes room for count slots at the end of the frame of main, and
+    // returns the index of the first, and where the code filling them goes.
+    // Returns nullopt if the frame may grow anywhere else than at the start
+    // of the entry.
+    std::optional<std::pair<int, std::list<PixIRInstruction>::iterator>>
+    extendFrame(PixIRFunction &func, int count)
+    {
+      std::list<PixIRInstruction> &entry = func.blocks[0]->instrs;
+      std::list<PixIRInstruction>::iterator alloc;
+      BasicBlock *allocBlock = nullptr;
+      for (std::unique_ptr<BasicBlock> &block : func.blocks)
+      {
+        for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+        {
+          if (it->opcode == PixIROpcode::ALLOC)
+          {
+            if (allocBlock)
+            {
+              return std::nullopt;
+            }
+            allocBlock = block.get();
+            alloc = it;
+          }
+        }
+      }
+
+      if (!allocBlock)
+      {
+        entry.push_front({PixIROpcode::ALLOC});
+        entry.push_front({PixIROpcode::PUSH, std::to_string(count)});
+        return std::make_pair(0, std::next(entry.begin(), 2));
+      }
+
+      // only a PUSH of the number of slots may come before it.
+      if (allocBlock != func.blocks[0].get() ||
+          alloc != std::next(entry.begin()) ||
+          entry.front().opcode != PixIROpcode::PUSH ||
+          !std::holds_alternative<std::string>(entry.front().data) ||
+          !isCount(std::get<std::string>(entry.front().data)))
+      {
+        return std::nullopt;
+      }
+      int allocated = std::stoi(std::get<std::string>(entry.front().data));
+      entry.front().data = std::to_string(allocated + count);
+      return std::make_pair(allocated, std::next(alloc));
+    }
+
+    // splits the entry of func at fill, and clears the flags of each table
+    // with a loop there, counting in the slot counter. The VM can't load
+    // the elements of an array which haven't been stored yet.
+    void clearFlags(PixIRFunction &func,
+                    std::list<PixIRInstruction>::iterator fill, int counter,
+                    const std::map<std::string, int> &tables)
+    {
+      auto loop = std::make_unique<BasicBlock>(BasicBlock{&func, {}});
+      auto rest = std::make_unique<BasicBlock>(BasicBlock{&func, {}});
+      std::list<PixIRInstruction> &entry = func.blocks[0]->instrs;
+      rest->instrs.splice(rest->instrs.end(), entry, fill, entry.end());
+
+      std::string i = slotOperand(counter, 0);
+      std::string size = std::to_string(MEMO_TABLE_SIZE);
+      entry.insert(entry.end(), {{PixIROpcode::PUSH, "0"},
+                                 {PixIROpcode::PUSH, std::to_string(counter)},
+                                 {PixIROpcode::PUSH, "0"},
+                                 {PixIROpcode::ST}});
+      for (const auto &[callee, table] : tables)
+      {
+        loop->instrs.insert(loop->instrs.end(),
+                            {{PixIROpcode::PUSH, "0"},
+                             {PixIROpcode::PUSH, size},
+                             {PixIROpcode::PUSH, i},
+                             {PixIROpcode::ADD},
+                             {PixIROpcode::PUSH, slotOperand(table, 0)},
+                             {PixIROpcode::STA}});
+      }
+      loop->instrs.insert(loop->instrs.end(),
+                          {{PixIROpcode::PUSH, "1"},
+                           {PixIROpcode::PUSH, i},
+                           {PixIROpcode::ADD},
+                           {PixIROpcode::PUSH, std::to_string(counter)},
+                           {PixIROpcode::PUSH, "0"},
+                           {PixIROpcode::ST},
+                           {PixIROpcode::PUSH, size},
+                           {PixIROpcode::PUSH, i},
+                           {PixIROpcode::LT},
+                           {PixIROpcode::PUSH, loop.get()},
+                           {PixIROpcode::CJMP2}});
+
+      std::vector<std::unique_ptr<BasicBlock>> blocks;
+      blocks.push_back(std::move(loop));
+      blocks.push_back(std::move(rest));
+      func.blocks.insert(func.blocks.begin() + 1,
+                         std::make_move_iterator(blocks.begin()),
+                         std::make_move_iterator(blocks.end()));
+    }
+
+  } // namespace
+
+  void eliminateCommonCalls(PixIRCode &code)
+  {
+    CallGraph graph{code};
+    std::vector<bool> pure = graph.findPure(code);
+    std::set<std::string> pureFuncs;
+    for (size_t func = 0; func < code.size(); func++)
+    {
+      if (pure[func])
+      {
+        pureFuncs.insert(code[func]->funcName);
+      }
+    }
+    if (pureFuncs.empty())
+    {
+      return;
+    }
+
+    for (std::unique_ptr<PixIRFunction> &func : code)
+    {
+      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+      {
+        SSABlock ssa{*block, {}, pureFuncs};
+        if (ssa.valid())
+        {
+          block->instrs = ssa.schedule();
+        }
+      }
+    }
+  }
+
+  void memoizePureCalls(PixIRCode &code)
+  {
+    CallGraph graph{code};
+    std::vector<bool> pure = graph.findPure(code);
+
+    // the numbers of arguments each label is called with.
+    std::map<std::string, std::set<std::string>> arities;
+    for (std::unique_ptr<PixIRFunction> &func : code)
+    {
+      for (std::unique_ptr<BasicBlock> &block : func->blocks)
+      {
+        SSABlock ssa{*block};
+        if (!ssa.valid())
+        {
+          continue;
+        }
+        for (const SSABlock::Node &node : ssa.nodes())
+        {
+          if (node.instr.opcode != PixIROpcode::CALL)
+          {
+            continue;
+          }
+          const std::optional<std::string> &label =
+              ssa.value(node.operands[0]).constant;
+          if (label)
+          {
+            arities[*label].insert(*ssa.value(node.operands[1]).constant);
+          }
+        }
+      }
+    }
+
+    // pure functions of one argument, which are expensive enough for a
+    // lookup to pay off.
+    std::set<std::string> memoizable;
+    for (size_t func = 0; func < code.size(); func++)
+    {
+      const PixIRFunction &callee = *code[func];
+      if (!pure[func] || callee.blocks.empty() ||
+          arities[callee.funcName] != std::set<std::string>{"1"})
+      {
+        continue;
+      }
+      ControlFlowGraph cfg{callee};
+      DominatorTree domTree{cfg};
+      if (!graph.calleesOf(func).empty() ||
+          !LoopInfo{cfg, domTree}.loops().empty())
+      {
+        memoizable.insert(callee.funcName);
+      }
+    }
+    if (memoizable.empty())
+    {
+      return;
+    }
+
+    // the tables are filled once per run of the function holding them, so
+    // only main gets them.
+    auto main = std::find_if(code.begin(), code.end(),
+                             [](const std::unique_ptr<PixIRFunction> &func)
+                             { return func->funcName == "." MAIN_FUNC_NAME; });
+    if (main == code.end())
+    {
+      return;
+    }
+    PixIRFunction &func = **main;
+    std::vector<MemoSite> sites = findMemoSites(func, memoizable);
+    if (sites.empty())
+    {
+      return;
+    }
+
+    // a slot for the argument, then one for each table.
+    std::map<std::string, int> tables;
+    for (const MemoSite &site : sites)
+    {
+      tables.insert({site.callee, 0});
+    }
+    auto extended = extendFrame(func, 1 + (int)tables.size());
+    if (!extended)
+    {
+      return;
+    }
+    auto [arg, init] = *extended;
+
+    std::list<PixIRInstruction> &entry = func.blocks[0]->instrs;
+    int table = arg;
+    for (auto &[callee, slot] : tables)
+    {
+      slot = ++table;
+      entry.insert(init,
+                   {{PixIROpcode::PUSH, std::to_string(2 * MEMO_TABLE_SIZE)},
+                    {PixIROpcode::ALLOCA},
+                    {PixIROpcode::PUSH, std::to_string(slot)},
+                    {PixIROpcode::PUSH, "0"},
+                    {PixIROpcode::ST}});
+    }
+
+    // later calls first, so the positions of earlier ones stay valid. The
+    // calls are in loops, so none is in the entry, which is split last.
+    std::sort(sites.begin(), sites.end(),
+              [](const MemoSite &a, const MemoSite &b)
+              {
+                return std::make_pair(a.block, a.pos) >
+                       std::make_pair(b.block, b.pos);
+              });
+    for (const MemoSite &site : sites)
+    {
+      memoizeCall(func, site, arg, tables.at(site.callee));
+    }
+    clearFlags(func, init, arg, tables);
+  }
+
+} // namespace codegen
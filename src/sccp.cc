@@ -0,0 +1,162 @@
+#include "cfg.hh"
+#include "deadcode.hh"
+#include "ssa.hh"
+
+#include <deque>
+#include <iterator>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    // whether a branch on the constant is taken, if it is an integer.
+    std::optional<bool> truthOf(const std::string &constant)
+    {
+      if (constant.empty() ||
+          constant.find_first_not_of("0123456789") != std::string::npos)
+      {
+        return std::nullopt;
+      }
+      return constant.find_first_not_of('0') != std::string::npos;
+    }
+
+    // whether the conditional jump ending a lifted block is taken, if its
+    // condition is a constant. CJMP jumps if the condition is 0, CJMP2 if it
+    // isn't.
+    std::optional<bool> branchTaken(const SSABlock &ssa)
+    {
+      if (ssa.nodes().empty())
+      {
+        return std::nullopt;
+      }
+      const SSABlock::Node &last = ssa.nodes().back();
+      if (last.instr.opcode != PixIROpcode::CJMP &&
+          last.instr.opcode != PixIROpcode::CJMP2)
+      {
+        return std::nullopt;
+      }
+      // pops the target, then the condition.
+      const std::optional<std::string> &cond =
+          ssa.value(last.operands[1]).constant;
+      std::optional<bool> truth = cond ? truthOf(*cond) : std::nullopt;
+      if (truth && last.instr.opcode == PixIROpcode::CJMP)
+      {
+        return !*truth;
+      }
+      return truth;
+    }
+
+  } // namespace
+
+  void propagateConstants(PixIRFunction &func, const SlotConstants &entrySlots)
+  {
+    if (func.blocks.empty())
+    {
+      return;
+    }
+
+    ControlFlowGraph cfg{func};
+    // the constants held by slots when each block is entered, or nullopt
+    // while no path to the block has been found.
+    std::vector<std::optional<SlotConstants>> entry(cfg.size());
+    entry[0] = entrySlots;
+
+    std::deque<size_t> workList{0};
+    std::vector<bool> queued(cfg.size());
+    queued[0] = true;
+    while (!workList.empty())
+    {
+      size_t block = workList.front();
+      workList.pop_front();
+      queued[block] = false;
+
+      SSABlock ssa{*func.blocks[block], *entry[block]};
+      SlotConstants exit = ssa.valid() ? ssa.exitSlots() : SlotConstants{};
+
+      // the jump target comes first among the successors.
+      std::vector<size_t> succs = cfg.successors(block);
+      if (std::optional<bool> taken = ssa.valid() ? branchTaken(ssa) : std::nullopt;
+          taken && succs.size() == 2)
+      {
+        succs = {*taken ? succs[0] : succs[1]};
+      }
+
+      for (size_t succ : succs)
+      {
+        bool changed = false;
+        if (!entry[succ])
+        {
+          entry[succ] = exit;
+          changed = true;
+        }
+        else
+        {
+          // keep the constants which agree along every path.
+          for (auto it = entry[succ]->begin(); it != entry[succ]->end();)
+          {
+            auto other = exit.find(it->first);
+            if (other == exit.end() || other->second != it->second)
+            {
+              it = entry[succ]->erase(it);
+              changed = true;
+            }
+            else
+            {
+              ++it;
+            }
+          }
+        }
+        if (changed && !queued[succ])
+        {
+          queued[succ] = true;
+          workList.push_back(succ);
+        }
+      }
+    }
+
+    for (size_t block = 0; block < cfg.size(); block++)
+    {
+      if (!entry[block])
+      {
+        continue;
+      }
+      SSABlock ssa{*func.blocks[block], *entry[block]};
+      if (!ssa.valid())
+      {
+        continue;
+      }
+      std::list<PixIRInstruction> &instrs = func.blocks[block]->instrs;
+      instrs = ssa.schedule();
+
+      // the condition is pushed as a constant unless computing it has side
+      // effects, which have to stay.
+      std::optional<bool> taken = branchTaken(ssa);
+      if (!taken || instrs.size() < 3)
+      {
+        continue;
+      }
+      auto jump = std::prev(instrs.end());
+      auto target = std::prev(jump);
+      auto cond = std::prev(target);
+      const std::string *operand = std::get_if<std::string>(&cond->data);
+      if (cond->opcode != PixIROpcode::PUSH || !operand || !truthOf(*operand))
+      {
+        continue;
+      }
+      instrs.erase(cond);
+      if (*taken)
+      {
+        jump->opcode = PixIROpcode::JMP;
+      }
+      else
+      {
+        instrs.erase(target, instrs.end());
+      }
+    }
+
+    eliminateUnreachableBlocks(func);
+  }
+
+} // namespace codegen
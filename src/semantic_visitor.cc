@@ -1,6 +1,8 @@
 #include "semantic_visitor.hh"
 #include "ast.hh"
+#include "thread_pool.hh"
 
+#include <exception>
 #include <memory>
 #include <stdexcept>
 
@@ -16,10 +18,8 @@ namespace ast
                         (NODEPTR)->loc);                                       \
   }
 
-  void SemanticVisitor::visit(BinaryExprNode &node)
+  void SemanticVisitor::check(BinaryExprNode &node)
   {
-    visitChildren(&node);
-
     const ast::TypeNodePtr &leftType = typeCheckerTable().at(node.left.get()),
                            &rightType = typeCheckerTable().at(node.right.get());
 
@@ -108,10 +108,8 @@ namespace ast
     }
   }
 
-  void SemanticVisitor::visit(UnaryExprNode &node)
+  void SemanticVisitor::check(UnaryExprNode &node)
   {
-    visitChildren(&node);
-
     const ast::TypeNodePtr &operandType =
         typeCheckerTable().at(node.operand.get());
 
@@ -139,10 +137,8 @@ namespace ast
     }
   }
 
-  void SemanticVisitor::visit(FunctionCallNode &node)
+  void SemanticVisitor::check(FunctionCallNode &node)
   {
-    visitChildren(&node);
-
     const SymbolTableEntry *entry = currentScope->get(node.funcName);
     if (entry == nullptr)
     {
@@ -156,8 +152,7 @@ namespace ast
                           node.loc);
     }
 
-    const FunctionTypeNode *funcType =
-        dynamic_cast<const ast::FunctionTypeNode *>(entry->type.get());
+    const FunctionTypeNode *funcType = entry->type->as<FunctionTypeNode>();
 
     if (funcType->argTypes.size() != node.args.size())
     {
@@ -224,37 +219,29 @@ namespace ast
     typeCheckerTable().insert({&node, std::make_unique<IntTypeNode>()});
   }
 
-  void SemanticVisitor::visit(ReadExprNode &node)
+  void SemanticVisitor::check(ReadExprNode &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.x.get(), IntTypeNode());
     CHECK_TYPE(node.y.get(), IntTypeNode());
 
     typeCheckerTable().insert({&node, std::make_unique<ColourTypeNode>()});
   }
 
-  void SemanticVisitor::visit(RandiExprNode &node)
+  void SemanticVisitor::check(RandiExprNode &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.operand.get(), IntTypeNode());
 
     typeCheckerTable().insert({&node, std::make_unique<IntTypeNode>()});
   }
 
-  void SemanticVisitor::visit(NewArrExprNode &node)
+  void SemanticVisitor::check(NewArrExprNode &node)
   {
-    visitChildren(&node);
-
     typeCheckerTable().insert({&node, std::make_unique<ArrayTypeNode>(
                                           node.ofType->copy(), Location{})});
   }
 
-  void SemanticVisitor::visit(ArrayAccessNode &node)
+  void SemanticVisitor::check(ArrayAccessNode &node)
   {
-    visitChildren(&node);
-
     const TypeNodePtr &arrType = typeCheckerTable().at(node.array.get());
 
     if (!arrType->isArrType())
@@ -266,7 +253,7 @@ namespace ast
     CHECK_TYPE(node.idx.get(), IntTypeNode());
 
     typeCheckerTable().insert(
-        {&node, dynamic_cast<ArrayTypeNode *>(arrType.get())->contained->copy()});
+        {&node, arrType->as<ArrayTypeNode>()->contained->copy()});
   }
 
   void SemanticVisitor::visit(GetCharNode &node)
@@ -274,19 +261,15 @@ namespace ast
     typeCheckerTable().insert({&node, std::make_unique<IntTypeNode>()});
   }
 
-  void SemanticVisitor::visit(Float2IntNode &node)
+  void SemanticVisitor::check(Float2IntNode &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.operand.get(), FloatTypeNode());
 
     typeCheckerTable().insert({&node, std::make_unique<IntTypeNode>()});
   }
 
-  void SemanticVisitor::visit(AssignmentStmt &node)
+  void SemanticVisitor::check(AssignmentStmt &node)
   {
-    visitChildren(&node);
-
     const ast::TypeNodePtr &leftType = typeCheckerTable().at(node.lvalue.get()),
                            &rightType = typeCheckerTable().at(node.expr.get());
 
@@ -299,10 +282,8 @@ namespace ast
     }
   }
 
-  void SemanticVisitor::visit(VariableDeclStmt &node)
+  void SemanticVisitor::check(VariableDeclStmt &node)
   {
-    visitChildren(&node);
-
     if (currentScope->symbols.count(node.id) != 0)
     {
       throw SemanticError("Symbol " + node.id + " defined twice in scope.",
@@ -316,28 +297,20 @@ namespace ast
                       std::make_unique<SymbolTableEntry>(std::move(varType)));
   }
 
-  void SemanticVisitor::visit(PrintStmt &node) { visitChildren(&node); }
-
-  void SemanticVisitor::visit(DelayStmt &node)
+  void SemanticVisitor::check(DelayStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.expr.get(), IntTypeNode());
   }
 
-  void SemanticVisitor::visit(PixelStmt &node)
+  void SemanticVisitor::check(PixelStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.x.get(), IntTypeNode());
     CHECK_TYPE(node.y.get(), IntTypeNode());
     CHECK_TYPE(node.colour.get(), ColourTypeNode());
   }
 
-  void SemanticVisitor::visit(PixelRStmt &node)
+  void SemanticVisitor::check(PixelRStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.x.get(), IntTypeNode());
     CHECK_TYPE(node.y.get(), IntTypeNode());
     CHECK_TYPE(node.w.get(), IntTypeNode());
@@ -345,10 +318,8 @@ namespace ast
     CHECK_TYPE(node.colour.get(), ColourTypeNode());
   }
 
-  void SemanticVisitor::visit(ReturnStmt &node)
+  void SemanticVisitor::check(ReturnStmt &node)
   {
-    visitChildren(&node);
-
     const std::optional<ast::FunctionTypeNode> &funcType =
         currentScope->getFuncType();
 
@@ -368,17 +339,13 @@ namespace ast
     }
   }
 
-  void SemanticVisitor::visit(PutCharStmt &node)
+  void SemanticVisitor::check(PutCharStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.expr.get(), IntTypeNode());
   }
 
-  void SemanticVisitor::visit(IfElseStmt &node)
+  void SemanticVisitor::check(IfElseStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.cond.get(), BoolTypeNode());
   }
 
@@ -386,18 +353,19 @@ namespace ast
   {
     enterScope(&node);
     visitChildren(&node);
-    CHECK_TYPE(node.cond.get(), BoolTypeNode());
-    exitScope();
+    schedule([this, &node]
+             {
+               CHECK_TYPE(node.cond.get(), BoolTypeNode());
+               exitScope();
+             });
   }
 
-  void SemanticVisitor::visit(WhileStmt &node)
+  void SemanticVisitor::check(WhileStmt &node)
   {
-    visitChildren(&node);
-
     CHECK_TYPE(node.cond.get(), BoolTypeNode());
   }
 
-  void SemanticVisitor::visit(FuncDeclStmt &node)
+  FunctionTypeNode SemanticVisitor::signatureOf(const FuncDeclStmt &node)
   {
     std::vector<TypeNodePtr> argTypes(node.params.size());
     std::transform(
@@ -405,36 +373,129 @@ namespace ast
         [](const ast::FormalParam &param)
         { return param.second->copy(); });
 
-    std::unique_ptr<FunctionTypeNode> funcType =
-        std::make_unique<FunctionTypeNode>(node.retType->copy(),
-                                           std::move(argTypes), Location{});
-
-    currentScope->add(node.funcName,
-                      std::make_unique<SymbolTableEntry>(funcType->copy()));
+    return FunctionTypeNode(node.retType->copy(), std::move(argTypes),
+                            Location{});
+  }
 
-    enterScope(&node, std::move(*funcType));
+  void SemanticVisitor::enterFunction(FuncDeclStmt &node)
+  {
+    enterScope(&node, signatureOf(node));
     for (auto const &[paramName, paramType] : node.params)
     {
       currentScope->add(paramName,
                         std::make_unique<SymbolTableEntry>(paramType->copy()));
     }
+  }
+
+  void SemanticVisitor::visit(FuncDeclStmt &node)
+  {
+    currentScope->add(node.funcName, std::make_unique<SymbolTableEntry>(
+                                         signatureOf(node).copy()));
+
+    enterFunction(node);
     // this will create a new scope for the block, but that's ok. The formal
     // params will be available in the new scope.
     visitChildren(&node);
-    exitScope();
+    schedule([this]
+             { exitScope(); });
   }
 
   void SemanticVisitor::visit(BlockStmt &node)
   {
     enterScope(&node);
     visitChildren(&node);
-    exitScope();
+    schedule([this]
+             { exitScope(); });
+  }
+
+  void SemanticVisitor::checkBodies(Scope *global,
+                                    const std::vector<DeferredBody> &bodies)
+  {
+    // every body gets its own checker and symbol table, so workers only share
+    // the global scope, which is no longer modified.
+    std::vector<SymbolTable> tables(bodies.size());
+    std::vector<std::exception_ptr> errors(bodies.size());
+
+    auto check = [&](size_t i)
+    {
+      try
+      {
+        SemanticVisitor checker{tables[i]};
+        checker.currentScope = global;
+        checker.enterFunction(*bodies[i].node);
+        checker.currentScope->visibleInParent = bodies[i].visible;
+        bodies[i].node->body->accept(&checker);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    };
+
+    if (pool != nullptr && bodies.size() > 1)
+    {
+      pool->parallelFor(bodies.size(), check);
+    }
+    else
+    {
+      for (size_t i = 0; i < bodies.size(); i++)
+      {
+        check(i);
+        if (errors[i])
+        {
+          break;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+      if (errors[i])
+      {
+        std::rethrow_exception(errors[i]);
+      }
+      symbolTable.merge(tables[i]);
+    }
   }
 
   void SemanticVisitor::visit(TranslationUnit &node)
   {
     enterScope(&node);
-    visitChildren(&node);
+    Scope *global = currentScope;
+
+    // the bodies of top-level functions only depend on the signatures and
+    // globals declared before them, so they are left until everything else has
+    // been checked in order, and can then be checked independently.
+    std::vector<DeferredBody> bodies;
+    std::exception_ptr error;
+    for (StmtNodePtr &stmt : node.stmts)
+    {
+      if (FuncDeclStmt *func = stmt->as<FuncDeclStmt>())
+      {
+        global->add(func->funcName, std::make_unique<SymbolTableEntry>(
+                                        signatureOf(*func).copy()));
+        bodies.push_back({func, global->symbols.size()});
+        continue;
+      }
+
+      try
+      {
+        traverse(stmt.get());
+      }
+      catch (...)
+      {
+        // functions declared before stmt come first, so their errors are
+        // reported instead.
+        error = std::current_exception();
+        break;
+      }
+    }
+
+    checkBodies(global, bodies);
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
     exitScope();
   }
 
@@ -5,10 +5,14 @@
 #include "util.hh"
 #include "visitor.hh"
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <optional>
 #include <stack>
+#include <vector>
+
+class ThreadPool;
 
 namespace ast
 {
@@ -17,15 +21,15 @@ namespace ast
   {
   public:
     SemanticError(std::string errmsg, Location loc)
-        : CompilationError("Semantic error at [" + std::to_string(loc.sline) +
-                           ":" + std::to_string(loc.scol) + "]-[" +
-                           std::to_string(loc.eline) + ":" +
-                           std::to_string(loc.ecol) + "]: " + errmsg) {}
+        : CompilationError("Semantic error at " + loc.to_string() + ": " +
+                           errmsg) {}
   };
 
   struct SymbolTableEntry
   {
     TypeNodePtr type;
+    // position among the symbols of its scope, in order of declaration.
+    size_t index = 0;
 
     SymbolTableEntry(TypeNodePtr &&type) : type(std::move(type)) {}
   };
@@ -36,6 +40,10 @@ namespace ast
     Scope *parent = nullptr;
     // stores the signature of a function whose scope we are entering.
     std::optional<FunctionTypeNode> funcType;
+    // number of the parent's symbols declared before this scope. Those
+    // declared later aren't visible from here, which matters when a function
+    // body is checked after the rest of the program.
+    size_t visibleInParent = SIZE_MAX;
 
     Scope(std::map<std::string, std::unique_ptr<SymbolTableEntry>> &&symbols,
           Scope *parent,
@@ -46,42 +54,45 @@ namespace ast
     // fetches the signature of the current scope's function (if any)
     const std::optional<FunctionTypeNode> &getFuncType() const
     {
-      if (funcType.has_value())
-      {
-        return funcType;
-      }
-      if (parent != nullptr)
+      const Scope *scope = this;
+      while (!scope->funcType.has_value() && scope->parent != nullptr)
       {
-        return parent->getFuncType();
+        scope = scope->parent;
       }
-      return funcType; // funcType == std::nullopt if we reached this point.
+      // std::nullopt if no enclosing scope belongs to a function.
+      return scope->funcType;
     }
 
-    const SymbolTableEntry *get(std::string symbol) const
+    const SymbolTableEntry *get(const std::string &symbol) const
     {
-      if (symbols.count(symbol))
+      size_t visible = SIZE_MAX;
+      for (const Scope *scope = this; scope != nullptr;
+           visible = scope->visibleInParent, scope = scope->parent)
       {
-        return symbols.at(symbol).get();
-      }
-      if (parent != nullptr)
-      {
-        return parent->get(symbol);
+        auto it = scope->symbols.find(symbol);
+        if (it != scope->symbols.end() && it->second->index < visible)
+        {
+          return it->second.get();
+        }
       }
       return nullptr;
     }
 
     void add(std::string symbol, std::unique_ptr<SymbolTableEntry> &&entry)
     {
+      entry->index = symbols.size();
       symbols.insert({symbol, std::move(entry)});
     }
   };
 
   using SymbolTable = std::map<StmtNode *, std::unique_ptr<Scope>>;
 
-  class SemanticVisitor : public AbstractVisitor
+  class SemanticVisitor final : public Visitor<SemanticVisitor>
   {
   private:
     SymbolTable &symbolTable;
+    // checks the bodies of top-level functions in parallel, if given.
+    ThreadPool *pool;
     Scope *currentScope = nullptr;
 
     using TypeCheckerTable = std::map<const ExprNode *, TypeNodePtr>;
@@ -109,8 +120,52 @@ namespace ast
       typeCheckerTables.pop();
     }
 
+    static FunctionTypeNode signatureOf(const FuncDeclStmt &node);
+    // enters the scope of node's body, declaring its parameters.
+    void enterFunction(FuncDeclStmt &node);
+
+    // a top-level function, whose body is checked once the rest of the
+    // program has been.
+    struct DeferredBody
+    {
+      FuncDeclStmt *node;
+      // number of global symbols declared before the body.
+      size_t visible;
+    };
+
+    // checks bodies on the pool, throwing the error of the first one to fail.
+    void checkBodies(Scope *global, const std::vector<DeferredBody> &bodies);
+
+    // checks node once its children have been visited.
+    template <typename Node> void visitThenCheck(Node &node)
+    {
+      visitChildren(&node);
+      schedule([this, &node]
+               { check(node); });
+    }
+
+    void check(BinaryExprNode &node);
+    void check(UnaryExprNode &node);
+    void check(FunctionCallNode &node);
+    void check(ReadExprNode &node);
+    void check(RandiExprNode &node);
+    void check(NewArrExprNode &node);
+    void check(ArrayAccessNode &node);
+    void check(Float2IntNode &node);
+
+    void check(AssignmentStmt &node);
+    void check(VariableDeclStmt &node);
+    void check(DelayStmt &node);
+    void check(PixelStmt &node);
+    void check(PixelRStmt &node);
+    void check(ReturnStmt &node);
+    void check(PutCharStmt &node);
+    void check(IfElseStmt &node);
+    void check(WhileStmt &node);
+
   public:
-    SemanticVisitor(SymbolTable &symbolTable) : symbolTable(symbolTable) {}
+    SemanticVisitor(SymbolTable &symbolTable, ThreadPool *pool = nullptr)
+        : symbolTable(symbolTable), pool(pool) {}
 
     // nothing to check for types.
     void visit(IntTypeNode &node) override {}
@@ -119,9 +174,9 @@ namespace ast
     void visit(BoolTypeNode &node) override {}
     void visit(ArrayTypeNode &node) override {}
 
-    void visit(BinaryExprNode &node) override;
-    void visit(UnaryExprNode &node) override;
-    void visit(FunctionCallNode &node) override;
+    void visit(BinaryExprNode &node) override { visitThenCheck(node); }
+    void visit(UnaryExprNode &node) override { visitThenCheck(node); }
+    void visit(FunctionCallNode &node) override { visitThenCheck(node); }
     void visit(IdExprNode &node) override;
     void visit(BoolLiteralExprNode &node) override;
     void visit(IntLiteralExprNode &node) override;
@@ -129,24 +184,24 @@ namespace ast
     void visit(ColourLiteralExprNode &node) override;
     void visit(PadWidthExprNode &node) override;
     void visit(PadHeightExprNode &node) override;
-    void visit(ReadExprNode &node) override;
-    void visit(RandiExprNode &node) override;
-    void visit(NewArrExprNode &node) override;
-    void visit(ArrayAccessNode &node) override;
+    void visit(ReadExprNode &node) override { visitThenCheck(node); }
+    void visit(RandiExprNode &node) override { visitThenCheck(node); }
+    void visit(NewArrExprNode &node) override { visitThenCheck(node); }
+    void visit(ArrayAccessNode &node) override { visitThenCheck(node); }
     void visit(GetCharNode &node) override;
-    void visit(Float2IntNode &node) override;
-
-    void visit(AssignmentStmt &node) override;
-    void visit(VariableDeclStmt &node) override;
-    void visit(PrintStmt &node) override;
-    void visit(DelayStmt &node) override;
-    void visit(PixelStmt &node) override;
-    void visit(PixelRStmt &node) override;
-    void visit(ReturnStmt &node) override;
-    void visit(PutCharStmt &node) override;
-    void visit(IfElseStmt &node) override;
+    void visit(Float2IntNode &node) override { visitThenCheck(node); }
+
+    void visit(AssignmentStmt &node) override { visitThenCheck(node); }
+    void visit(VariableDeclStmt &node) override { visitThenCheck(node); }
+    void visit(PrintStmt &node) override { visitChildren(&node); }
+    void visit(DelayStmt &node) override { visitThenCheck(node); }
+    void visit(PixelStmt &node) override { visitThenCheck(node); }
+    void visit(PixelRStmt &node) override { visitThenCheck(node); }
+    void visit(ReturnStmt &node) override { visitThenCheck(node); }
+    void visit(PutCharStmt &node) override { visitThenCheck(node); }
+    void visit(IfElseStmt &node) override { visitThenCheck(node); }
     void visit(ForStmt &node) override;
-    void visit(WhileStmt &node) override;
+    void visit(WhileStmt &node) override { visitThenCheck(node); }
     void visit(FuncDeclStmt &node) override;
     void visit(BlockStmt &node) override;
 
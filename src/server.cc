@@ -0,0 +1,237 @@
+#include "server.hh"
+#include "compiler.hh"
+#include "framing.hh"
+
+#include <cerrno>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace server
+{
+
+  // minimal streambuf over a file descriptor, used to run serve() over socket
+  // connections.
+  class FdStreamBuf : public std::streambuf
+  {
+  private:
+    int fd;
+    char inBuf[4096];
+    char outBuf[4096];
+
+  protected:
+    int_type underflow() override
+    {
+      ssize_t n;
+      do
+      {
+        n = ::read(fd, inBuf, sizeof(inBuf));
+      } while (n < 0 && errno == EINTR);
+
+      if (n <= 0)
+      {
+        return traits_type::eof();
+      }
+      setg(inBuf, inBuf, inBuf + n);
+      return traits_type::to_int_type(*gptr());
+    }
+
+    int_type overflow(int_type c) override
+    {
+      if (sync() != 0)
+      {
+        return traits_type::eof();
+      }
+      if (!traits_type::eq_int_type(c, traits_type::eof()))
+      {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+      }
+      return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+      const char *p = pbase();
+      while (p < pptr())
+      {
+        ssize_t n = ::write(fd, p, pptr() - p);
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          return -1;
+        }
+        p += n;
+      }
+      setp(outBuf, outBuf + sizeof(outBuf));
+      return 0;
+    }
+
+  public:
+    FdStreamBuf(int fd) : fd(fd)
+    {
+      setg(inBuf, inBuf, inBuf);
+      setp(outBuf, outBuf + sizeof(outBuf));
+    }
+  };
+
+  bool readRequest(std::istream &in, CompileRequest &req)
+  {
+    if (!framing::readField(in, req.opts))
+    {
+      return false;
+    }
+    if (!framing::readField(in, req.src))
+    {
+      throw framing::FramingError("Request is missing source code.");
+    }
+    return true;
+  }
+
+  void writeResponse(std::ostream &out, const CompileResponse &resp)
+  {
+    framing::writeField(out, resp.ok ? "ok" : "error");
+    framing::writeField(out, resp.asmOutput);
+    framing::writeField(out, resp.xmlOutput);
+    framing::writeField(out, resp.diagnostics);
+    out.flush();
+  }
+
+  CompileResponse handleRequest(const CompileRequest &req,
+                                const CompilerOptions &baseOpts)
+  {
+    CompileResponse resp;
+
+    // XML is always generated, as it is part of every response.
+    CompilerOptions opts;
+    opts.generateXml = true;
+    opts.cacheDir = baseOpts.cacheDir;
+    opts.cacheMaxBytes = baseOpts.cacheMaxBytes;
+
+    std::stringstream optStream{req.opts};
+    std::string opt;
+    while (optStream >> opt)
+    {
+      if (opt == "-xml-depth" || opt == "-xml-func")
+      {
+        std::string value;
+        int depth;
+        if (!(optStream >> value))
+        {
+          resp.ok = false;
+          resp.diagnostics = "Expected a value for compiler option " + opt + ".";
+          return resp;
+        }
+        if (opt == "-xml-func")
+        {
+          opts.xmlFunction = value;
+        }
+        else if (std::stringstream(value) >> depth)
+        {
+          opts.xmlMaxDepth = depth;
+        }
+        else
+        {
+          resp.ok = false;
+          resp.diagnostics = "Invalid XML depth " + value + ".";
+          return resp;
+        }
+      }
+      else if (!setOptimizationFlag(opts, opt))
+      {
+        resp.ok = false;
+        resp.diagnostics = "Unknown compiler option " + opt + ".";
+        return resp;
+      }
+    }
+
+    try
+    {
+      pixelc::CompilationResult result = pixelc::compile(req.src, opts);
+      resp.ok = result.success;
+      resp.asmOutput = std::move(result.asmOutput);
+      resp.xmlOutput = std::move(result.xmlOutput);
+      resp.diagnostics = std::move(result.diagnostics);
+    }
+    catch (std::exception &e)
+    {
+      // keep the server alive even if the compiler trips over an internal
+      // error.
+      resp.ok = false;
+      resp.diagnostics = std::string("Internal compiler error: ") + e.what();
+    }
+
+    return resp;
+  }
+
+  void serve(std::istream &in, std::ostream &out,
+             const CompilerOptions &baseOpts)
+  {
+    CompileRequest req;
+    while (readRequest(in, req))
+    {
+      writeResponse(out, handleRequest(req, baseOpts));
+    }
+  }
+
+  static void serveConnection(int fd, CompilerOptions baseOpts)
+  {
+    FdStreamBuf buf{fd};
+    std::istream in{&buf};
+    std::ostream out{&buf};
+
+    try
+    {
+      serve(in, out, baseOpts);
+    }
+    catch (framing::FramingError &e)
+    {
+      std::cerr << "Dropping connection: " << e.what() << std::endl;
+    }
+    ::close(fd);
+  }
+
+  void serveSocket(const std::string &path, const CompilerOptions &baseOpts)
+  {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+      throw CompilationError("Socket path " + path + " is too long.");
+    }
+    path.copy(addr.sun_path, path.size());
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+      throw CompilationError("Could not create socket.");
+    }
+
+    // remove a stale socket left behind by a previous server.
+    ::unlink(path.c_str());
+    if (::bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        ::listen(sock, SOMAXCONN) < 0)
+    {
+      ::close(sock);
+      throw CompilationError("Could not listen on socket " + path + ".");
+    }
+
+    while (true)
+    {
+      int conn = ::accept(sock, nullptr, nullptr);
+      if (conn < 0)
+      {
+        continue;
+      }
+      std::thread(serveConnection, conn, baseOpts).detach();
+    }
+  }
+
+} // namespace server
@@ -0,0 +1,63 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "compiler.hh"
+#include "util.hh"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace server
+{
+
+  // The compile server speaks a simple protocol made up of length-prefixed
+  // fields (see framing.hh).
+  //
+  // A request consists of two fields:
+  //   1. compiler options, separated by whitespace (e.g. "-frotate-loops")
+  //   2. the source code to compile
+  //
+  // A response consists of four fields:
+  //   1. status, either "ok" or "error"
+  //   2. generated assembly (empty on error)
+  //   3. XML for the AST (empty on error)
+  //   4. diagnostics produced by the compiler (empty on success)
+
+  struct CompileRequest
+  {
+    std::string opts;
+    std::string src;
+  };
+
+  struct CompileResponse
+  {
+    bool ok = true;
+    std::string asmOutput;
+    std::string xmlOutput;
+    std::string diagnostics;
+  };
+
+  // reads a request, returning false if in is exhausted. Throws
+  // framing::FramingError on malformed input.
+  bool readRequest(std::istream &in, CompileRequest &req);
+  void writeResponse(std::ostream &out, const CompileResponse &resp);
+
+  // compiles a request. Only the cache settings of baseOpts are used; the
+  // remaining options come from the request itself.
+  CompileResponse handleRequest(const CompileRequest &req,
+                                const CompilerOptions &baseOpts = {});
+
+  // serve requests read from in until it is exhausted, writing responses to
+  // out.
+  void serve(std::istream &in, std::ostream &out,
+             const CompilerOptions &baseOpts = {});
+
+  // listen on a Unix domain socket at path, serving each connection on its
+  // own thread. Does not return unless setting up the socket fails.
+  void serveSocket(const std::string &path,
+                   const CompilerOptions &baseOpts = {});
+
+} // namespace server
+
+#endif // SERVER_H_
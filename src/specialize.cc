@@ -0,0 +1,224 @@
+#include "cfg.hh"
+#include "ssa.hh"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    // the fewest instructions clones may add, however small the code is.
+    const size_t MIN_SPECIALIZATION_BUDGET = 256;
+
+    struct CallSite
+    {
+      PixIRFunction *caller;
+      // the PUSH of the label called, which is redirected to a clone.
+      PixIRInstruction *label;
+      std::string callee;
+      // the constant of each argument, if it is one.
+      std::vector<std::optional<std::string>> args;
+      // the number of loops the call is in.
+      size_t loopDepth;
+    };
+
+    size_t codeSize(const PixIRFunction &func)
+    {
+      size_t size = 0;
+      for (const std::unique_ptr<BasicBlock> &block : func.blocks)
+      {
+        size += block->instrs.size();
+      }
+      return size;
+    }
+
+    std::unique_ptr<PixIRFunction> cloneFunction(const PixIRFunction &func,
+                                                 const std::string &name)
+    {
+      auto clone = std::make_unique<PixIRFunction>();
+      clone->funcName = name;
+      clone->callees = func.callees;
+
+      std::map<const BasicBlock *, BasicBlock *> blocks;
+      for (const std::unique_ptr<BasicBlock> &block : func.blocks)
+      {
+        clone->blocks.push_back(std::make_unique<BasicBlock>(
+            BasicBlock{clone.get(), block->instrs}));
+        blocks[block.get()] = clone->blocks.back().get();
+      }
+      for (std::unique_ptr<BasicBlock> &block : clone->blocks)
+      {
+        for (PixIRInstruction &instr : block->instrs)
+        {
+          if (auto *target = std::get_if<BasicBlock *>(&instr.data))
+          {
+            *target = blocks.at(*target);
+          }
+        }
+      }
+      return clone;
+    }
+
+    // appends the calls of func with at least one constant argument to
+    // sites.
+    void findCallSites(PixIRFunction &func, std::vector<CallSite> &sites)
+    {
+      if (func.blocks.empty())
+      {
+        return;
+      }
+      ControlFlowGraph cfg{func};
+      DominatorTree domTree{cfg};
+      LoopInfo loops{cfg, domTree};
+
+      for (size_t block = 0; block < cfg.size(); block++)
+      {
+        SSABlock ssa{*func.blocks[block]};
+        if (!ssa.valid())
+        {
+          continue;
+        }
+        std::vector<PixIRInstruction *> instrs;
+        for (PixIRInstruction &instr : func.blocks[block]->instrs)
+        {
+          instrs.push_back(&instr);
+        }
+
+        for (const SSABlock::Node &node : ssa.nodes())
+        {
+          if (node.instr.opcode != PixIROpcode::CALL)
+          {
+            continue;
+          }
+          // pops the label, the number of arguments, then the arguments.
+          const SSABlock::Value &label = ssa.value(node.operands[0]);
+          if (!label.constant || label.def == SSABlock::NONE)
+          {
+            continue;
+          }
+
+          std::vector<std::optional<std::string>> args;
+          bool constant = false;
+          for (size_t i = 2; i < node.operands.size(); i++)
+          {
+            std::optional<std::string> arg =
+                ssa.value(node.operands[i]).constant;
+            if (arg && arg->front() == '.')
+            {
+              arg = std::nullopt;
+            }
+            constant = constant || arg;
+            args.push_back(std::move(arg));
+          }
+          if (constant)
+          {
+            sites.push_back({&func, instrs[label.def], *label.constant,
+                             std::move(args), loops.depthOf(block)});
+          }
+        }
+      }
+    }
+
+  } // namespace
+
+  void specializeFunctions(PixIRCode &code)
+  {
+    // nested functions may share a label, and calls can't tell which one
+    // they refer to, so those aren't specialized.
+    std::map<std::string, PixIRFunction *> funcs;
+    std::set<std::string> shared;
+    size_t size = 0;
+    for (std::unique_ptr<PixIRFunction> &func : code)
+    {
+      if (!funcs.insert({func->funcName, func.get()}).second)
+      {
+        shared.insert(func->funcName);
+      }
+      size += codeSize(*func);
+    }
+    size_t budget = std::max(MIN_SPECIALIZATION_BUDGET, size / 4);
+
+    std::vector<CallSite> sites;
+    for (std::unique_ptr<PixIRFunction> &func : code)
+    {
+      findCallSites(*func, sites);
+    }
+    std::stable_sort(sites.begin(), sites.end(),
+                     [](const CallSite &a, const CallSite &b)
+                     { return a.loopDepth > b.loopDepth; });
+
+    // the clone for each function and arguments, or an empty label if the
+    // function isn't worth specializing on them.
+    std::map<std::pair<std::string, std::vector<std::optional<std::string>>>,
+             std::string>
+        clones;
+    // calls in clones are appended to sites, and specialized in turn.
+    for (size_t i = 0; i < sites.size(); i++)
+    {
+      CallSite site = sites[i];
+      auto func = funcs.find(site.callee);
+      if (func == funcs.end() || shared.count(site.callee))
+      {
+        continue;
+      }
+
+      auto [clone, added] = clones.insert({{site.callee, site.args}, ""});
+      const PixIRFunction &generic = *func->second;
+      if (added && codeSize(generic) <= budget)
+      {
+        std::string name;
+        for (size_t n = 1; name.empty() || funcs.count(name); n++)
+        {
+          name = site.callee + "_" + std::to_string(n);
+        }
+
+        SlotConstants entry;
+        for (size_t arg = 0; arg < site.args.size(); arg++)
+        {
+          if (site.args[arg])
+          {
+            entry[{(int)arg, 0}] = *site.args[arg];
+          }
+        }
+        std::unique_ptr<PixIRFunction> specialized =
+            cloneFunction(generic, name);
+        propagateConstants(*specialized, entry);
+
+        // only the constants of the arguments should make the clone smaller.
+        std::unique_ptr<PixIRFunction> reference =
+            cloneFunction(generic, generic.funcName);
+        propagateConstants(*reference);
+
+        if (codeSize(*specialized) < codeSize(*reference))
+        {
+          budget -= std::min(budget, codeSize(*specialized));
+          clone->second = name;
+          funcs[name] = specialized.get();
+          findCallSites(*specialized, sites);
+          code.push_back(std::move(specialized));
+        }
+      }
+      if (clone->second.empty())
+      {
+        continue;
+      }
+
+      site.label->data = clone->second;
+      std::vector<std::string> &callees = site.caller->callees;
+      auto callee = std::find(callees.begin(), callees.end(), site.callee);
+      if (callee != callees.end())
+      {
+        *callee = clone->second;
+      }
+      else
+      {
+        callees.push_back(clone->second);
+      }
+    }
+  }
+
+} // namespace codegen
@@ -0,0 +1,643 @@
+#include "ssa.hh"
+
+#include <climits>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace codegen
+{
+
+  namespace
+  {
+
+    // the number of values an instruction pops and pushes. CALL also pops the
+    // number of arguments given by its second operand.
+    std::pair<size_t, size_t> stackEffect(PixIROpcode opcode)
+    {
+      switch (opcode)
+      {
+      case PixIROpcode::PUSH:
+      case PixIROpcode::WIDTH:
+      case PixIROpcode::HEIGHT:
+      case PixIROpcode::GETCHAR:
+        return {0, 1};
+      case PixIROpcode::NOT:
+      case PixIROpcode::INC:
+      case PixIROpcode::DEC:
+      case PixIROpcode::ROUND:
+      case PixIROpcode::IRND:
+      case PixIROpcode::ALLOCA:
+        return {1, 1};
+      case PixIROpcode::AND:
+      case PixIROpcode::OR:
+      case PixIROpcode::ADD:
+      case PixIROpcode::SUB:
+      case PixIROpcode::MUL:
+      case PixIROpcode::DIV:
+      case PixIROpcode::MAX:
+      case PixIROpcode::MIN:
+      case PixIROpcode::LT:
+      case PixIROpcode::LE:
+      case PixIROpcode::EQ:
+      case PixIROpcode::NEQ:
+      case PixIROpcode::GT:
+      case PixIROpcode::GE:
+      case PixIROpcode::READ:
+      case PixIROpcode::LDA:
+      case PixIROpcode::CALL:
+        return {2, 1};
+      case PixIROpcode::JMP:
+      case PixIROpcode::RET:
+      case PixIROpcode::ALLOC:
+      case PixIROpcode::OFRAME:
+      case PixIROpcode::DELAY:
+      case PixIROpcode::CLEAR:
+      case PixIROpcode::PRINT:
+      case PixIROpcode::PUTCHAR:
+        return {1, 0};
+      case PixIROpcode::CJMP:
+      case PixIROpcode::CJMP2:
+        return {2, 0};
+      case PixIROpcode::ST:
+      case PixIROpcode::PIXEL:
+      case PixIROpcode::STA:
+        return {3, 0};
+      case PixIROpcode::PIXELR:
+        return {5, 0};
+      case PixIROpcode::DUP:
+        return {1, 2};
+      case PixIROpcode::CFRAME:
+      case PixIROpcode::HALT:
+        return {0, 0};
+      }
+      return {0, 0};
+    }
+
+    // parses a constant which is small enough to be folded without overflow.
+    // Negative, float and colour constants aren't folded.
+    std::optional<long long> intConstant(const std::optional<std::string> &s)
+    {
+      if (!s || s->empty() || s->size() > 9 ||
+          s->find_first_not_of("0123456789") != std::string::npos)
+      {
+        return std::nullopt;
+      }
+      return std::stoll(*s);
+    }
+
+    // parses the operand of PUSH [index:depth] or PUSH [index].
+    std::optional<std::pair<int, int>> slotOperand(const PixIRInstruction &instr)
+    {
+      if (instr.opcode != PixIROpcode::PUSH ||
+          !std::holds_alternative<std::string>(instr.data))
+      {
+        return std::nullopt;
+      }
+      const std::string &s = std::get<std::string>(instr.data);
+      if (s.size() < 3 || s.front() != '[' || s.back() != ']')
+      {
+        return std::nullopt;
+      }
+      size_t colon = s.find(':');
+      std::string index = s.substr(1, std::min(colon, s.size() - 1) - 1);
+      std::string depth =
+          colon == std::string::npos ? "0" : s.substr(colon + 1, s.size() - colon - 2);
+      std::optional<long long> i = intConstant(index), d = intConstant(depth);
+      if (!i || !d)
+      {
+        return std::nullopt;
+      }
+      return std::make_pair((int)*i, (int)*d);
+    }
+
+    // the constant computed by an instruction from constant operands, the
+    // top of the stack (i.e. the left operand) first. Results which can't be
+    // pushed back as they are, i.e. negative ones, aren't folded.
+    std::optional<std::string> fold(PixIROpcode opcode,
+                                    const std::vector<std::optional<long long>> &operands)
+    {
+      for (const std::optional<long long> &operand : operands)
+      {
+        if (!operand)
+        {
+          return std::nullopt;
+        }
+      }
+
+      std::optional<long long> result;
+      if (operands.size() == 1)
+      {
+        long long a = *operands[0];
+        switch (opcode)
+        {
+        case PixIROpcode::NOT:
+          result = !a;
+          break;
+        case PixIROpcode::INC:
+          result = a + 1;
+          break;
+        case PixIROpcode::DEC:
+          result = a - 1;
+          break;
+        default:
+          break;
+        }
+      }
+      else if (operands.size() == 2)
+      {
+        long long a = *operands[0], b = *operands[1];
+        switch (opcode)
+        {
+        case PixIROpcode::AND:
+          result = a && b;
+          break;
+        case PixIROpcode::OR:
+          result = a || b;
+          break;
+        case PixIROpcode::ADD:
+          result = a + b;
+          break;
+        case PixIROpcode::SUB:
+          result = a - b;
+          break;
+        case PixIROpcode::MUL:
+          result = a * b;
+          break;
+        case PixIROpcode::MAX:
+          result = std::max(a, b);
+          break;
+        case PixIROpcode::MIN:
+          result = std::min(a, b);
+          break;
+        case PixIROpcode::LT:
+          result = a < b;
+          break;
+        case PixIROpcode::LE:
+          result = a <= b;
+          break;
+        case PixIROpcode::EQ:
+          result = a == b;
+          break;
+        case PixIROpcode::NEQ:
+          result = a != b;
+          break;
+        case PixIROpcode::GT:
+          result = a > b;
+          break;
+        case PixIROpcode::GE:
+          result = a >= b;
+          break;
+        default:
+          break;
+        }
+      }
+
+      if (!result || *result < 0 || *result > INT_MAX)
+      {
+        return std::nullopt;
+      }
+      return std::to_string(*result);
+    }
+
+    // for x + 0, 0 + x, x - 0, x * 1 and 1 * x, the index among the operands
+    // of x and of the constant.
+    std::optional<std::pair<size_t, size_t>>
+    identity(PixIROpcode opcode,
+             const std::vector<std::optional<long long>> &operands)
+    {
+      if (operands.size() != 2)
+      {
+        return std::nullopt;
+      }
+      switch (opcode)
+      {
+      case PixIROpcode::ADD:
+        if (operands[1] == 0)
+        {
+          return std::make_pair(0, 1);
+        }
+        if (operands[0] == 0)
+        {
+          return std::make_pair(1, 0);
+        }
+        break;
+      case PixIROpcode::SUB:
+        if (operands[1] == 0)
+        {
+          return std::make_pair(0, 1);
+        }
+        break;
+      case PixIROpcode::MUL:
+        if (operands[1] == 1)
+        {
+          return std::make_pair(0, 1);
+        }
+        if (operands[0] == 1)
+        {
+          return std::make_pair(1, 0);
+        }
+        break;
+      default:
+        break;
+      }
+      return std::nullopt;
+    }
+
+    // whether the value of an instruction only depends on its operands, so
+    // instructions with equal operands give equal values.
+    bool isNumbered(PixIROpcode opcode)
+    {
+      switch (opcode)
+      {
+      case PixIROpcode::AND:
+      case PixIROpcode::OR:
+      case PixIROpcode::NOT:
+      case PixIROpcode::ADD:
+      case PixIROpcode::SUB:
+      case PixIROpcode::MUL:
+      case PixIROpcode::DIV:
+      case PixIROpcode::INC:
+      case PixIROpcode::DEC:
+      case PixIROpcode::MAX:
+      case PixIROpcode::MIN:
+      case PixIROpcode::ROUND:
+      case PixIROpcode::LT:
+      case PixIROpcode::LE:
+      case PixIROpcode::EQ:
+      case PixIROpcode::NEQ:
+      case PixIROpcode::GT:
+      case PixIROpcode::GE:
+      case PixIROpcode::WIDTH:
+      case PixIROpcode::HEIGHT:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+  } // namespace
+
+  bool SSABlock::isPure(const PixIRInstruction &instr)
+  {
+    switch (instr.opcode)
+    {
+    case PixIROpcode::PUSH:
+    case PixIROpcode::DUP:
+    case PixIROpcode::READ:
+    case PixIROpcode::LDA:
+      return true;
+    default:
+      return isNumbered(instr.opcode);
+    }
+  }
+
+  SSABlock::SSABlock(const BasicBlock &block, const SlotConstants &entry,
+                     const std::set<std::string> &pureFuncs)
+  {
+    // the constant of each value number, if any.
+    std::vector<std::optional<std::string>> numberConstants;
+    std::map<std::string, size_t> constantNumbers;
+    std::map<std::tuple<PixIROpcode, std::vector<size_t>>, size_t>
+        expressionNumbers;
+    // the number of the value held by each slot, keyed by index and depth.
+    // Only valid while the same frames are open.
+    std::map<std::pair<int, int>, size_t> slotNumbers;
+
+    auto newNumber = [&](std::optional<std::string> constant = std::nullopt)
+    {
+      numberConstants.push_back(std::move(constant));
+      return numberConstants.size() - 1;
+    };
+    auto constantNumber = [&](const std::string &constant)
+    {
+      auto it = constantNumbers.find(constant);
+      if (it == constantNumbers.end())
+      {
+        it = constantNumbers.insert({constant, newNumber(constant)}).first;
+      }
+      return it->second;
+    };
+    auto newValue = [&](size_t def, size_t number)
+    {
+      valueList.push_back({def, number, numberConstants[number]});
+      return valueList.size() - 1;
+    };
+
+    for (const auto &[slot, constant] : entry)
+    {
+      slotNumbers[slot] = constantNumber(constant);
+    }
+
+    // moves the slots known to a frame deeper, or shallower, dropping the
+    // slots of the closed frame.
+    auto shiftSlots = [&](int by)
+    {
+      std::map<std::pair<int, int>, size_t> shifted;
+      for (const auto &[slot, number] : slotNumbers)
+      {
+        if (slot.second + by >= 0)
+        {
+          shifted[{slot.first, slot.second + by}] = number;
+        }
+      }
+      slotNumbers = std::move(shifted);
+    };
+
+    std::vector<size_t> stack;
+    auto pop = [&]()
+    {
+      if (stack.empty())
+      {
+        inputList.push_back(newValue(NONE, newNumber()));
+        return inputList.back();
+      }
+      size_t v = stack.back();
+      stack.pop_back();
+      return v;
+    };
+
+    for (const PixIRInstruction &instr : block.instrs)
+    {
+      size_t n = nodeList.size();
+      Node node{instr, {}, {}, isPure(instr)};
+      auto [pops, pushes] = stackEffect(instr.opcode);
+      for (size_t i = 0; i < pops; i++)
+      {
+        node.operands.push_back(pop());
+      }
+      if (instr.opcode == PixIROpcode::CALL)
+      {
+        std::optional<long long> args =
+            intConstant(valueList[node.operands[1]].constant);
+        if (!args)
+        {
+          liftable = false;
+          return;
+        }
+        for (long long i = 0; i < *args; i++)
+        {
+          node.operands.push_back(pop());
+        }
+        const std::optional<std::string> &label =
+            valueList[node.operands[0]].constant;
+        node.pure = label && pureFuncs.count(*label);
+      }
+      bool pureCall = node.pure && instr.opcode == PixIROpcode::CALL;
+
+      std::vector<size_t> operandNumbers;
+      std::vector<std::optional<long long>> operandConstants;
+      for (size_t operand : node.operands)
+      {
+        operandNumbers.push_back(valueList[operand].number);
+        operandConstants.push_back(intConstant(valueList[operand].constant));
+      }
+
+      if (pushes == 1)
+      {
+        size_t number;
+        if (auto slot = slotOperand(instr))
+        {
+          auto it = slotNumbers.find(*slot);
+          number = it != slotNumbers.end() ? it->second : newNumber();
+          slotNumbers[*slot] = number;
+        }
+        else if (instr.opcode == PixIROpcode::PUSH &&
+                 std::holds_alternative<std::string>(instr.data))
+        {
+          number = constantNumber(std::get<std::string>(instr.data));
+        }
+        else if (!isNumbered(instr.opcode) && !pureCall)
+        {
+          number = newNumber();
+        }
+        else if (auto constant = fold(instr.opcode, operandConstants))
+        {
+          number = constantNumber(*constant);
+        }
+        else if (auto kept = identity(instr.opcode, operandConstants))
+        {
+          number = operandNumbers[kept->first];
+        }
+        else
+        {
+          auto key = std::make_tuple(instr.opcode, operandNumbers);
+          auto it = expressionNumbers.find(key);
+          if (it == expressionNumbers.end())
+          {
+            it = expressionNumbers.insert({key, newNumber()}).first;
+          }
+          number = it->second;
+        }
+        if (pureCall)
+        {
+          for (const auto &[slot, held] : slotNumbers)
+          {
+            if (held == number)
+            {
+              node.heldBy = slot;
+              break;
+            }
+          }
+        }
+        node.results.push_back(newValue(n, number));
+      }
+      else if (instr.opcode == PixIROpcode::DUP)
+      {
+        size_t number = operandNumbers[0];
+        node.results.push_back(newValue(n, number));
+        node.results.push_back(newValue(n, number));
+      }
+
+      switch (instr.opcode)
+      {
+      case PixIROpcode::ST:
+      {
+        // pops the depth, then the index, then the value.
+        std::optional<long long> depth = operandConstants[0];
+        std::optional<long long> index = operandConstants[1];
+        if (depth && index)
+        {
+          slotNumbers[{(int)*index, (int)*depth}] = operandNumbers[2];
+        }
+        else
+        {
+          slotNumbers.clear();
+        }
+        break;
+      }
+      case PixIROpcode::OFRAME:
+        shiftSlots(1);
+        break;
+      case PixIROpcode::CFRAME:
+        shiftSlots(-1);
+        break;
+      // a callee may store to any slot, unless it is pure.
+      case PixIROpcode::CALL:
+        if (!pureCall)
+        {
+          slotNumbers.clear();
+        }
+        break;
+      case PixIROpcode::RET:
+      case PixIROpcode::HALT:
+        slotNumbers.clear();
+        break;
+      default:
+        break;
+      }
+
+      for (size_t result : node.results)
+      {
+        stack.push_back(result);
+      }
+      nodeList.push_back(std::move(node));
+    }
+
+    outputList = std::move(stack);
+    for (const auto &[slot, number] : slotNumbers)
+    {
+      if (numberConstants[number])
+      {
+        exitConstants[slot] = *numberConstants[number];
+      }
+    }
+  }
+
+  std::list<PixIRInstruction> SSABlock::schedule() const
+  {
+    // a value on the stack, and where the code computing it starts, or NONE
+    // for inputs. The code from start to the end of code computes the value
+    // and everything above it on the stack.
+    struct Entry
+    {
+      size_t value;
+      size_t start;
+    };
+
+    std::vector<PixIRInstruction> code;
+    // the number of impure instructions among the first i of code.
+    std::vector<size_t> impure{0};
+    std::vector<Entry> stack;
+    for (auto input = inputList.rbegin(); input != inputList.rend(); ++input)
+    {
+      stack.push_back({*input, NONE});
+    }
+
+    auto emit = [&](PixIRInstruction instr, bool pure = true)
+    {
+      impure.push_back(impure.back() + !pure);
+      code.push_back(std::move(instr));
+    };
+    auto truncate = [&](size_t size)
+    {
+      code.resize(size);
+      impure.resize(size + 1);
+    };
+    auto isPureFrom = [&](size_t start)
+    {
+      return start != NONE && impure.back() == impure[start];
+    };
+
+    for (const Node &node : nodeList)
+    {
+      // the operands, the top of the stack first.
+      std::vector<Entry> popped;
+      for (size_t i = 0; i < node.operands.size(); i++)
+      {
+        popped.push_back(stack.back());
+        stack.pop_back();
+      }
+      // the code computing the operands, i.e. everything since the start of
+      // the deepest one.
+      size_t start = popped.empty() ? code.size() : popped.back().start;
+      bool pure = node.pure && isPureFrom(start);
+
+      if (node.results.size() == 1)
+      {
+        size_t result = node.results[0];
+        const std::optional<std::string> &constant = valueList[result].constant;
+
+        if (pure && constant &&
+            !(node.instr.opcode == PixIROpcode::PUSH &&
+              node.instr.data == decltype(node.instr.data)(*constant)))
+        {
+          truncate(start);
+          emit({PixIROpcode::PUSH, *constant});
+          stack.push_back({result, start});
+          continue;
+        }
+
+        std::vector<std::optional<long long>> operandConstants;
+        for (size_t operand : node.operands)
+        {
+          operandConstants.push_back(intConstant(valueList[operand].constant));
+        }
+        if (auto kept = identity(node.instr.opcode, operandConstants))
+        {
+          // the constant has to be a lone PUSH to be dropped.
+          auto [x, c] = *kept;
+          size_t cStart = popped[c].start;
+          size_t cEnd = c == 0 ? code.size() : popped[c - 1].start;
+          if (cStart != NONE && cEnd == cStart + 1 &&
+              code[cStart].opcode == PixIROpcode::PUSH)
+          {
+            code.erase(code.begin() + cStart);
+            impure.erase(impure.begin() + cStart + 1);
+            size_t xStart = popped[x].start;
+            if (xStart != NONE && xStart > cStart)
+            {
+              xStart--;
+            }
+            stack.push_back({result, xStart});
+            continue;
+          }
+        }
+
+        // a value computed again right after itself is copied.
+        if (pure && !popped.empty() && !stack.empty() &&
+            valueList[stack.back().value].number == valueList[result].number)
+        {
+          truncate(start);
+          emit({PixIROpcode::DUP});
+          stack.push_back({result, start});
+          continue;
+        }
+
+        // a pure call made again after its value was stored is loaded.
+        if (pure && node.heldBy)
+        {
+          auto [index, depth] = *node.heldBy;
+          truncate(start);
+          emit({PixIROpcode::PUSH,
+                "[" + std::to_string(index) +
+                    (depth == 0 ? "" : ":" + std::to_string(depth)) + "]"});
+          stack.push_back({result, start});
+          continue;
+        }
+      }
+
+      emit(node.instr, node.pure);
+      for (size_t i = 0; i < node.results.size(); i++)
+      {
+        // the copy pushed by DUP is computed by the DUP alone.
+        stack.push_back({node.results[i], i == 0 ? start : code.size() - 1});
+      }
+    }
+
+    return std::list<PixIRInstruction>(code.begin(), code.end());
+  }
+
+  void ssaOptimize(PixIRFunction &func)
+  {
+    for (std::unique_ptr<BasicBlock> &block : func.blocks)
+    {
+      SSABlock ssa{*block};
+      if (ssa.valid())
+      {
+        block->instrs = ssa.schedule();
+      }
+    }
+  }
+
+} // namespace codegen
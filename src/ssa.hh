@@ -0,0 +1,148 @@
+#ifndef SSA_H_
+#define SSA_H_
+
+#include "codegen.hh"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace codegen
+{
+
+  // constants known to be held by frame slots, keyed by their index and
+  // depth, as in PUSH [index:depth].
+  using SlotConstants = std::map<std::pair<int, int>, std::string>;
+
+  // A basic block lifted to SSA form. Each instruction becomes a node, and
+  // each value it pushes becomes a value defined only by that node. Nodes
+  // refer to the values they pop rather than to stack positions, so the
+  // dataflow of the block is explicit. Values popped which were already on
+  // the stack when the block was entered are inputs, defined by no node.
+  //
+  // Frame slots aren't promoted to values: loads and stores stay nodes, but a
+  // load of a slot stored earlier in the block gets the number of the value
+  // stored, and loads of the same slot with no store in between share a
+  // number. Slots are followed through OFRAME and CFRAME, but calls may store
+  // to any of them, unless the function called is known to be pure. Calls to
+  // pure functions are numbered like other expressions instead, by their
+  // label and arguments.
+  class SSABlock
+  {
+  public:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    struct Node
+    {
+      PixIRInstruction instr;
+      // the values popped, the top of the stack first.
+      std::vector<size_t> operands;
+      // the values pushed, the bottom of the stack first.
+      std::vector<size_t> results;
+      // whether the node has no effect besides popping and pushing, see
+      // isPure. Calls are if the function called is pure.
+      bool pure = false;
+      // a slot holding the value a pure call pushes before it is made, if
+      // any, keyed by index and depth.
+      std::optional<std::pair<int, int>> heldBy;
+    };
+
+    struct Value
+    {
+      // the node defining the value, or NONE for inputs.
+      size_t def;
+      // values with the same number are equal, as in value numbering.
+      size_t number;
+      // the operand of a PUSH giving the value, if it is known.
+      std::optional<std::string> constant;
+    };
+
+  private:
+    std::vector<Node> nodeList;
+    std::vector<Value> valueList;
+    // the inputs, the top of the stack at the start of the block first.
+    std::vector<size_t> inputList;
+    // values left on the stack at the end of the block, bottom first.
+    std::vector<size_t> outputList;
+    SlotConstants exitConstants;
+    bool liftable = true;
+
+  public:
+    // entry gives the constants held by slots when the block is entered, and
+    // pureFuncs the labels of the functions which are pure, see
+    // CallGraph::findPure.
+    explicit SSABlock(const BasicBlock &block, const SlotConstants &entry = {},
+                      const std::set<std::string> &pureFuncs = {});
+
+    // false if the stack effect of an instruction isn't known, e.g. a CALL
+    // whose argument count isn't a constant. Nothing else is valid then.
+    bool valid() const { return liftable; }
+
+    const std::vector<Node> &nodes() const { return nodeList; }
+    const Value &value(size_t v) const { return valueList[v]; }
+    const std::vector<size_t> &inputs() const { return inputList; }
+    const std::vector<size_t> &outputs() const { return outputList; }
+    // the constants held by slots at the end of the block.
+    const SlotConstants &exitSlots() const { return exitConstants; }
+
+    // whether an instruction has no effect besides popping and pushing, so
+    // its code can be dropped if the value it computes is known otherwise.
+    static bool isPure(const PixIRInstruction &instr);
+
+    // emits the block as stack code again. Values with a known constant are
+    // pushed instead of computed, x + 0, x - 0 and x * 1 become x, and a
+    // value equal to the one below it on the stack is copied with DUP instead
+    // of computed again, and a pure call whose value a slot holds loads it.
+    // Code is only dropped if it is pure.
+    std::list<PixIRInstruction> schedule() const;
+  };
+
+  // lifts each block of a function that hasn't been linearized yet to SSA
+  // form, and replaces it by the code scheduled from it.
+  void ssaOptimize(PixIRFunction &func);
+
+  // sparse conditional constant propagation over a function that hasn't been
+  // linearized yet. Finds the constants held by slots at the entry of each
+  // block, merging them where paths join, and only follows the branches which
+  // can be taken given those constants. Blocks are then scheduled as in
+  // ssaOptimize with the constants known at their entry, branches on
+  // constant conditions become jumps, and the blocks which can no longer be
+  // reached are removed. entrySlots gives the constants held by slots when
+  // the function is entered, e.g. its arguments.
+  void propagateConstants(PixIRFunction &func,
+                          const SlotConstants &entrySlots = {});
+
+  // Specializes functions on the constant arguments they are called with.
+  // For each call with some constant arguments, the function called is
+  // cloned, the constants are propagated through the clone from its
+  // arguments, and the call is redirected to the clone if it is smaller
+  // than the function would be without them. Calls with the same constants
+  // share a clone, and the original stays for other calls. Calls in loops
+  // are specialized first, and the clones may add at most a quarter of the
+  // code's size, so code doesn't grow without bound, e.g. for recursive
+  // calls with constant arguments.
+  void specializeFunctions(PixIRCode &code);
+
+  // Common subexpression elimination of calls to pure functions, see
+  // CallGraph::findPure. Each block is scheduled again as in ssaOptimize,
+  // with the calls to pure functions numbered by their arguments, so a call
+  // made again with the same arguments reuses the value of the first one.
+  void eliminateCommonCalls(PixIRCode &code);
+
+  // Memoizes the calls to pure functions of one argument made in loops,
+  // when the function called is expensive, i.e. it has loops or makes calls
+  // itself. Only the calls of main are memoized, as a table is cleared each
+  // time the function holding it runs. Main gets a table in its frame for
+  // each function, and each call with an integer argument from 0 to 255
+  // looks its value up there before making it, and stores it afterwards.
+  // Other arguments are called as before. Runs on code that hasn't been
+  // linearized yet.
+  void memoizePureCalls(PixIRCode &code);
+
+} // namespace codegen
+
+#endif // SSA_H_
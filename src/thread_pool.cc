@@ -0,0 +1,104 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(size_t nThreads)
+{
+  if (nThreads == 0)
+  {
+    nThreads = hardwareThreads();
+  }
+
+  workers.reserve(nThreads);
+  for (size_t i = 0; i < nThreads; i++)
+  {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+
+  for (std::thread &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::workerLoop()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskAvailable.wait(lock, [this]
+                         { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+      {
+        // stopping, and nothing is left to do.
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--unfinished == 0)
+      {
+        allDone.notify_all();
+      }
+    }
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+    unfinished++;
+  }
+  taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  allDone.wait(lock, [this]
+               { return unfinished == 0; });
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &body)
+{
+  // each worker claims the next unclaimed index until none are left, so
+  // uneven iterations balance out without queueing a task per index.
+  std::atomic<size_t> next = 0;
+  size_t nTasks = std::min(n, workers.size());
+  for (size_t t = 0; t < nTasks; t++)
+  {
+    submit([&body, &next, n]
+           {
+             for (size_t i = next++; i < n; i = next++)
+             {
+               body(i);
+             }
+           });
+  }
+  wait();
+}
+
+size_t ThreadPool::hardwareThreads()
+{
+  size_t n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed-size pool of worker threads consuming tasks from a shared queue.
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+
+  std::mutex mutex;
+  std::condition_variable taskAvailable;
+  std::condition_variable allDone;
+
+  // number of tasks submitted but not yet finished.
+  size_t unfinished = 0;
+  bool stopping = false;
+
+  void workerLoop();
+
+public:
+  // nThreads == 0 uses one thread per hardware thread.
+  explicit ThreadPool(size_t nThreads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  void submit(std::function<void()> task);
+
+  // blocks until every submitted task has finished.
+  void wait();
+
+  // runs body(i) for every i in [0, n) across the pool and waits for all of
+  // them. Exceptions must be handled inside body.
+  void parallelFor(size_t n, const std::function<void(size_t)> &body);
+
+  static size_t hardwareThreads();
+};
+
+#endif // THREAD_POOL_H_
@@ -1,13 +1,55 @@
 #include "visitor.hh"
 #include "ast.hh"
 
+#include <iterator>
+
 namespace ast
 {
+  void AbstractVisitor::traverse(ASTNode *root)
+  {
+    // traversals may nest, e.g. when a visitor runs another visitor over a
+    // subtree, so only the tasks above base belong to this one.
+    size_t base = tasks.size();
+    std::vector<Task> outer;
+    std::swap(outer, scheduled);
+
+    try
+    {
+      tasks.push_back({root, {}});
+      while (tasks.size() > base)
+      {
+        Task task = std::move(tasks.back());
+        tasks.pop_back();
+
+        if (task.node != nullptr)
+        {
+          dispatch(*task.node);
+        }
+        else
+        {
+          task.action();
+        }
+
+        tasks.insert(tasks.end(), std::make_move_iterator(scheduled.rbegin()),
+                     std::make_move_iterator(scheduled.rend()));
+        scheduled.clear();
+      }
+    }
+    catch (...)
+    {
+      tasks.resize(base);
+      scheduled = std::move(outer);
+      throw;
+    }
+
+    scheduled = std::move(outer);
+  }
+
   void AbstractVisitor::visitChildren(ASTNode *node)
   {
     for (ASTNode *child : node->children())
     {
-      child->accept(this);
+      schedule(child);
     }
   }
 
@@ -16,7 +58,7 @@ namespace ast
     std::vector<ASTNode *> children = node->children();
     for (auto it = children.rbegin(); it != children.rend(); ++it)
     {
-      (*it)->accept(this);
+      schedule(*it);
     }
   }
 
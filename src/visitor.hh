@@ -1,6 +1,9 @@
 #ifndef VISITOR_H_
 #define VISITOR_H_
 
+#include <functional>
+#include <vector>
+
 namespace ast
 {
 
@@ -46,9 +49,35 @@ namespace ast
 
   class TranslationUnit;
 
+  // calls v.visit() with node cast to its concrete class. Defined in ast.hh.
+  template <typename V>
+  void visitNode(V &v, ASTNode &node);
+
+  // Visitors never recurse on the native stack. visit() does the work for a
+  // node and schedules the rest (its children, and actions to run once they
+  // have been visited), which traverse() then runs from an explicit stack. This
+  // keeps arbitrarily deep ASTs from overflowing the stack.
+  //
+  // Everything scheduled by one visit() or action runs in the order it was
+  // scheduled, before anything scheduled earlier.
+  //
+  // Visitors derive from Visitor<T> rather than from AbstractVisitor directly.
   class AbstractVisitor
   {
+  private:
+    struct Task
+    {
+      ASTNode *node;
+      std::function<void()> action;
+    };
+
+    std::vector<Task> tasks;
+    // scheduled by the running visit() or action, not yet on the stack.
+    std::vector<Task> scheduled;
+
   public:
+    virtual ~AbstractVisitor() {}
+
     virtual void visit(IntTypeNode &node) = 0;
     virtual void visit(FloatTypeNode &node) = 0;
     virtual void visit(ColourTypeNode &node) = 0;
@@ -91,10 +120,36 @@ namespace ast
 
     virtual void visit(TranslationUnit &node) = 0;
 
+    // calls the visit() overload for node's class.
+    virtual void dispatch(ASTNode &node) = 0;
+
+    // visits root and everything scheduled along the way.
+    void traverse(ASTNode *root);
+
+    void schedule(ASTNode *node) { scheduled.push_back({node, {}}); }
+    void schedule(std::function<void()> action)
+    {
+      scheduled.push_back({nullptr, std::move(action)});
+    }
+
+    // schedule the children of node, in order or in reverse.
     void visitChildren(ASTNode *node);
     void rvisitChildren(ASTNode *node);
   };
 
+  // Dispatches on ASTNode::kind with a switch. As long as Derived is final, its
+  // visit() overloads are called directly rather than through the vtable, so
+  // visiting a node takes one virtual call instead of two.
+  template <typename Derived>
+  class Visitor : public AbstractVisitor
+  {
+  public:
+    void dispatch(ASTNode &node) final
+    {
+      visitNode(static_cast<Derived &>(*this), node);
+    }
+  };
+
 } // namespace ast
 
 #endif // VISITOR_H_
@@ -0,0 +1,97 @@
+#include "writer.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+BufferedWriter::BufferedWriter(int fd) : sink(fd) { buf.reserve(BUFFER_SIZE); }
+
+BufferedWriter::BufferedWriter(std::string &out) : sink(&out)
+{
+  buf.reserve(BUFFER_SIZE);
+}
+
+BufferedWriter::BufferedWriter(std::ostream &out) : sink(&out)
+{
+  buf.reserve(BUFFER_SIZE);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+  try
+  {
+    flush();
+  }
+  catch (std::runtime_error &)
+  {
+    // destructors can't report errors; call flush() explicitly to see them.
+  }
+}
+
+BufferedWriter &BufferedWriter::operator<<(int x)
+{
+  char digits[16];
+  std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), x);
+  return *this << std::string_view(digits, res.ptr - digits);
+}
+
+BufferedWriter &BufferedWriter::indent(int n)
+{
+  while (n > 0)
+  {
+    size_t room = BUFFER_SIZE - buf.size();
+    if (room == 0)
+    {
+      flush();
+      continue;
+    }
+    size_t chunk = std::min<size_t>(n, room);
+    buf.append(chunk, ' ');
+    n -= chunk;
+  }
+  return *this;
+}
+
+void BufferedWriter::flush()
+{
+  if (!buf.empty())
+  {
+    drain(buf.data(), buf.size());
+    buf.clear();
+  }
+}
+
+void BufferedWriter::drain(const char *data, size_t size)
+{
+  if (std::string **str = std::get_if<std::string *>(&sink))
+  {
+    (*str)->append(data, size);
+  }
+  else if (std::ostream **out = std::get_if<std::ostream *>(&sink))
+  {
+    (*out)->write(data, size);
+  }
+  else
+  {
+    int fd = std::get<int>(sink);
+    while (size > 0)
+    {
+      ssize_t n = ::write(fd, data, size);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n < 0)
+      {
+        throw std::runtime_error(std::string("Write failed: ") +
+                                 std::strerror(errno));
+      }
+      data += n;
+      size -= n;
+    }
+  }
+}
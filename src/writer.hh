@@ -0,0 +1,72 @@
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <variant>
+
+// Output buffer shared by the code and XML emitters. Text is collected in a
+// large user-space buffer and handed to the sink one chunk at a time: a
+// single write(2) per chunk for file descriptors, a single append/write for
+// strings and streams. Nothing is flushed until the buffer fills, flush() is
+// called or the writer is destroyed.
+class BufferedWriter
+{
+private:
+  std::variant<int, std::string *, std::ostream *> sink;
+  std::string buf;
+
+  void drain(const char *data, size_t size);
+
+public:
+  static const size_t BUFFER_SIZE = 64 * 1024;
+
+  // writes to a file descriptor owned by the caller.
+  explicit BufferedWriter(int fd);
+  // appends to out.
+  explicit BufferedWriter(std::string &out);
+  explicit BufferedWriter(std::ostream &out);
+
+  BufferedWriter(const BufferedWriter &) = delete;
+  BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+  ~BufferedWriter();
+
+  BufferedWriter &operator<<(std::string_view s)
+  {
+    if (buf.size() + s.size() > BUFFER_SIZE)
+    {
+      flush();
+      if (s.size() > BUFFER_SIZE)
+      {
+        drain(s.data(), s.size());
+        return *this;
+      }
+    }
+    buf.append(s);
+    return *this;
+  }
+
+  BufferedWriter &operator<<(char c)
+  {
+    if (buf.size() == BUFFER_SIZE)
+    {
+      flush();
+    }
+    buf.push_back(c);
+    return *this;
+  }
+
+  BufferedWriter &operator<<(int x);
+
+  // writes n spaces.
+  BufferedWriter &indent(int n);
+
+  // hands everything buffered so far to the sink. Throws std::runtime_error
+  // if writing to a file descriptor fails.
+  void flush();
+};
+
+#endif // WRITER_H_
@@ -1,24 +1,31 @@
 #include "xml_visitor.hh"
 #include "ast.hh"
+#include "util.hh"
 
 namespace ast
 {
 
-#define XML_ELEM_WITH_CHILDREN(NODE, TAGNAME, ATTRS)                       \
-  ss << std::string(indent, ' ') << "<" << (TAGNAME) << ATTRS << " loc=\"" \
-     << (NODE).loc.to_string()                                             \
-     << "\""                                                               \
-        ">"                                                                \
-     << std::endl;                                                         \
-  indent++;                                                                \
-  visitChildren((ASTNode *)(&(NODE)));                                     \
-  indent--;                                                                \
-  ss << std::string(indent, ' ') << "</" << (TAGNAME) << ">" << std::endl
-
-#define XML_ELEM_WITH_CONTENT(NODE, TAGNAME, ATTRS, CONTENT)               \
-  ss << std::string(indent, ' ') << "<" << (TAGNAME) << ATTRS << " loc=\"" \
-     << (NODE).loc.to_string() << "\""                                     \
-     << ">" << (CONTENT) << "</" << (TAGNAME) << ">" << std::endl
+#define XML_ELEM_WITH_CHILDREN(NODE, TAGNAME, ATTRS)                         \
+  if (expandChildren())                                                      \
+  {                                                                          \
+    w.indent(indent) << "<" << (TAGNAME) << ATTRS << " loc=\""               \
+                     << (NODE).loc.to_string() << "\""                       \
+                     << ">" << '\n';                                         \
+    indent++;                                                                \
+    visitChildren((ASTNode *)(&(NODE)));                                     \
+    closeElement(TAGNAME);                                                   \
+  }                                                                          \
+  else                                                                       \
+  {                                                                          \
+    w.indent(indent) << "<" << (TAGNAME) << ATTRS << " loc=\""               \
+                     << (NODE).loc.to_string() << "\""                       \
+                     << " truncated=\"true\"></" << (TAGNAME) << ">" << '\n'; \
+  }
+
+#define XML_ELEM_WITH_CONTENT(NODE, TAGNAME, ATTRS, CONTENT)                 \
+  w.indent(indent) << "<" << (TAGNAME) << ATTRS << " loc=\""                 \
+                   << (NODE).loc.to_string() << "\""                         \
+                   << ">" << (CONTENT) << "</" << (TAGNAME) << ">" << '\n'
 
   void XMLVisitor::visit(IntTypeNode &node)
   {
@@ -239,35 +246,49 @@ namespace ast
 
   void XMLVisitor::visit(FuncDeclStmt &node)
   {
-    ss << std::string(indent, ' ') << "<FuncDeclStmt "
-       << "loc=\"" << node.loc.to_string() << "\">" << std::endl;
+    if (!expandChildren())
+    {
+      w.indent(indent) << "<FuncDeclStmt "
+                       << "loc=\"" << node.loc.to_string()
+                       << "\" truncated=\"true\"></FuncDeclStmt>" << '\n';
+      return;
+    }
+
+    w.indent(indent) << "<FuncDeclStmt "
+                     << "loc=\"" << node.loc.to_string() << "\">" << '\n';
 
     indent++;
 
     for (const FormalParam &param : node.params)
     {
-      ss << std::string(indent, ' ') << "<FormalParam name=\"" << param.first
-         << "\">" << std::endl;
-
-      indent++;
-      param.second->accept(this);
-      indent--;
-
-      ss << "</FormalParam>" << std::endl;
+      schedule([this, &param]
+               {
+                 w.indent(indent) << "<FormalParam name=\"" << param.first
+                                  << "\">" << '\n';
+                 indent++;
+               });
+      schedule(param.second.get());
+      schedule([this]
+               {
+                 indent--;
+                 w << "</FormalParam>" << '\n';
+               });
     }
 
-    ss << std::string(indent, ' ') << "<Returns>" << std::endl;
-
-    indent++;
-    node.retType->accept(this);
-    indent--;
-
-    ss << "</Returns>" << std::endl;
+    schedule([this]
+             {
+               w.indent(indent) << "<Returns>" << '\n';
+               indent++;
+             });
+    schedule(node.retType.get());
+    schedule([this]
+             {
+               indent--;
+               w << "</Returns>" << '\n';
+             });
 
     visitChildren(&node);
-    indent--;
-
-    ss << std::string(indent, ' ') << "</FuncDeclStmt>" << std::endl;
+    closeElement("FuncDeclStmt");
   }
 
   void XMLVisitor::visit(BlockStmt &node)
@@ -277,7 +298,34 @@ namespace ast
 
   void XMLVisitor::visit(TranslationUnit &node)
   {
-    XML_ELEM_WITH_CHILDREN(node, "TranslationUnit", "");
+    if (!opts.function)
+    {
+      XML_ELEM_WITH_CHILDREN(node, "TranslationUnit", "");
+      return;
+    }
+
+    FuncDeclStmt *selected = nullptr;
+    for (StmtNodePtr &stmt : node.stmts)
+    {
+      FuncDeclStmt *func = stmt->as<FuncDeclStmt>();
+      if (func && func->funcName == opts.function.value())
+      {
+        selected = func;
+        break;
+      }
+    }
+    if (!selected)
+    {
+      throw CompilationError("Can't export XML for function " +
+                             opts.function.value() + ", which is not defined.");
+    }
+
+    // keep the TranslationUnit root, so consumers see the same document shape.
+    w.indent(indent) << "<TranslationUnit loc=\"" << node.loc.to_string()
+                     << "\">" << '\n';
+    indent++;
+    schedule(selected);
+    closeElement("TranslationUnit");
   }
 
 } // namespace ast
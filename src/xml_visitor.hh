@@ -2,20 +2,60 @@
 #define XML_H_
 
 #include "visitor.hh"
+#include "writer.hh"
 
-#include <sstream>
+#include <optional>
 #include <string>
 
 namespace ast
 {
 
-  class XMLVisitor : public AbstractVisitor
+  struct XMLOptions
+  {
+    // nodes nested deeper than this below the root are left out. Elements
+    // whose children were left out are marked with truncated="true".
+    std::optional<int> maxDepth = std::nullopt;
+    // only export the top-level function with this name.
+    std::optional<std::string> function = std::nullopt;
+  };
+
+  class XMLVisitor final : public Visitor<XMLVisitor>
   {
   private:
-    std::stringstream ss;
+    XMLOptions opts;
+
+    // only used when collecting the document into a string.
+    std::string doc;
+    std::optional<BufferedWriter> docWriter;
+
+    BufferedWriter &w;
     int indent = 0;
 
+    // whether the children of an element at the current depth are exported.
+    bool expandChildren() const
+    {
+      return !opts.maxDepth || indent < opts.maxDepth.value();
+    }
+
+    // schedules the closing tag of the current element, after its children.
+    void closeElement(const char *tagName)
+    {
+      schedule([this, tagName]
+               {
+                 indent--;
+                 w.indent(indent) << "</" << tagName << ">" << '\n';
+               });
+    }
+
   public:
+    // collects the document, which is then retrieved with xml().
+    XMLVisitor(XMLOptions opts = {})
+        : opts(std::move(opts)), w(docWriter.emplace(doc)) {}
+
+    // streams the document to w as the AST is traversed.
+    XMLVisitor(BufferedWriter &w, XMLOptions opts = {})
+        : opts(std::move(opts)), w(w) {}
+
     void visit(IntTypeNode &node) override;
     void visit(FloatTypeNode &node) override;
     void visit(ColourTypeNode &node) override;
@@ -55,7 +95,11 @@ namespace ast
 
     void visit(TranslationUnit &node) override;
 
-    std::string xml() { return ss.str(); };
+    std::string xml()
+    {
+      w.flush();
+      return doc;
+    };
   };
 
 } // namespace ast
@@ -0,0 +1,94 @@
+#include "ast_binary.hh"
+#include "compiler.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "xml_visitor.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static const std::string SRC = R"(
+fun f(a: int, b: []float) -> float {
+  let c: colour = #ff00aa;
+  if ((a > 2) and not true) {
+    return b[a] * -1.5;
+  } else {
+    __pixelr 0, 0, __width, __height, c;
+  }
+  return 0.0;
+}
+
+let xs: []int = __newarr int, 4;
+for (let i: int = 0; i < 4; i = i + 1) {
+  xs[i] = __randi 10;
+}
+while (false) {
+  __print __read 1, 2;
+  __print f(1, __newarr float, 2);
+}
+)";
+
+static std::string toXml(ast::TranslationUnit &tu)
+{
+  ast::XMLVisitor xmlVisitor;
+  tu.accept(&xmlVisitor);
+  return xmlVisitor.xml();
+}
+
+static std::string toBinary(ast::TranslationUnit &tu)
+{
+  std::string binary;
+  BufferedWriter w{binary};
+  ast::writeBinaryAST(tu, w);
+  w.flush();
+  return binary;
+}
+
+static std::unique_ptr<ast::TranslationUnit> parse(const std::string &src)
+{
+  std::stringstream ss{src};
+  lexer::Lexer lexer{ss};
+  parser::Parser parser{lexer};
+  return parser.parse();
+}
+
+TEST_CASE("Binary ASTs round-trip.", "[ast_binary]") {
+  std::unique_ptr<ast::TranslationUnit> tu = parse(SRC);
+  std::string binary = toBinary(*tu);
+
+  REQUIRE(ast::isBinaryAST(binary));
+  REQUIRE(binary.size() < toXml(*tu).size() / 10);
+
+  std::unique_ptr<ast::TranslationUnit> reloaded = ast::readBinaryAST(binary);
+  REQUIRE(toXml(*reloaded) == toXml(*tu));
+  REQUIRE(toBinary(*reloaded) == binary);
+}
+
+TEST_CASE("Binary ASTs compile like their source.", "[ast_binary]") {
+  CompilerOptions opts;
+  opts.generateBinaryAst = true;
+  pixelc::CompilationResult fromSource = pixelc::compile(SRC, opts);
+  REQUIRE(fromSource.success);
+
+  pixelc::CompilationResult fromBinary =
+      pixelc::compile(fromSource.binaryAst, CompilerOptions());
+  REQUIRE(fromBinary.success);
+  REQUIRE(fromBinary.asmOutput == fromSource.asmOutput);
+}
+
+TEST_CASE("Malformed binary ASTs are rejected.", "[ast_binary]") {
+  std::unique_ptr<ast::TranslationUnit> tu = parse(SRC);
+  std::string binary = toBinary(*tu);
+
+  REQUIRE_FALSE(ast::isBinaryAST(SRC));
+  REQUIRE_THROWS_AS(ast::readBinaryAST(SRC), CompilationError);
+  for (size_t len : {size_t(7), binary.size() / 2, binary.size() - 1})
+  {
+    REQUIRE_THROWS_AS(ast::readBinaryAST(binary.substr(0, len)),
+                      CompilationError);
+  }
+  REQUIRE_THROWS_AS(ast::readBinaryAST(binary + "x"), CompilationError);
+}
@@ -0,0 +1,75 @@
+#include "batch.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::filesystem::path freshBatchDir(const std::string &name)
+{
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / ("pixelc-batch-test-" + name);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+static std::string writeSource(const std::filesystem::path &path,
+                               const std::string &src)
+{
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream{path} << src;
+  return path.string();
+}
+
+TEST_CASE("Sources are compiled to an output directory.", "[batch]") {
+  std::filesystem::path dir = freshBatchDir("compile");
+  std::vector<std::string> sources{
+      writeSource(dir / "a.pix", "__print 1;"),
+      writeSource(dir / "b.pix", "__print 2;"),
+      writeSource(dir / "bad.pix", "__print x;")};
+
+  BatchOptions opts;
+  opts.outDir = (dir / "out").string();
+  opts.jobs = 2;
+  std::ostringstream diagnostics;
+  REQUIRE(compileBatch(sources, opts, diagnostics) == 1);
+  REQUIRE(std::filesystem::exists(dir / "out" / "a.pixardis"));
+  REQUIRE(std::filesystem::exists(dir / "out" / "b.pixardis"));
+  REQUIRE(diagnostics.str().rfind(sources[2] + ": ", 0) == 0);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Sources writing the same output file fail.", "[batch]") {
+  std::filesystem::path dir = freshBatchDir("clash");
+  std::string first = writeSource(dir / "a" / "x.pix", "__print 1;");
+  std::string second = writeSource(dir / "b" / "x.pix", "__print 2;");
+  std::vector<std::string> sources{first, second, first};
+
+  BatchOptions opts;
+  opts.outDir = (dir / "out").string();
+  std::ostringstream diagnostics;
+  REQUIRE(compileBatch(sources, opts, diagnostics) == 2);
+
+  // the first source is compiled alone.
+  std::string output = (dir / "out" / "x.pixardis").string();
+  std::string expected = second + ": Output " + output +
+                         " is also written for " + first + ".\n" + first +
+                         ": Output " + output + " is also written for " +
+                         first + ".\n";
+  REQUIRE(diagnostics.str() == expected);
+  std::ifstream asmFile{output};
+  std::string text{std::istreambuf_iterator<char>(asmFile), {}};
+  REQUIRE(text.find("push 1") != std::string::npos);
+
+  // without an output directory, the outputs are next to the sources.
+  opts.outDir = std::nullopt;
+  REQUIRE(compileBatch({first, second}, opts, diagnostics) == 0);
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,84 @@
+#include "cache.hh"
+#include "compiler.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+static std::filesystem::path freshCacheDir(const std::string &name)
+{
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / ("pixelc-cache-test-" + name);
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+static std::string compile(CompilerOptions opts, const std::string &src)
+{
+  std::istringstream in{src};
+  std::ostringstream out, xmlOut;
+  Compiler compiler{opts, in, out, xmlOut};
+  compiler.compile();
+  return out.str();
+}
+
+TEST_CASE("Cache keys depend on source and options.", "[cache]") {
+  CompilerOptions opts, optimized;
+  optimized.peepholeOptimize = true;
+
+  std::string key = CompilationCache::makeKey("let x: int = 1;", opts);
+  REQUIRE(key == CompilationCache::makeKey("let x: int = 1;", opts));
+  REQUIRE(key != CompilationCache::makeKey("let x: int = 2;", opts));
+  REQUIRE(key != CompilationCache::makeKey("let x: int = 1;", optimized));
+}
+
+TEST_CASE("Cache returns stored entries.", "[cache]") {
+  std::filesystem::path dir = freshCacheDir("roundtrip");
+  CompilationCache cache{dir};
+
+  REQUIRE_FALSE(cache.lookup("0123"));
+  cache.store("0123", {"asm", "xml"});
+
+  std::optional<CacheEntry> entry = cache.lookup("0123");
+  REQUIRE(entry);
+  REQUIRE(entry->asmOutput == "asm");
+  REQUIRE(entry->xmlOutput == "xml");
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Cache evicts entries past its size limit.", "[cache]") {
+  std::filesystem::path dir = freshCacheDir("eviction");
+  CompilationCache cache{dir, 4096};
+
+  for (int i = 0; i < 16; i++)
+  {
+    cache.store("key" + std::to_string(i), {std::string(1024, 'x'), ""});
+  }
+
+  uintmax_t total = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(dir))
+  {
+    total += entry.file_size();
+  }
+  REQUIRE(total <= 4096);
+  REQUIRE(cache.lookup("key15"));
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Cached compilations match uncached ones.", "[cache]") {
+  std::filesystem::path dir = freshCacheDir("compile");
+  const std::string src = "let x: int = 1 + 2;\n__print x;";
+
+  CompilerOptions opts;
+  std::string expected = compile(opts, src);
+
+  opts.cacheDir = dir.string();
+  REQUIRE(compile(opts, src) == expected);
+  REQUIRE(compile(opts, src) == expected);
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,114 @@
+#include "call_graph.hh"
+#include "compiler.hh"
+#include "deadcode.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST_CASE("Calls are recorded in the call graph.", "[call_graph]") {
+  codegen::PixIRCode code = compiled(
+      "fun leaf(x: int) -> int { return x; }\n"
+      "fun twice(x: int) -> int { return leaf(leaf(x)); }\n"
+      "fun unused() -> int { let s: int = 0; __print s; return twice(1); }\n"
+      "__print twice(2);");
+  codegen::CallGraph graph{code};
+
+  size_t main = graph.idOf("." MAIN_FUNC_NAME);
+  size_t leaf = graph.idOf(".leaf");
+  size_t twice = graph.idOf(".twice");
+  size_t unused = graph.idOf(".unused");
+
+  REQUIRE(graph.size() == 4);
+  REQUIRE(graph.calleesOf(main) == std::vector<size_t>{twice});
+  REQUIRE(graph.calleesOf(twice) == std::vector<size_t>{leaf});
+  REQUIRE(graph.calleesOf(leaf).empty());
+  REQUIRE(graph.calleesOf(unused) == std::vector<size_t>{twice});
+
+  std::vector<bool> reachable = graph.reachableFrom(main);
+  REQUIRE(reachable[main]);
+  REQUIRE(reachable[leaf]);
+  REQUIRE(reachable[twice]);
+  REQUIRE_FALSE(reachable[unused]);
+}
+
+TEST_CASE("String operands aren't mistaken for calls.", "[call_graph]") {
+  // colour, float and frame operands are pushed as strings, but aren't calls.
+  codegen::PixIRCode code =
+      compiled("fun f() -> int { return 1; }\n"
+               "let x: int = 1;\n"
+               "__pixel 0, 0, #ff0000;\n__print 1.5;\n__print x;");
+  codegen::CallGraph graph{code};
+  REQUIRE(graph.calleesOf(graph.idOf("." MAIN_FUNC_NAME)).empty());
+
+  codegen::DeadFunctionEliminator(code).eliminate();
+  REQUIRE(code.size() == 1);
+}
+
+TEST_CASE("Recursive functions are found.", "[call_graph]") {
+  codegen::PixIRCode code = compiled(
+      "fun fact(n: int) -> int {\n"
+      "  if (n < 2) { return 1; }\n"
+      "  return n * fact(n - 1);\n"
+      "}\n"
+      "fun flat(n: int) -> int { return fact(n) + 1; }\n"
+      "__print flat(3);");
+  codegen::CallGraph graph{code};
+
+  std::vector<bool> recursive = graph.findRecursive();
+  REQUIRE(recursive[graph.idOf(".fact")]);
+  REQUIRE_FALSE(recursive[graph.idOf(".flat")]);
+  REQUIRE_FALSE(recursive[graph.idOf("." MAIN_FUNC_NAME)]);
+}
+
+TEST_CASE("Pure functions are found.", "[call_graph]") {
+  codegen::PixIRCode code = compiled(
+      "let g: int = 3;\n"
+      "fun square(x: int) -> int { let y: int = x * x; return y; }\n"
+      "fun sum(n: int) -> int {\n"
+      "  let s: int = 0;\n"
+      "  for (let i: int = 0; i < n; i = i + 1) { s = s + square(i); }\n"
+      "  return s;\n"
+      "}\n"
+      "fun show(x: int) -> int { __print x; return x; }\n"
+      "fun shown(x: int) -> int { return show(x) + 1; }\n"
+      "fun global(x: int) -> int { return x + g; }\n"
+      "fun random(x: int) -> int { return __randi x; }\n"
+      "__print sum(3) + shown(1) + global(2) + random(4);");
+  codegen::CallGraph graph{code};
+  std::vector<bool> pure = graph.findPure(code);
+
+  REQUIRE(pure[graph.idOf(".square")]);
+  REQUIRE(pure[graph.idOf(".sum")]);
+  REQUIRE_FALSE(pure[graph.idOf(".show")]);
+  REQUIRE_FALSE(pure[graph.idOf(".shown")]);
+  REQUIRE_FALSE(pure[graph.idOf(".global")]);
+  REQUIRE_FALSE(pure[graph.idOf(".random")]);
+  REQUIRE_FALSE(pure[graph.idOf("." MAIN_FUNC_NAME)]);
+}
+
+TEST_CASE("Long call chains don't overflow the stack.",
+          "[call_graph][stress]") {
+  const size_t depth = 100000;
+  codegen::PixIRCode code;
+  for (size_t i = 0; i < depth; i++)
+  {
+    code.push_back(std::make_unique<codegen::PixIRFunction>());
+    code.back()->funcName = "." + std::to_string(i);
+    // every function calls the next, and the last one calls the first.
+    code.back()->callees.push_back("." + std::to_string((i + 1) % depth));
+  }
+  codegen::CallGraph graph{code};
+
+  std::vector<bool> recursive = graph.findRecursive();
+  REQUIRE(std::count(recursive.begin(), recursive.end(), true) == depth);
+
+  code.back()->callees.clear();
+  recursive = codegen::CallGraph(code).findRecursive();
+  REQUIRE(std::count(recursive.begin(), recursive.end(), true) == 0);
+  REQUIRE(codegen::CallGraph(code).reachableFrom(0).back());
+}
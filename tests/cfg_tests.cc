@@ -0,0 +1,137 @@
+#include "cfg.hh"
+#include "codegen.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+static size_t exits(const codegen::ControlFlowGraph &cfg)
+{
+  size_t n = 0;
+  for (size_t block : cfg.reversePostorder())
+  {
+    n += cfg.successors(block).empty();
+  }
+  return n;
+}
+
+TEST_CASE("If statements branch and join.", "[cfg]") {
+  codegen::PixIRCode code =
+      generate("let x: int = 1;\n"
+               "if (x < 2) { __print 1; } else { __print 2; }\n"
+               "__print 3;");
+  const codegen::PixIRFunction &main = *code[0];
+  codegen::ControlFlowGraph cfg{main};
+  codegen::DominatorTree domTree{cfg};
+
+  // the head is the only block with two successors, and the join is the only
+  // one with two predecessors.
+  size_t head = codegen::ControlFlowGraph::NONE;
+  size_t join = codegen::ControlFlowGraph::NONE;
+  for (size_t block = 0; block < cfg.size(); block++)
+  {
+    REQUIRE(cfg.isReachable(block));
+    if (cfg.successors(block).size() == 2)
+    {
+      REQUIRE(head == codegen::ControlFlowGraph::NONE);
+      head = block;
+    }
+    if (cfg.predecessors(block).size() == 2)
+    {
+      REQUIRE(join == codegen::ControlFlowGraph::NONE);
+      join = block;
+    }
+  }
+  REQUIRE(head != codegen::ControlFlowGraph::NONE);
+  REQUIRE(join != codegen::ControlFlowGraph::NONE);
+
+  REQUIRE(domTree.immediateDominator(join) == head);
+  for (size_t branch : cfg.successors(head))
+  {
+    REQUIRE(domTree.immediateDominator(branch) == head);
+    REQUIRE_FALSE(domTree.dominates(branch, join));
+  }
+  REQUIRE(domTree.dominates(0, join));
+  REQUIRE(exits(cfg) == 1);
+  REQUIRE(cfg.reversePostorder().front() == 0);
+  REQUIRE(cfg.rpoIndexOf(join) > cfg.rpoIndexOf(head));
+
+  codegen::LoopInfo loops{cfg, domTree};
+  REQUIRE(loops.loops().empty());
+}
+
+TEST_CASE("Nested loops are found.", "[cfg]") {
+  for (bool rotateLoops : {false, true})
+  {
+    codegen::PixIRCode code = generate(
+        "for (let i: int = 0; i < 3; i = i + 1) {\n"
+        "  let j: int = 0;\n"
+        "  while (j < i) { j = j + 1; }\n"
+        "  __print j;\n"
+        "}\n"
+        "while (false) { __print 0; }\n",
+        rotateLoops);
+    codegen::ControlFlowGraph cfg{*code[0]};
+    codegen::DominatorTree domTree{cfg};
+    codegen::LoopInfo loopInfo{cfg, domTree};
+
+    INFO("rotateLoops: " << rotateLoops);
+    const std::vector<codegen::LoopInfo::Loop> &loops = loopInfo.loops();
+    REQUIRE(loops.size() == 3);
+
+    size_t depths[3] = {0, 0, 0};
+    for (size_t loop = 0; loop < loops.size(); loop++)
+    {
+      const codegen::LoopInfo::Loop &l = loops[loop];
+      depths[l.depth]++;
+      REQUIRE(loopInfo.loopOf(l.header) == loop);
+      for (size_t block : l.blocks)
+      {
+        REQUIRE(domTree.dominates(l.header, block));
+        REQUIRE(loopInfo.depthOf(block) >= l.depth);
+      }
+      if (l.parent != codegen::LoopInfo::NONE)
+      {
+        const codegen::LoopInfo::Loop &parent = loops[l.parent];
+        REQUIRE(std::includes(parent.blocks.begin(), parent.blocks.end(),
+                              l.blocks.begin(), l.blocks.end(),
+                              [&](size_t a, size_t b)
+                              { return cfg.rpoIndexOf(a) < cfg.rpoIndexOf(b); }));
+      }
+    }
+    REQUIRE(depths[1] == 2);
+    REQUIRE(depths[2] == 1);
+    REQUIRE(loopInfo.depthOf(0) == 0);
+  }
+}
+
+TEST_CASE("Blocks after returns are unreachable.", "[cfg]") {
+  codegen::PixIRCode code = generate(
+      "fun f(x: int) -> int {\n"
+      "  if (x < 1) { return 1; } else { return 2; }\n"
+      "  __print 3;\n"
+      "  return 4;\n"
+      "}\n"
+      "__print f(1);");
+  codegen::ControlFlowGraph cfg{*code[1]};
+  codegen::DominatorTree domTree{cfg};
+
+  size_t unreachable = 0;
+  for (size_t block = 0; block < cfg.size(); block++)
+  {
+    if (!cfg.isReachable(block))
+    {
+      unreachable++;
+      REQUIRE(domTree.immediateDominator(block) ==
+              codegen::ControlFlowGraph::NONE);
+      REQUIRE_FALSE(domTree.dominates(0, block));
+    }
+  }
+  REQUIRE(unreachable > 0);
+  REQUIRE(cfg.reversePostorder().size() + unreachable == cfg.size());
+  REQUIRE(exits(cfg) == 2);
+}
@@ -0,0 +1,302 @@
+#include "compiler.hh"
+#include "interpreter.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+TEST_CASE("In-memory compilation produces assembly and IR.", "[compiler]") {
+  CompilerOptions opts;
+  opts.generateXml = true;
+
+  pixelc::CompilationResult result =
+      pixelc::compile("let x: int = 1 + 2;\n__print x;", opts);
+
+  REQUIRE(result.success);
+  REQUIRE(result.diagnostics.empty());
+  REQUIRE(result.asmOutput.find(".main") != std::string::npos);
+  REQUIRE(result.xmlOutput.find("<TranslationUnit") != std::string::npos);
+  REQUIRE_FALSE(result.code.empty());
+  REQUIRE(result.code.front()->funcName == "." MAIN_FUNC_NAME);
+}
+
+TEST_CASE("In-memory compilation reports errors as diagnostics.",
+          "[compiler]") {
+  pixelc::CompilationResult result =
+      pixelc::compile("let x: int = ;", CompilerOptions());
+
+  REQUIRE_FALSE(result.success);
+  REQUIRE(result.asmOutput.empty());
+  REQUIRE(result.code.empty());
+  REQUIRE(result.diagnostics.find("Parser error") != std::string::npos);
+}
+
+TEST_CASE("Deeply nested programs compile.", "[compiler][stress]") {
+  const size_t depth = 20000;
+  std::string src = "let x: int = 0;\n";
+  for (size_t i = 0; i < depth; i++)
+  {
+    src += i % 3 == 0 ? "if (true) {" : i % 3 == 1 ? "while (false) {" : "{";
+  }
+  src += "x = " + std::string(depth, '(') + "x + 1" + std::string(depth, ')') +
+         ";" + std::string(depth, '}');
+
+  CompilerOptions opts;
+  opts.generateBinaryAst = true;
+  opts.rotateLoops = true;
+  opts.eliminateDeadCode = true;
+  opts.peepholeOptimize = true;
+
+  pixelc::CompilationResult result = pixelc::compile(src, opts);
+  REQUIRE(result.success);
+
+  opts.generateBinaryAst = false;
+  pixelc::CompilationResult fromAst = pixelc::compile(result.binaryAst, opts);
+  REQUIRE(fromAst.success);
+  REQUIRE(fromAst.asmOutput == result.asmOutput);
+}
+
+TEST_CASE("Parallel compilation produces the same code as serial.",
+          "[compiler]") {
+  size_t compiled = 0;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(PIXELC_EXAMPLES_DIR))
+  {
+    if (entry.path().extension() != ".pix")
+    {
+      continue;
+    }
+    std::ifstream in{entry.path()};
+    std::stringstream src;
+    src << in.rdbuf();
+
+    for (bool optimize : {false, true})
+    {
+      CompilerOptions opts;
+      opts.rotateLoops = optimize;
+      opts.unrollLoops = optimize;
+      opts.coalescePixels = optimize;
+      opts.specializeFunctions = optimize;
+      opts.memoizeCalls = optimize;
+      opts.eliminateDeadCode = optimize;
+      opts.peepholeOptimize = optimize;
+      opts.ssaOptimize = optimize;
+
+      pixelc::CompilationResult serial = pixelc::compile(src.str(), opts);
+      opts.threads = 4;
+      pixelc::CompilationResult parallel = pixelc::compile(src.str(), opts);
+
+      INFO(entry.path());
+      REQUIRE(serial.success);
+      REQUIRE(parallel.success);
+      REQUIRE(parallel.asmOutput == serial.asmOutput);
+    }
+    compiled++;
+  }
+  REQUIRE(compiled > 0);
+}
+
+TEST_CASE("Optimizations keep the behaviour of programs.", "[compiler]") {
+  std::vector<std::pair<std::string, std::string>> programs = {
+      {"memoized calls",
+       "fun fib(n: int) -> int {\n"
+       "  if (n < 2) { return n; }\n"
+       "  return fib(n - 1) + fib(n - 2);\n"
+       "}\n"
+       "fun cube(x: int) -> int { return x * x * x; }\n"
+       "let t: int = 0;\n"
+       "for (let k: int = 0; k < 15; k = k + 1) { t = t + fib(k) + cube(k); }\n"
+       "for (let k: int = 0; k < 15; k = k + 1) { t = t + cube(k); }\n"
+       "__print t;"},
+      {"unrolled loops",
+       "let n: int = 10;\n"
+       "let s: int = 0;\n"
+       "for (let i: int = 0; i < n; i = i + 3) { s = s * 2 + i; __print s; }\n"
+       "for (let i: int = 40; i > 1; i = i - 1) { s = s - i; }\n"
+       "__print s;"},
+      {"coalesced pixels",
+       "fun box(x0: int, y0: int, w: int, h: int, c: colour) -> int {\n"
+       "  for (let y: int = y0; y < y0 + h; y = y + 1) {\n"
+       "    for (let x: int = x0; x < x0 + w; x = x + 1) { __pixel x, y, c; }\n"
+       "  }\n"
+       "  return 0;\n"
+       "}\n"
+       "let r: int = box(2, 3, 5, 4, #ff0000);\n"
+       "__delay 1;\n"
+       "r = box(10, 10, 0, 3, #00ff00);\n"
+       "r = box(10, 10, 3, -2, #0000ff);\n"
+       "__delay 1;\n"
+       "let a: int = __width + 5;\n"
+       "for (let i: int = a; i < 10; i = i + 1) { __pixel i, 0, #ff0000; }\n"
+       "__pixel 3, 2, #00ff00;\n"
+       "__pixel 3, 1, #00ff00;\n"
+       "__print __read 3, 1;"},
+      {"dead code",
+       "fun f(x: int) -> int {\n"
+       "  if (x > 2) { return 1; } else { return 2; }\n"
+       "  __print 3;\n"
+       "  return 4;\n"
+       "}\n"
+       "let debug: bool = false;\n"
+       "if (debug) { __print 5; } else { __print f(3) + f(1); }\n"
+       "while (true) { __print 6; }"}};
+  for (const auto &entry :
+       std::filesystem::directory_iterator(PIXELC_EXAMPLES_DIR))
+  {
+    if (entry.path().extension() == ".pix")
+    {
+      std::ifstream in{entry.path()};
+      std::stringstream src;
+      src << in.rdbuf();
+      programs.push_back({entry.path().filename().string(), src.str()});
+    }
+  }
+
+  std::vector<std::string> flags = {"-frotate-loops",
+                                    "-funroll-loops",
+                                    "-fcoalesce-pixels",
+                                    "-felim-dead-code",
+                                    "-fpeephole-optimize",
+                                    "-fssa-optimize",
+                                    "-fspecialize-calls",
+                                    "-fmemoize-calls"};
+  for (const auto &[name, src] : programs)
+  {
+    interpreter::Trace base = interpreter::run(compiled(src));
+    INFO(name);
+    REQUIRE(!base.events.empty());
+
+    // each optimization alone, then all of them.
+    CompilerOptions all;
+    for (size_t i = 0; i <= flags.size(); i++)
+    {
+      CompilerOptions opts;
+      if (i < flags.size())
+      {
+        setOptimizationFlag(opts, flags[i]);
+        setOptimizationFlag(all, flags[i]);
+      }
+      INFO((i < flags.size() ? flags[i] : "all"));
+      interpreter::Trace optimized =
+          interpreter::run(compiled(src, i < flags.size() ? opts : all));
+      REQUIRE(interpreter::sameBehaviour(base, optimized));
+    }
+  }
+}
+
+TEST_CASE("Delays folded to zero are removed.", "[compiler]") {
+  CompilerOptions opts;
+  opts.peepholeOptimize = true;
+  opts.ssaOptimize = true;
+
+  pixelc::CompilationResult result =
+      pixelc::compile("__delay 5 - 5;\n__print 1;", opts);
+  REQUIRE(result.success);
+  REQUIRE(result.asmOutput == ".main\n\tpush 1\n\tprint\n\thalt\n\n");
+}
+
+// the number of times an instruction appears in the generated assembly.
+static size_t countInstrs(const std::string &asmOutput, const std::string &instr)
+{
+  size_t count = 0;
+  std::istringstream lines{asmOutput};
+  for (std::string line; std::getline(lines, line);)
+  {
+    count += line == "\t" + instr;
+  }
+  return count;
+}
+
+TEST_CASE("For loops with known trip counts are unrolled.", "[compiler]") {
+  CompilerOptions opts;
+  opts.unrollLoops = true;
+
+  // fully unrolled: the body is copied once per iteration.
+  pixelc::CompilationResult small = pixelc::compile(
+      "let n: int = 3;\n"
+      "for (let i: int = 0; i < n; i = i + 1) { __print i; }",
+      opts);
+  REQUIRE(small.success);
+  REQUIRE(countInstrs(small.asmOutput, "print") == 3);
+  REQUIRE(countInstrs(small.asmOutput, "cjmp2") == 0);
+
+  // partially unrolled: 8 copies in the loop, after 100 % 8 peeled ones.
+  pixelc::CompilationResult large = pixelc::compile(
+      "for (let i: int = 100; i > 0; i = i - 1) { __print i; }", opts);
+  REQUIRE(large.success);
+  REQUIRE(countInstrs(large.asmOutput, "print") == 12);
+  REQUIRE(countInstrs(large.asmOutput, "cjmp2") == 1);
+
+  // the bound may change, or the body changes the variable.
+  for (const char *src :
+       {"let n: int = 3;\n"
+        "n = 4;\n"
+        "for (let i: int = 0; i < n; i = i + 1) { __print i; }",
+        "for (let i: int = 0; i < 3; i = i + 1) { i = i * 2; }"})
+  {
+    pixelc::CompilationResult loop = pixelc::compile(src, opts);
+    REQUIRE(loop.success);
+    REQUIRE(countInstrs(loop.asmOutput, "cjmp2") == 1);
+  }
+}
+
+TEST_CASE("Pixels drawn in one colour are coalesced.", "[compiler]") {
+  CompilerOptions opts;
+  opts.coalescePixels = true;
+
+  // nested loops filling a rectangle draw it at once.
+  pixelc::CompilationResult fill = pixelc::compile(
+      "for (let y: int = 0; y < __height; y = y + 1) {\n"
+      "  for (let x: int = 1; x <= 5; x = x + 1) { __pixel x, y, #ff0000; }\n"
+      "}",
+      opts);
+  REQUIRE(fill.success);
+  REQUIRE(countInstrs(fill.asmOutput, "pixel") == 0);
+  REQUIRE(countInstrs(fill.asmOutput, "pixelr") == 1);
+  // only the check that the height isn't empty is left of the loops.
+  REQUIRE(countInstrs(fill.asmOutput, "cjmp2") == 1);
+
+  // a loop starting past the edge draws nothing, and mustn't draw an empty
+  // rectangle out of bounds either.
+  pixelc::CompilationResult empty = pixelc::compile(
+      "let a: int = __width + 5;\n"
+      "for (let i: int = a; i < 10; i = i + 1) { __pixel i, 0, #ff0000; }\n"
+      "__print 1;",
+      opts);
+  REQUIRE(empty.success);
+  REQUIRE(countInstrs(empty.asmOutput, "pixelr") == 1);
+  REQUIRE(countInstrs(empty.asmOutput, "gt") == 1);
+  REQUIRE(countInstrs(empty.asmOutput, "cjmp2") == 1);
+  REQUIRE(countInstrs(empty.asmOutput, "max") == 0);
+  REQUIRE(empty.asmOutput.find("cjmp2") < empty.asmOutput.find("pixelr"));
+
+  // a run of pixels becomes a vertical span and a single pixel.
+  pixelc::CompilationResult run = pixelc::compile(
+      "let x: int = 3;\n"
+      "__pixel x, 2, #00ff00;\n"
+      "__pixel x, 1, #00ff00;\n"
+      "__pixel x, 3, #00ff00;\n"
+      "__pixel x + 2, 1, #00ff00;",
+      opts);
+  REQUIRE(run.success);
+  REQUIRE(countInstrs(run.asmOutput, "pixel") == 1);
+  REQUIRE(countInstrs(run.asmOutput, "pixelr") == 1);
+
+  // the colour, or the other coordinate, changes with the loop.
+  for (const char *src :
+       {"for (let i: int = 0; i < 4; i = i + 1) { __pixel i, i, #0000ff; }",
+        "fun c(i: int) -> colour { return #0000ff; }\n"
+        "for (let i: int = 0; i < 4; i = i + 1) { __pixel i, 0, c(i); }"})
+  {
+    pixelc::CompilationResult loop = pixelc::compile(src, opts);
+    REQUIRE(loop.success);
+    REQUIRE(countInstrs(loop.asmOutput, "pixel") == 1);
+    REQUIRE(countInstrs(loop.asmOutput, "pixelr") == 0);
+  }
+}
@@ -0,0 +1,216 @@
+#include "codegen.hh"
+#include "deadcode.hh"
+#include "interpreter.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST_CASE("Code after infinite loops is removed.", "[deadcode]") {
+  for (bool rotateLoops : {false, true})
+  {
+    codegen::PixIRCode code =
+        generate("__print 1;\nwhile (true) { __print 2; }\n__print 3;",
+                 rotateLoops);
+    codegen::PixIRFunction &main = *code[0];
+    REQUIRE(printed(main) == "1 2 3 ");
+    interpreter::Trace before = interpreter::run(code, 1000);
+
+    codegen::eliminateUnreachableBlocks(main);
+    INFO("rotateLoops: " << rotateLoops);
+    REQUIRE(printed(main) == "1 2 ");
+    REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code, 1000)));
+
+    // the loop no longer tests its condition.
+    for (const std::unique_ptr<codegen::BasicBlock> &block : main.blocks)
+    {
+      for (const codegen::PixIRInstruction &instr : block->instrs)
+      {
+        REQUIRE(instr.opcode != codegen::PixIROpcode::CJMP2);
+        REQUIRE(instr.opcode != codegen::PixIROpcode::HALT);
+      }
+    }
+  }
+}
+
+TEST_CASE("Branches on constants are folded.", "[deadcode]") {
+  codegen::PixIRCode code = generate(
+      "if (true) { __print 1; } else { __print 2; }\n"
+      "if (false) { __print 3; } else { __print 4; }\n"
+      "let x: bool = false;\n"
+      "if (x) { __print 5; } else { __print 6; }\n"
+      "while (false) { __print 7; }\n"
+      "__print 8;");
+  codegen::PixIRFunction &main = *code[0];
+
+  codegen::eliminateUnreachableBlocks(main);
+  // only the branch on x is left.
+  REQUIRE(printed(main) == "1 4 6 5 8 ");
+  REQUIRE(interpreter::run(code).events ==
+          std::vector<std::string>{"print 1", "print 4", "print 6", "print 8",
+                                   "halt"});
+
+  // linearizing resolves the jumps of the remaining blocks.
+  codegen::linearizeCode(main);
+  REQUIRE(main.blocks.back()->instrs.back().opcode ==
+          codegen::PixIROpcode::HALT);
+}
+
+TEST_CASE("CJMP jumps if its condition is false.", "[deadcode]") {
+  using codegen::PixIROpcode;
+  for (const char *cond : {"0", "1"})
+  {
+    // push cond; cjmp to a block printing 2, else fall through to print 1.
+    codegen::PixIRFunction func;
+    for (int i = 0; i < 3; i++)
+    {
+      func.blocks.push_back(
+          std::make_unique<codegen::BasicBlock>(codegen::BasicBlock{&func, {}}));
+    }
+    func.blocks[0]->instrs = {{PixIROpcode::PUSH, cond},
+                              {PixIROpcode::PUSH, func.blocks[2].get()},
+                              {PixIROpcode::CJMP}};
+    func.blocks[1]->instrs = {{PixIROpcode::PUSH, "1"},
+                              {PixIROpcode::PRINT},
+                              {PixIROpcode::HALT}};
+    func.blocks[2]->instrs = {{PixIROpcode::PUSH, "2"},
+                              {PixIROpcode::PRINT},
+                              {PixIROpcode::HALT}};
+
+    codegen::eliminateUnreachableBlocks(func);
+    INFO("cond: " << cond);
+    if (std::string(cond) == "0")
+    {
+      REQUIRE(printed(func) == "2 ");
+      REQUIRE(func.blocks[0]->instrs.back().opcode == PixIROpcode::JMP);
+    }
+    else
+    {
+      REQUIRE(printed(func) == "1 ");
+      REQUIRE(func.blocks[0]->instrs.empty());
+    }
+  }
+}
+
+TEST_CASE("Code after returns on every path is removed.", "[deadcode]") {
+  codegen::PixIRCode code = generate(
+      "fun f(x: int) -> int {\n"
+      "  if (x < 1) { return 1; } else { __print 2; return 3; }\n"
+      "  __print 4;\n"
+      "  return 5;\n"
+      "}\n"
+      "__print f(0);");
+  codegen::PixIRFunction &f = *code[1];
+  size_t blocks = f.blocks.size();
+  interpreter::Trace before = interpreter::run(code);
+
+  codegen::eliminateUnreachableBlocks(f);
+  REQUIRE(printed(f) == "2 ");
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+  REQUIRE(f.blocks.size() < blocks);
+  // nothing follows a return.
+  for (const std::unique_ptr<codegen::BasicBlock> &block : f.blocks)
+  {
+    for (auto it = block->instrs.begin(); it != block->instrs.end(); ++it)
+    {
+      if (it->opcode == codegen::PixIROpcode::RET)
+      {
+        REQUIRE(std::next(it) == block->instrs.end());
+      }
+    }
+  }
+}
+
+// the number of instructions of a function with the given opcode.
+static size_t count(const codegen::PixIRFunction &func,
+                    codegen::PixIROpcode opcode)
+{
+  size_t result = 0;
+  for (const std::unique_ptr<codegen::BasicBlock> &block : func.blocks)
+  {
+    for (const codegen::PixIRInstruction &instr : block->instrs)
+    {
+      result += instr.opcode == opcode;
+    }
+  }
+  return result;
+}
+
+// the operands pushed just before each instruction with the given opcode,
+// e.g. the frame sizes of OFRAME.
+static std::string operandsOf(const codegen::PixIRFunction &func,
+                              codegen::PixIROpcode opcode)
+{
+  std::string result;
+  const codegen::PixIRInstruction *last = nullptr;
+  for (const std::unique_ptr<codegen::BasicBlock> &block : func.blocks)
+  {
+    for (const codegen::PixIRInstruction &instr : block->instrs)
+    {
+      if (instr.opcode == opcode && last)
+      {
+        result += std::get<std::string>(last->data) + " ";
+      }
+      last = &instr;
+    }
+  }
+  return result;
+}
+
+TEST_CASE("Stores to unused variables are removed.", "[deadcode]") {
+  codegen::PixIRCode code = generate("let unused: int = 1 + 2;\n"
+                                     "let x: int = 3;\n"
+                                     "let r: int = __randi 5;\n"
+                                     "{\n"
+                                     "  let a: int = 4;\n"
+                                     "  let b: int = x;\n"
+                                     "  __print b;\n"
+                                     "}\n"
+                                     "__print x;");
+  codegen::PixIRFunction &main = *code[0];
+  REQUIRE(count(main, codegen::PixIROpcode::ST) == 5);
+  REQUIRE(operandsOf(main, codegen::PixIROpcode::ALLOC) == "3 ");
+  REQUIRE(operandsOf(main, codegen::PixIROpcode::OFRAME) == "2 ");
+  interpreter::Trace before = interpreter::run(code);
+
+  codegen::eliminateDeadStores(main);
+  // r is never read, but its value has a side effect on the random numbers.
+  REQUIRE(count(main, codegen::PixIROpcode::ST) == 3);
+  REQUIRE(count(main, codegen::PixIROpcode::IRND) == 1);
+  REQUIRE(count(main, codegen::PixIROpcode::ADD) == 0);
+
+  // the frames only hold the remaining variables.
+  REQUIRE(operandsOf(main, codegen::PixIROpcode::ALLOC) == "2 ");
+  REQUIRE(operandsOf(main, codegen::PixIROpcode::OFRAME) == "1 ");
+  REQUIRE(printed(main) == "[0] [1] ");
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+}
+
+TEST_CASE("Frames open during calls keep their layout.", "[deadcode]") {
+  codegen::PixIRCode code = generate("fun f(x: int) -> int {\n"
+                                     "  let y: int = x;\n"
+                                     "  return x;\n"
+                                     "}\n"
+                                     "{\n"
+                                     "  let a: int = 1;\n"
+                                     "  __print f(2);\n"
+                                     "}");
+  codegen::PixIRFunction &main = *code[0];
+  codegen::PixIRFunction &f = *code[1];
+  interpreter::Trace before = interpreter::run(code);
+
+  codegen::eliminateDeadStores(main);
+  REQUIRE(count(main, codegen::PixIROpcode::ST) == 1);
+  REQUIRE(operandsOf(main, codegen::PixIROpcode::OFRAME) == "1 ");
+
+  // y is unused, but the parameter x stays in the function's own frame.
+  REQUIRE(operandsOf(f, codegen::PixIROpcode::OFRAME) == "1 ");
+  codegen::eliminateDeadStores(f);
+  REQUIRE(count(f, codegen::PixIROpcode::ST) == 0);
+  REQUIRE(operandsOf(f, codegen::PixIROpcode::OFRAME) == "0 ");
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+}
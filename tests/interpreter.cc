@@ -0,0 +1,473 @@
+#include "interpreter.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace interpreter
+{
+
+  bool sameBehaviour(const Trace &a, const Trace &b)
+  {
+    if (a.finished && b.finished)
+    {
+      return a.events == b.events;
+    }
+
+    // the events of a run which didn't finish are a prefix of what it would
+    // have done.
+    size_t n = std::min(a.finished ? a.events.size() + 1 : a.events.size(),
+                        b.finished ? b.events.size() + 1 : b.events.size());
+    return a.events.size() >= n && b.events.size() >= n &&
+           std::equal(a.events.begin(), a.events.begin() + n, b.events.begin());
+  }
+
+  static std::string format(double x)
+  {
+    if (x == std::floor(x) && std::abs(x) < 1e15)
+    {
+      return std::to_string(static_cast<long long>(x));
+    }
+    // folded constants are printed with 6 significant digits.
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", x);
+    return buf;
+  }
+
+  Interpreter::Interpreter(const codegen::PixIRCode &code)
+      : screen(WIDTH * HEIGHT, 0)
+  {
+    for (const std::unique_ptr<codegen::PixIRFunction> &func : code)
+    {
+      Function &flat = funcs[func->funcName];
+      for (const std::unique_ptr<codegen::BasicBlock> &block : func->blocks)
+      {
+        flat.offsets[block.get()] = flat.instrs.size();
+        for (const codegen::PixIRInstruction &instr : block->instrs)
+        {
+          flat.instrs.push_back(&instr);
+        }
+      }
+    }
+  }
+
+  Interpreter::Value Interpreter::pop()
+  {
+    if (stack.empty())
+    {
+      throw std::runtime_error("Empty stack when operand is needed.");
+    }
+    Value x = std::move(stack.back());
+    stack.pop_back();
+    return x;
+  }
+
+  double Interpreter::popNumber()
+  {
+    Value x = pop();
+    if (!std::holds_alternative<double>(x.data))
+    {
+      throw std::runtime_error("Operand is not a number.");
+    }
+    return std::get<double>(x.data);
+  }
+
+  Interpreter::Value &Interpreter::frameSlot(size_t index, size_t depth)
+  {
+    if (depth >= frames.size())
+    {
+      throw std::runtime_error("Access to a missing frame.");
+    }
+    // frames grow as slots are stored to, like arrays in JavaScript.
+    std::vector<Value> &frame = frames[frames.size() - 1 - depth];
+    if (index >= frame.size())
+    {
+      frame.resize(index + 1);
+    }
+    return frame[index];
+  }
+
+  void Interpreter::fillRect(double x, double y, double w, double h, double c)
+  {
+    if (x < 0 || y < 0 || x + w > WIDTH || y + h > HEIGHT)
+    {
+      throw std::runtime_error("Out of bounds fill.");
+    }
+    for (int i = x; i < x + w; i++)
+    {
+      for (int j = y; j < y + h; j++)
+      {
+        screen[j * WIDTH + i] = static_cast<uint32_t>(c);
+      }
+    }
+    screenChanged |= w > 0 && h > 0;
+  }
+
+  void Interpreter::record(const std::string &event)
+  {
+    if (screenChanged)
+    {
+      // FNV-1a.
+      uint64_t hash = 14695981039346656037ull;
+      for (uint32_t colour : screen)
+      {
+        hash = (hash ^ colour) * 1099511628211ull;
+      }
+      trace.events.push_back("screen " + std::to_string(hash));
+      screenChanged = false;
+    }
+    trace.events.push_back(event);
+  }
+
+  bool Interpreter::step()
+  {
+    Call &call = calls.back();
+    if (call.pc >= call.func->instrs.size())
+    {
+      throw std::runtime_error("Program counter out of bounds.");
+    }
+    const codegen::PixIRInstruction &instr = *call.func->instrs[call.pc++];
+
+    switch (instr.opcode)
+    {
+    case codegen::AND:
+    case codegen::MIN:
+    {
+      double x = popNumber();
+      push(std::min(x, popNumber()));
+      break;
+    }
+    case codegen::OR:
+    case codegen::MAX:
+    {
+      double x = popNumber();
+      push(std::max(x, popNumber()));
+      break;
+    }
+    case codegen::NOT:
+      push(popNumber() > 0 ? 0 : 1);
+      break;
+    case codegen::ADD:
+    {
+      double x = popNumber();
+      push(x + popNumber());
+      break;
+    }
+    case codegen::SUB:
+    {
+      double x = popNumber();
+      push(x - popNumber());
+      break;
+    }
+    case codegen::MUL:
+    {
+      double x = popNumber();
+      push(x * popNumber());
+      break;
+    }
+    case codegen::DIV:
+    {
+      double x = popNumber();
+      push(x / popNumber());
+      break;
+    }
+    case codegen::INC:
+      push(popNumber() + 1);
+      break;
+    case codegen::DEC:
+      push(popNumber() - 1);
+      break;
+    case codegen::ROUND:
+      push(std::floor(popNumber() + 0.5));
+      break;
+    case codegen::IRND:
+    {
+      double x = popNumber();
+      if (x <= 0)
+      {
+        throw std::runtime_error("Argument to irnd is <= 0.");
+      }
+      seed = seed * 1103515245 + 12345;
+      push(std::floor((seed >> 8) / double(1 << 24) * (x - 1) + 0.5));
+      break;
+    }
+    case codegen::LT:
+    {
+      double x = popNumber();
+      push(x < popNumber());
+      break;
+    }
+    case codegen::LE:
+    {
+      double x = popNumber();
+      push(x <= popNumber());
+      break;
+    }
+    case codegen::GT:
+    {
+      double x = popNumber();
+      push(x > popNumber());
+      break;
+    }
+    case codegen::GE:
+    {
+      double x = popNumber();
+      push(x >= popNumber());
+      break;
+    }
+    case codegen::EQ:
+    case codegen::NEQ:
+    {
+      Value x = pop();
+      Value y = pop();
+      push((x.data == y.data) == (instr.opcode == codegen::EQ));
+      break;
+    }
+    case codegen::PUSH:
+    {
+      if (std::holds_alternative<codegen::BasicBlock *>(instr.data))
+      {
+        auto *block = std::get<codegen::BasicBlock *>(instr.data);
+        push(call.func->offsets.at(block));
+        break;
+      }
+      const std::string &operand = std::get<std::string>(instr.data);
+      if (operand.rfind("#PC", 0) == 0)
+      {
+        push(double(call.pc - 1) + std::stod(operand.substr(3)));
+      }
+      else if (operand[0] == '#')
+      {
+        push(std::stoul(operand.substr(1), nullptr, 16));
+      }
+      else if (operand[0] == '[')
+      {
+        // [index] or [index:depth].
+        size_t colon = operand.find(':');
+        size_t depth = colon == std::string::npos
+                           ? 0
+                           : std::stoul(operand.substr(colon + 1));
+        Value &slot = frameSlot(std::stoul(operand.substr(1)), depth);
+        if (std::holds_alternative<std::monostate>(slot.data))
+        {
+          throw std::runtime_error("Memory access to undefined location " +
+                                   operand + ".");
+        }
+        stack.push_back(slot);
+      }
+      else if (operand[0] == '.')
+      {
+        stack.push_back({operand});
+      }
+      else
+      {
+        push(std::stod(operand));
+      }
+      break;
+    }
+    case codegen::JMP:
+      call.pc = popNumber();
+      break;
+    case codegen::CJMP:
+    case codegen::CJMP2:
+    {
+      double target = popNumber();
+      bool jump = popNumber() != 0;
+      if (jump == (instr.opcode == codegen::CJMP2))
+      {
+        call.pc = target;
+      }
+      break;
+    }
+    case codegen::CALL:
+    {
+      Value label = pop();
+      if (!std::holds_alternative<std::string>(label.data) ||
+          !funcs.count(std::get<std::string>(label.data)))
+      {
+        throw std::runtime_error("Call to a missing function.");
+      }
+      size_t args = popNumber();
+      std::vector<Value> frame;
+      for (size_t i = 0; i < args; i++)
+      {
+        frame.push_back(pop());
+      }
+      frames.push_back(std::move(frame));
+      calls.push_back({&funcs.at(std::get<std::string>(label.data)), 0});
+      break;
+    }
+    case codegen::RET:
+      frames.pop_back();
+      calls.pop_back();
+      if (calls.empty())
+      {
+        throw std::runtime_error("Return from main.");
+      }
+      break;
+    case codegen::ST:
+    {
+      double depth = popNumber();
+      double index = popNumber();
+      Value x = pop();
+      frameSlot(index, depth) = std::move(x);
+      break;
+    }
+    case codegen::ALLOC:
+      frames.back().resize(frames.back().size() + size_t(popNumber()));
+      break;
+    case codegen::OFRAME:
+      frames.emplace_back(size_t(popNumber()));
+      break;
+    case codegen::CFRAME:
+      frames.pop_back();
+      break;
+    case codegen::DELAY:
+    {
+      // a delay of 0 can't be told apart from none.
+      double delay = popNumber();
+      if (delay != 0)
+      {
+        record("delay " + format(delay));
+      }
+      break;
+    }
+    case codegen::PIXEL:
+    {
+      double x = popNumber();
+      double y = popNumber();
+      fillRect(x, y, 1, 1, popNumber());
+      break;
+    }
+    case codegen::PIXELR:
+    {
+      double x = popNumber();
+      double y = popNumber();
+      double w = popNumber();
+      double h = popNumber();
+      fillRect(x, y, w, h, popNumber());
+      break;
+    }
+    case codegen::CLEAR:
+      fillRect(0, 0, WIDTH, HEIGHT, popNumber());
+      break;
+    case codegen::READ:
+    {
+      int x = popNumber();
+      int y = popNumber();
+      bool inside = x >= 0 && y >= 0 && x < WIDTH && y < HEIGHT;
+      push(inside ? screen[y * WIDTH + x] : 0);
+      break;
+    }
+    case codegen::WIDTH:
+      push(WIDTH);
+      break;
+    case codegen::HEIGHT:
+      push(HEIGHT);
+      break;
+    case codegen::PRINT:
+    {
+      Value x = pop();
+      if (auto *number = std::get_if<double>(&x.data))
+      {
+        record("print " + format(*number));
+      }
+      else if (auto *label = std::get_if<std::string>(&x.data))
+      {
+        record("print " + *label);
+      }
+      else
+      {
+        record("print array");
+      }
+      break;
+    }
+    case codegen::DUP:
+    {
+      Value x = pop();
+      stack.push_back(x);
+      stack.push_back(x);
+      break;
+    }
+    case codegen::HALT:
+      return false;
+    case codegen::ALLOCA:
+    {
+      double size = popNumber();
+      if (size < 0)
+      {
+        throw std::runtime_error("Cannot allocate array with negative size.");
+      }
+      stack.push_back({std::make_shared<Array>(size_t(size))});
+      break;
+    }
+    case codegen::STA:
+    case codegen::LDA:
+    {
+      Value arr = pop();
+      if (!std::holds_alternative<std::shared_ptr<Array>>(arr.data))
+      {
+        throw std::runtime_error("Operand is not an array.");
+      }
+      Array &elems = *std::get<std::shared_ptr<Array>>(arr.data);
+      double index = popNumber();
+      if (index < 0 || index >= elems.size())
+      {
+        throw std::runtime_error("Out of bounds array access.");
+      }
+      Value &elem = elems[size_t(index)];
+      if (instr.opcode == codegen::STA)
+      {
+        elem = pop();
+      }
+      else if (std::holds_alternative<std::monostate>(elem.data))
+      {
+        throw std::runtime_error("Loaded undefined array element.");
+      }
+      else
+      {
+        stack.push_back(elem);
+      }
+      break;
+    }
+    case codegen::GETCHAR:
+    {
+      static const std::string input = "Hello, world!\n";
+      push(input[charsRead++ % input.size()]);
+      break;
+    }
+    case codegen::PUTCHAR:
+      record("putchar " + format(std::floor(popNumber() + 0.5)));
+      break;
+    }
+    return true;
+  }
+
+  Trace Interpreter::run(size_t maxSteps)
+  {
+    frames.emplace_back();
+    calls.push_back({&funcs.at("." MAIN_FUNC_NAME), 0});
+
+    try
+    {
+      while (trace.steps < maxSteps)
+      {
+        trace.steps++;
+        if (!step())
+        {
+          trace.finished = true;
+          record("halt");
+          break;
+        }
+      }
+    }
+    catch (std::exception &e)
+    {
+      trace.finished = true;
+      record(std::string("error: ") + e.what());
+    }
+    return trace;
+  }
+
+} // namespace interpreter
@@ -0,0 +1,107 @@
+#ifndef INTERPRETER_H_
+#define INTERPRETER_H_
+
+#include "codegen.hh"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace interpreter
+{
+
+  // what a program did when run: the values it printed, the characters it
+  // wrote and its delays, each preceded by the contents of the screen if they
+  // changed since the last one.
+  struct Trace
+  {
+    std::vector<std::string> events;
+    // whether the program halted, or failed as the VM would, before running
+    // out of steps. A failure is the last event.
+    bool finished = false;
+    size_t steps = 0;
+  };
+
+  // whether two runs of a program behaved the same, up to where either one
+  // ran out of steps.
+  bool sameBehaviour(const Trace &a, const Trace &b);
+
+  // runs PixIR the way the PixelVM (vm/src/vm.ts) does. Jumps may still refer
+  // to blocks, so code needn't be linearized. Random numbers and the
+  // characters read are fixed sequences, so runs can be compared.
+  class Interpreter
+  {
+  public:
+    static const int WIDTH = 100;
+    static const int HEIGHT = 100;
+    static const size_t DEFAULT_MAX_STEPS = 1000000;
+
+  private:
+    struct Value;
+    using Array = std::vector<Value>;
+
+    // undefined, a number (also colours and instruction pointers), a function
+    // label or an array.
+    struct Value
+    {
+      std::variant<std::monostate, double, std::string, std::shared_ptr<Array>>
+          data;
+    };
+
+    struct Function
+    {
+      std::vector<const codegen::PixIRInstruction *> instrs;
+      // where each block starts.
+      std::unordered_map<const codegen::BasicBlock *, size_t> offsets;
+    };
+
+    struct Call
+    {
+      const Function *func;
+      size_t pc;
+    };
+
+    std::unordered_map<std::string, Function> funcs;
+
+    std::vector<Value> stack;
+    // the innermost frame is the last one.
+    std::vector<std::vector<Value>> frames;
+    std::vector<Call> calls;
+
+    std::vector<uint32_t> screen;
+    bool screenChanged = false;
+    uint32_t seed = 1;
+    size_t charsRead = 0;
+
+    Trace trace;
+
+    Value pop();
+    double popNumber();
+    void push(double x) { stack.push_back({x}); }
+    Value &frameSlot(size_t index, size_t depth);
+
+    void fillRect(double x, double y, double w, double h, double c);
+    void record(const std::string &event);
+
+    // runs the instruction at the top of the call stack. Returns false once
+    // the program halted.
+    bool step();
+
+  public:
+    Interpreter(const codegen::PixIRCode &code);
+
+    Trace run(size_t maxSteps = DEFAULT_MAX_STEPS);
+  };
+
+  inline Trace run(const codegen::PixIRCode &code,
+                   size_t maxSteps = Interpreter::DEFAULT_MAX_STEPS)
+  {
+    return Interpreter{code}.run(maxSteps);
+  }
+
+} // namespace interpreter
+
+#endif // INTERPRETER_H_
@@ -0,0 +1,103 @@
+#include "codegen.hh"
+#include "interpreter.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+using codegen::PixIROpcode;
+
+// a main function made of the given code.
+static codegen::PixIRCode
+makeMain(std::list<codegen::PixIRInstruction> &&instrs)
+{
+  auto main = std::make_unique<codegen::PixIRFunction>();
+  main->funcName = "." MAIN_FUNC_NAME;
+  main->blocks.push_back(std::make_unique<codegen::BasicBlock>());
+  main->blocks[0]->parentFunc = main.get();
+  main->blocks[0]->instrs = std::move(instrs);
+
+  codegen::PixIRCode code;
+  code.push_back(std::move(main));
+  return code;
+}
+
+TEST_CASE("Programs are run as the VM runs them.", "[interpreter]") {
+  interpreter::Trace trace = interpreter::run(
+      compiled("fun half(x: float) -> float { return x / 2.0; }\n"
+               "let a: []int = __newarr int, 4;\n"
+               "a[1] = 3;\n"
+               "__print half(7.0);\n"
+               "__print a[1] + 2;\n"
+               "__pixel 1, 1, #ff0000;\n"
+               "__print __read 1, 1;"));
+  REQUIRE(trace.finished);
+  REQUIRE(trace.events == std::vector<std::string>{"print 3.5", "print 5",
+                                                   trace.events[2],
+                                                   "print 16711680", "halt"});
+  REQUIRE(trace.events[2].rfind("screen ", 0) == 0);
+
+  // CJMP jumps on zero, CJMP2 on anything else.
+  for (PixIROpcode jump : {PixIROpcode::CJMP, PixIROpcode::CJMP2})
+  {
+    trace = interpreter::run(makeMain({{PixIROpcode::PUSH, "0"},
+                                       {PixIROpcode::PUSH, "#PC+4"},
+                                       {jump},
+                                       {PixIROpcode::PUSH, "1"},
+                                       {PixIROpcode::PRINT},
+                                       {PixIROpcode::PUSH, "2"},
+                                       {PixIROpcode::PRINT},
+                                       {PixIROpcode::HALT}}));
+    INFO(codegen::to_string(jump));
+    REQUIRE(trace.events.front() ==
+            (jump == PixIROpcode::CJMP ? "print 2" : "print 1"));
+  }
+}
+
+TEST_CASE("Programs fail where the VM fails.", "[interpreter]") {
+  // even an empty rectangle is checked against the screen.
+  interpreter::Trace trace = interpreter::run(
+      makeMain({{PixIROpcode::PUSH, "#ff0000"},
+                {PixIROpcode::PUSH, "1"},
+                {PixIROpcode::PUSH, "0"},
+                {PixIROpcode::PUSH, "0"},
+                {PixIROpcode::PUSH,
+                 std::to_string(interpreter::Interpreter::WIDTH + 5)},
+                {PixIROpcode::PIXELR},
+                {PixIROpcode::HALT}}));
+  REQUIRE(trace.finished);
+  REQUIRE(trace.events ==
+          std::vector<std::string>{"error: Out of bounds fill."});
+
+  // arrays start out undefined.
+  trace = interpreter::run(compiled("let a: []int = __newarr int, 2;\n"
+                                    "__print 1;\n"
+                                    "__print a[0];"));
+  REQUIRE(trace.finished);
+  REQUIRE(trace.events ==
+          std::vector<std::string>{"print 1",
+                                   "error: Loaded undefined array element."});
+
+  trace = interpreter::run(compiled("while (true) { __print 1; }"), 100);
+  REQUIRE_FALSE(trace.finished);
+  REQUIRE(trace.steps == 100);
+}
+
+TEST_CASE("Runs out of steps are compared up to where they stopped.",
+          "[interpreter]") {
+  interpreter::Trace done{{"print 1", "print 2", "halt"}, true};
+  interpreter::Trace stopped{{"print 1"}, false};
+  interpreter::Trace longer{{"print 1", "print 2", "print 3"}, false};
+  interpreter::Trace failed{{"print 1", "error: Out of bounds fill."}, true};
+
+  REQUIRE(interpreter::sameBehaviour(done, done));
+  REQUIRE(interpreter::sameBehaviour(done, stopped));
+  REQUIRE(interpreter::sameBehaviour(stopped, longer));
+  REQUIRE(interpreter::sameBehaviour(stopped, failed));
+  REQUIRE_FALSE(interpreter::sameBehaviour(done, longer));
+  REQUIRE_FALSE(interpreter::sameBehaviour(done, failed));
+}
@@ -0,0 +1,284 @@
+#include "ast.hh"
+#include "lexer.hh"
+#include "parser.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const size_t STRESS_TERMS = 100000;
+
+static ast::ExprNodePtr parseExpr(const std::string &src)
+{
+  std::stringstream ss{src};
+  lexer::Lexer lexer{ss};
+  parser::Parser parser{lexer};
+  return parser.parseExpr();
+}
+
+static std::string parseError(const std::string &src)
+{
+  try
+  {
+    parseExpr(src);
+  }
+  catch (parser::ParserError &e)
+  {
+    return e.what();
+  }
+  return "";
+}
+
+TEST_CASE("Binary operators are right associative.", "[parser]") {
+  ast::ExprNodePtr expr = parseExpr("1 - 2 * 3 / 4 + 5 < 6");
+
+  auto *lt = dynamic_cast<ast::BinaryExprNode *>(expr.get());
+  REQUIRE(lt);
+  REQUIRE(lt->op == ast::BinaryExprNode::LESS);
+
+  // 1 - ((2 * (3 / 4)) + 5)
+  auto *sub = dynamic_cast<ast::BinaryExprNode *>(lt->left.get());
+  REQUIRE(sub);
+  REQUIRE(sub->op == ast::BinaryExprNode::SUB);
+  auto *add = dynamic_cast<ast::BinaryExprNode *>(sub->right.get());
+  REQUIRE(add);
+  REQUIRE(add->op == ast::BinaryExprNode::ADD);
+  auto *mul = dynamic_cast<ast::BinaryExprNode *>(add->left.get());
+  REQUIRE(mul);
+  REQUIRE(mul->op == ast::BinaryExprNode::MUL);
+  auto *div = dynamic_cast<ast::BinaryExprNode *>(mul->right.get());
+  REQUIRE(div);
+  REQUIRE(div->op == ast::BinaryExprNode::DIV);
+}
+
+TEST_CASE("Prefix operators bind tighter than binary operators.",
+          "[parser]") {
+  ast::ExprNodePtr expr = parseExpr("-(1 + 2) * not - 3");
+
+  auto *mul = dynamic_cast<ast::BinaryExprNode *>(expr.get());
+  REQUIRE(mul);
+  auto *minus = dynamic_cast<ast::UnaryExprNode *>(mul->left.get());
+  REQUIRE(minus);
+  REQUIRE(minus->op == ast::UnaryExprNode::MINUS);
+  REQUIRE(dynamic_cast<ast::BinaryExprNode *>(minus->operand.get()));
+  auto *notOp = dynamic_cast<ast::UnaryExprNode *>(mul->right.get());
+  REQUIRE(notOp);
+  REQUIRE(notOp->op == ast::UnaryExprNode::NOT);
+  REQUIRE(dynamic_cast<ast::UnaryExprNode *>(notOp->operand.get()));
+}
+
+TEST_CASE("Nodes are tagged with their kind.", "[parser]") {
+  ast::ExprNodePtr expr = parseExpr("a[1] + f(2.5)");
+
+  REQUIRE(expr->kind == ast::BINARY_EXPR_NODE);
+  auto *add = expr->as<ast::BinaryExprNode>();
+  REQUIRE(add == expr.get());
+  REQUIRE(expr->as<ast::UnaryExprNode>() == nullptr);
+
+  REQUIRE(add->left->is<ast::ArrayAccessNode>());
+  auto *access = add->left->as<ast::ArrayAccessNode>();
+  REQUIRE(access->array->is<ast::IdExprNode>());
+  REQUIRE(access->idx->is<ast::IntLiteralExprNode>());
+
+  auto *call = add->right->as<ast::FunctionCallNode>();
+  REQUIRE(call);
+  REQUIRE(call->args[0]->kind == ast::FLOAT_LITERAL_EXPR_NODE);
+
+  ast::ArrayTypeNode ints{std::make_unique<ast::IntTypeNode>(), Location{}};
+  ast::ArrayTypeNode floats{std::make_unique<ast::FloatTypeNode>(), Location{}};
+  REQUIRE(ints == *ints.copy());
+  REQUIRE(ints != floats);
+  REQUIRE(ast::IntTypeNode() != ints);
+}
+
+TEST_CASE("Unbalanced brackets are reported.", "[parser]") {
+  REQUIRE(parseError("(1 + 2;") ==
+          "Parser error at [1:6]-[1:7]: Mismatched bracket");
+  REQUIRE(parseError("(1 < 2 < 3)") ==
+          "Parser error at [1:7]-[1:8]: Mismatched bracket");
+  REQUIRE(parseError("1 + ;") ==
+          "Parser error at [1:4]-[1:5]: Failed in parseFactor");
+}
+
+TEST_CASE("Long operator chains are parsed.", "[parser][stress]") {
+  std::string src = "1";
+  for (size_t i = 1; i < STRESS_TERMS; i++)
+  {
+    src += i % 2 ? " + 1" : " * 1";
+  }
+
+  ast::ExprNodePtr expr = parseExpr(src + ";");
+
+  // every operator joins two terms.
+  size_t operators = 0;
+  std::vector<ast::ExprNode *> worklist{expr.get()};
+  while (!worklist.empty())
+  {
+    auto *binary = dynamic_cast<ast::BinaryExprNode *>(worklist.back());
+    worklist.pop_back();
+    if (binary)
+    {
+      operators++;
+      worklist.push_back(binary->left.get());
+      worklist.push_back(binary->right.get());
+    }
+  }
+  REQUIRE(operators == STRESS_TERMS - 1);
+  REQUIRE(expr->loc.ecol == src.size());
+
+}
+
+TEST_CASE("Deeply nested brackets and prefix operators are parsed.",
+          "[parser][stress]") {
+  std::string src = std::string(STRESS_TERMS, '(') + "1" +
+                    std::string(STRESS_TERMS, ')') + ";";
+  ast::ExprNodePtr expr = parseExpr(src);
+  REQUIRE(dynamic_cast<ast::IntLiteralExprNode *>(expr.get()));
+
+  src.clear();
+  for (size_t i = 0; i < STRESS_TERMS; i++)
+  {
+    src += "-(";
+  }
+  src += "1" + std::string(STRESS_TERMS, ')') + ";";
+
+  expr = parseExpr(src);
+  size_t depth = 0;
+  ast::ExprNode *node = expr.get();
+  while (auto *unary = dynamic_cast<ast::UnaryExprNode *>(node))
+  {
+    depth++;
+    node = unary->operand.get();
+  }
+  REQUIRE(depth == STRESS_TERMS);
+
+}
+
+TEST_CASE("Deeply nested calls, indices and builtins are parsed.",
+          "[parser][stress]") {
+  std::string src;
+  for (size_t i = 0; i < STRESS_TERMS; i++)
+  {
+    src += "f(";
+  }
+  src += "1" + std::string(STRESS_TERMS, ')') + ";";
+
+  ast::ExprNodePtr expr = parseExpr(src);
+  size_t depth = 0;
+  bool wellFormed = true;
+  ast::ExprNode *node = expr.get();
+  while (auto *call = dynamic_cast<ast::FunctionCallNode *>(node))
+  {
+    wellFormed &= call->args.size() == 1;
+    if (!wellFormed)
+    {
+      break;
+    }
+    depth++;
+    node = call->args[0].get();
+  }
+  REQUIRE(wellFormed);
+  REQUIRE(depth == STRESS_TERMS);
+  REQUIRE(expr->loc.ecol == src.size() - 1);
+
+  // each kind of operand opens its own subexpression.
+  src.clear();
+  for (size_t i = 0; i < STRESS_TERMS; i++)
+  {
+    const char *opens[] = {"a[", "__randi ", "g(0, ", "__float2int ",
+                           "__read 0, ", "__newarr int, "};
+    src += opens[i % 6];
+  }
+  src += "1";
+  for (size_t i = STRESS_TERMS; i-- > 0;)
+  {
+    src += i % 6 == 0 ? "]" : i % 6 == 2 ? ")" : "";
+  }
+
+  expr = parseExpr(src + ";");
+  depth = 0;
+  node = expr.get();
+  while (node)
+  {
+    ast::ExprNode *next = nullptr;
+    if (auto *access = dynamic_cast<ast::ArrayAccessNode *>(node))
+    {
+      next = access->idx.get();
+    }
+    else if (auto *randi = dynamic_cast<ast::RandiExprNode *>(node))
+    {
+      next = randi->operand.get();
+    }
+    else if (auto *call = dynamic_cast<ast::FunctionCallNode *>(node))
+    {
+      next = call->args.size() == 2 ? call->args[1].get() : nullptr;
+    }
+    else if (auto *f2i = dynamic_cast<ast::Float2IntNode *>(node))
+    {
+      next = f2i->operand.get();
+    }
+    else if (auto *read = dynamic_cast<ast::ReadExprNode *>(node))
+    {
+      next = read->y.get();
+    }
+    else if (auto *newarr = dynamic_cast<ast::NewArrExprNode *>(node))
+    {
+      next = newarr->operand.get();
+    }
+    if (!next)
+    {
+      break;
+    }
+    depth++;
+    node = next;
+  }
+  REQUIRE(depth == STRESS_TERMS);
+  REQUIRE(dynamic_cast<ast::IntLiteralExprNode *>(node));
+}
+
+TEST_CASE("Deeply nested statements are parsed.", "[parser][stress]") {
+  std::string src;
+  for (size_t i = 0; i < STRESS_TERMS; i++)
+  {
+    src += i % 2 == 0 ? "if (true) {" : "{";
+  }
+  src += "__print 1;" + std::string(STRESS_TERMS, '}') + " else { }";
+
+  std::stringstream ss{src};
+  lexer::Lexer lexer{ss};
+  parser::Parser parser{lexer};
+  std::unique_ptr<ast::TranslationUnit> tu = parser.parse();
+
+  REQUIRE(tu->stmts.size() == 1);
+  auto *outer = dynamic_cast<ast::IfElseStmt *>(tu->stmts[0].get());
+  REQUIRE(outer);
+  REQUIRE(outer->elseBody);
+
+  // every block holds exactly the next statement in.
+  size_t depth = 0;
+  bool wellFormed = true;
+  ast::StmtNode *node = outer;
+  while (true)
+  {
+    if (auto *block = dynamic_cast<ast::BlockStmt *>(node))
+    {
+      wellFormed &= block->stmts.size() == 1;
+      node = block->stmts[0].get();
+    }
+    else if (auto *ifElse = dynamic_cast<ast::IfElseStmt *>(node))
+    {
+      wellFormed &= ifElse == outer || ifElse->elseBody == nullptr;
+      node = ifElse->ifBody.get();
+    }
+    else
+    {
+      break;
+    }
+    depth++;
+  }
+  REQUIRE(wellFormed);
+  REQUIRE(depth == STRESS_TERMS + STRESS_TERMS / 2);
+  REQUIRE(dynamic_cast<ast::PrintStmt *>(node));
+}
@@ -0,0 +1,81 @@
+#include "pass_manager.hh"
+#include "thread_pool.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static codegen::PixIRCode makeCode(size_t nFuncs)
+{
+  codegen::PixIRCode code;
+  for (size_t i = 0; i < nFuncs; i++)
+  {
+    code.push_back(std::make_unique<codegen::PixIRFunction>(
+        codegen::PixIRFunction{"." + std::to_string(i), {}}));
+  }
+  return code;
+}
+
+static void runPasses(ThreadPool *pool)
+{
+  codegen::PixIRCode code = makeCode(100);
+  std::vector<size_t> blocksSeen;
+
+  codegen::PassManager passes{pool};
+  // each function pass adds a block, as long as it sees the blocks added
+  // before it.
+  passes.addFunctionPass([](codegen::PixIRFunction &func)
+                         { func.blocks.push_back(nullptr); });
+  passes.addFunctionPass([](codegen::PixIRFunction &func)
+                         {
+                           if (func.blocks.size() == 1)
+                           {
+                             func.blocks.push_back(nullptr);
+                           }
+                         });
+  // module passes see every function pass before them finished.
+  passes.addModulePass([&](codegen::PixIRCode &code)
+                       {
+                         for (auto &func : code)
+                         {
+                           blocksSeen.push_back(func->blocks.size());
+                         }
+                         code.pop_back();
+                       });
+  passes.addFunctionPass([](codegen::PixIRFunction &func)
+                         { func.blocks.push_back(nullptr); });
+  passes.run(code);
+
+  REQUIRE(blocksSeen == std::vector<size_t>(100, 2));
+  REQUIRE(code.size() == 99);
+  for (size_t i = 0; i < code.size(); i++)
+  {
+    REQUIRE(code[i]->funcName == "." + std::to_string(i));
+    REQUIRE(code[i]->blocks.size() == 3);
+  }
+}
+
+TEST_CASE("Passes run in order.", "[pass_manager]") {
+  runPasses(nullptr);
+
+  ThreadPool pool{4};
+  runPasses(&pool);
+}
+
+TEST_CASE("Errors in function passes are rethrown.", "[pass_manager]") {
+  ThreadPool pool{4};
+  codegen::PixIRCode code = makeCode(10);
+
+  codegen::PassManager passes{&pool};
+  passes.addFunctionPass([](codegen::PixIRFunction &func)
+                         {
+                           if (func.funcName == ".3")
+                           {
+                             throw std::logic_error("bad function");
+                           }
+                         });
+  REQUIRE_THROWS_AS(passes.run(code), std::logic_error);
+}
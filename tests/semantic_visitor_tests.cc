@@ -3,10 +3,15 @@
 #include "lexer.hh"
 #include "parser.hh"
 #include "semantic_visitor.hh"
+#include "thread_pool.hh"
 
 #include <catch2/catch_all.hpp>
 
+#include <algorithm>
 #include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #define TEST_SETUP(INPUT)                                                      \
   std::stringstream ss{(INPUT)};                                               \
@@ -22,27 +27,27 @@
 TEST_CASE("Semantic check for var declared float initialized with int works.",
           "[semantic]") {
   TEST_SETUP("let t0: float = 3;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 TEST_CASE("Semantic check for var declared int initialized with float works.",
           "[semantic]") {
   TEST_SETUP("let t0: int = 3.0;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 TEST_CASE(
     "Semantic check for var declared float initialized with colour works.",
     "[semantic]") {
   TEST_SETUP("let t0: float = #00ff00;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 // other semantic checks for initialization
 
 TEST_CASE("Semantic check for double-definition of vars works.", "[semantic]") {
   TEST_SETUP("let t0: float = 0.0; let t0: int = 3;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 // semantic type checks for assignment
@@ -50,26 +55,26 @@ TEST_CASE("Semantic check for double-definition of vars works.", "[semantic]") {
 TEST_CASE("Semantic check for var declared float assigned with int works.",
           "[semantic]") {
   TEST_SETUP("let t0: float = 3.0; t0 = 4;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 TEST_CASE("Semantic check for var declared int assigned with float works.",
           "[semantic]") {
   TEST_SETUP("let t0: int = 3; t0 = 4.0;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 TEST_CASE("Semantic check for var declared float assigned with colour works.",
           "[semantic]") {
   TEST_SETUP("let t0: float = 3.0; t0 = #00ff00;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 // other semantic checks for assignment
 
 TEST_CASE("Semantic check for undeclared var assigned works.", "[semantic]") {
   TEST_SETUP("t0 = 3;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 // semantic type checks for binary operators.
@@ -77,11 +82,112 @@ TEST_CASE("Semantic check for undeclared var assigned works.", "[semantic]") {
 TEST_CASE("Semantic check for int + float works.", "[semantic]") {
 
   TEST_SETUP("let t0: int = 3; let t1 : float = 4.0; let t2: float = t0 + t1;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
 }
 
 TEST_CASE("Semantic check for float + int works.", "[semantic]") {
 
   TEST_SETUP("let t0: int = 3; let t1 : float = 4.0; let t2: float = t1 + t0;");
-  REQUIRE_THROWS_AS(v.visit(*tu), ast::SemanticError);
+  REQUIRE_THROWS_AS(tu->accept(&v), ast::SemanticError);
+}
+
+// function bodies are checked after the rest of the program, possibly on a
+// thread pool.
+
+struct Checked
+{
+  std::unique_ptr<ast::TranslationUnit> tu;
+  ast::SymbolTable symbolTable;
+  std::string error;
+};
+
+static Checked check(const std::string &src, ThreadPool *pool)
+{
+  std::stringstream ss{src};
+  lexer::Lexer lexer{ss};
+  parser::Parser parser{lexer};
+  Checked checked{parser.parse()};
+  ast::SemanticVisitor v{checked.symbolTable, pool};
+  try
+  {
+    checked.tu->accept(&v);
+  }
+  catch (ast::SemanticError &e)
+  {
+    checked.error = e.what();
+  }
+  return checked;
+}
+
+TEST_CASE("Function bodies only see what was declared before them.",
+          "[semantic]") {
+  ThreadPool pool{4};
+  for (ThreadPool *p : {static_cast<ThreadPool *>(nullptr), &pool})
+  {
+    REQUIRE(check("fun f() -> int { return x; } let x: int = 1;", p).error ==
+            "Semantic error at [1:24]-[1:25]: Symbol x is not in scope.");
+    REQUIRE(
+        check("let x: int = 1; fun f() -> int { return x; }", p).error.empty());
+    REQUIRE_FALSE(check("fun f() -> int { return g(); } "
+                        "fun g() -> int { return 1; }",
+                        p)
+                      .error.empty());
+    REQUIRE(check("fun g() -> int { return 1; } "
+                  "fun f(n: int) -> int { return f(n) + g(); }",
+                  p)
+                .error.empty());
+  }
+}
+
+TEST_CASE("The first semantic error is reported when bodies are checked in "
+          "parallel.",
+          "[semantic]") {
+  std::string src;
+  for (int i = 0; i < 40; i++)
+  {
+    // f10 and f30 fail, as does the statement between them.
+    std::string ret = i == 10 || i == 30 ? "1.0" : "n";
+    src += "fun f" + std::to_string(i) +
+           "(n: int) -> int { let a: int = n; return " + ret + "; }\n";
+    if (i == 20)
+    {
+      src += "let bad: bool = 1;\n";
+    }
+  }
+
+  ThreadPool pool{4};
+  std::string expected = check(src, nullptr).error;
+  REQUIRE(expected.rfind("Semantic error at [11:", 0) == 0);
+  REQUIRE(check(src, &pool).error == expected);
+}
+
+TEST_CASE("Checking bodies in parallel fills in the same symbol table.",
+          "[semantic]") {
+  std::string src = "let g: int = 2;\n";
+  for (int i = 0; i < 40; i++)
+  {
+    src += "fun f" + std::to_string(i) +
+           "(n: int) -> int { for (let i: int = 0; i < n; i = i + 1) { "
+           "let x: int = i * g; } return n; }\n";
+  }
+
+  // the two runs parse separate ASTs, so scopes are matched by location.
+  auto scopes = [](const ast::SymbolTable &table)
+  {
+    std::vector<std::tuple<uint32_t, uint32_t, size_t>> scopes;
+    for (auto &[stmt, scope] : table)
+    {
+      scopes.emplace_back(stmt->loc.sline, stmt->loc.scol,
+                          scope->symbols.size());
+    }
+    std::sort(scopes.begin(), scopes.end());
+    return scopes;
+  };
+
+  ThreadPool pool{4};
+  Checked sequential = check(src, nullptr), parallel = check(src, &pool);
+  REQUIRE(sequential.error.empty());
+  REQUIRE(parallel.error.empty());
+  REQUIRE(sequential.symbolTable.size() == 161);
+  REQUIRE(scopes(parallel.symbolTable) == scopes(sequential.symbolTable));
 }
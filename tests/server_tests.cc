@@ -0,0 +1,81 @@
+#include "framing.hh"
+#include "server.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <sstream>
+#include <string>
+
+static std::string frame(const std::string &field)
+{
+  return std::to_string(field.size()) + "\n" + field;
+}
+
+static server::CompileResponse readResponse(std::istream &in)
+{
+  server::CompileResponse resp;
+  std::string status;
+  REQUIRE(framing::readField(in, status));
+  REQUIRE(framing::readField(in, resp.asmOutput));
+  REQUIRE(framing::readField(in, resp.xmlOutput));
+  REQUIRE(framing::readField(in, resp.diagnostics));
+  resp.ok = status == "ok";
+  return resp;
+}
+
+TEST_CASE("Compile server answers every request in order.", "[server]") {
+  std::stringstream in{frame("") + frame("let x: int = 1;") +
+                       frame("-fpeephole-optimize") + frame("let x: int = ;")};
+  std::stringstream out;
+
+  server::serve(in, out);
+
+  server::CompileResponse first = readResponse(out);
+  REQUIRE(first.ok);
+  REQUIRE(first.asmOutput.find(".main") != std::string::npos);
+  REQUIRE(first.xmlOutput.find("<TranslationUnit") != std::string::npos);
+  REQUIRE(first.diagnostics.empty());
+
+  server::CompileResponse second = readResponse(out);
+  REQUIRE_FALSE(second.ok);
+  REQUIRE(second.asmOutput.empty());
+  REQUIRE(second.diagnostics.find("Parser error") != std::string::npos);
+
+  std::string extra;
+  REQUIRE_FALSE(framing::readField(out, extra));
+}
+
+TEST_CASE("Compile server rejects unknown options.", "[server]") {
+  server::CompileResponse resp =
+      server::handleRequest({"-fno-such-flag", "let x: int = 1;"});
+  REQUIRE_FALSE(resp.ok);
+  REQUIRE(resp.diagnostics.find("-fno-such-flag") != std::string::npos);
+}
+
+TEST_CASE("Compile server rejects truncated requests.", "[server]") {
+  std::stringstream in{frame("") + "100\nlet x"};
+  std::stringstream out;
+  REQUIRE_THROWS_AS(server::serve(in, out), framing::FramingError);
+}
+
+TEST_CASE("Compile server exports only the requested part of the AST.",
+          "[server]") {
+  const std::string src = "fun f() -> int { return 1 + 2; }\n"
+                          "fun g() -> int { return 3; }\n"
+                          "__print f();";
+
+  server::CompileResponse resp = server::handleRequest({"-xml-func g", src});
+  REQUIRE(resp.ok);
+  REQUIRE(resp.xmlOutput.find("<FuncDeclStmt") ==
+          resp.xmlOutput.rfind("<FuncDeclStmt"));
+  REQUIRE(resp.xmlOutput.find("3</IntLiteralExprNode>") != std::string::npos);
+  REQUIRE(resp.xmlOutput.find("PrintStmt") == std::string::npos);
+
+  resp = server::handleRequest({"-xml-depth 1", src});
+  REQUIRE(resp.ok);
+  REQUIRE(resp.xmlOutput.find("truncated=\"true\"") != std::string::npos);
+  REQUIRE(resp.xmlOutput.find("ReturnStmt") == std::string::npos);
+
+  resp = server::handleRequest({"-xml-func h", src});
+  REQUIRE_FALSE(resp.ok);
+}
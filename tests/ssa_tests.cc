@@ -0,0 +1,325 @@
+#include "codegen.hh"
+#include "interpreter.hh"
+#include "ssa.hh"
+#include "test_helpers.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using codegen::PixIROpcode;
+
+// a block holding the given code, e.g. {{PixIROpcode::PUSH, "1"}}.
+static std::unique_ptr<codegen::BasicBlock>
+makeBlock(std::list<codegen::PixIRInstruction> &&instrs)
+{
+  auto block = std::make_unique<codegen::BasicBlock>();
+  block->instrs = std::move(instrs);
+  return block;
+}
+
+static std::string toString(const std::list<codegen::PixIRInstruction> &instrs)
+{
+  std::string result;
+  for (const codegen::PixIRInstruction &instr : instrs)
+  {
+    result += instr.to_string() + "; ";
+  }
+  return result;
+}
+
+TEST_CASE("Blocks are lifted to SSA form.", "[ssa]") {
+  // print ([0] - 2), with a value left on the stack by an earlier block.
+  auto block = makeBlock({{PixIROpcode::PUSH, "2"},
+                          {PixIROpcode::PUSH, "[0]"},
+                          {PixIROpcode::SUB},
+                          {PixIROpcode::PRINT},
+                          {PixIROpcode::PUSH, "1"},
+                          {PixIROpcode::ADD}});
+  codegen::SSABlock ssa{*block};
+  REQUIRE(ssa.valid());
+
+  const auto &nodes = ssa.nodes();
+  REQUIRE(nodes.size() == 6);
+  // the left operand is on top of the stack.
+  REQUIRE(nodes[2].operands ==
+          std::vector<size_t>{nodes[1].results[0], nodes[0].results[0]});
+  REQUIRE(nodes[3].operands == std::vector<size_t>{nodes[2].results[0]});
+  REQUIRE(ssa.value(nodes[0].results[0]).constant == "2");
+  REQUIRE(!ssa.value(nodes[2].results[0]).constant);
+
+  REQUIRE(ssa.inputs().size() == 1);
+  REQUIRE(ssa.value(ssa.inputs()[0]).def == codegen::SSABlock::NONE);
+  REQUIRE(nodes[5].operands[1] == ssa.inputs()[0]);
+  REQUIRE(ssa.outputs() == std::vector<size_t>{nodes[5].results[0]});
+
+  // nothing can be improved.
+  REQUIRE(toString(ssa.schedule()) == toString(block->instrs));
+}
+
+TEST_CASE("Constants are folded and propagated through slots.", "[ssa]") {
+  // [0] = 2 * 3; print [0] - 0; print 1 - [1] < 2.
+  auto block = makeBlock({{PixIROpcode::PUSH, "3"},
+                          {PixIROpcode::PUSH, "2"},
+                          {PixIROpcode::MUL},
+                          {PixIROpcode::PUSH, "0"},
+                          {PixIROpcode::PUSH, "0"},
+                          {PixIROpcode::ST},
+                          {PixIROpcode::PUSH, "0"},
+                          {PixIROpcode::PUSH, "[0]"},
+                          {PixIROpcode::SUB},
+                          {PixIROpcode::PRINT},
+                          {PixIROpcode::PUSH, "2"},
+                          {PixIROpcode::PUSH, "[1]"},
+                          {PixIROpcode::PUSH, "1"},
+                          {PixIROpcode::SUB},
+                          {PixIROpcode::LT},
+                          {PixIROpcode::PRINT}});
+  codegen::SSABlock ssa{*block};
+  REQUIRE(ssa.valid());
+  // 1 - [1] may be negative, so it isn't folded.
+  REQUIRE(toString(ssa.schedule()) ==
+          "push 6; push 0; push 0; st; push 6; print; "
+          "push 2; push [1]; push 1; sub; lt; print; ");
+
+  // a store to another frame, or a call, may change the slot.
+  for (PixIROpcode opcode : {PixIROpcode::OFRAME, PixIROpcode::CALL})
+  {
+    auto changed = makeBlock({{PixIROpcode::PUSH, "1"},
+                              {PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::ST},
+                              {PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::PUSH, ".f"},
+                              {opcode},
+                              {PixIROpcode::PUSH, "[0]"},
+                              {PixIROpcode::PRINT}});
+    REQUIRE(toString(codegen::SSABlock{*changed}.schedule()) ==
+            toString(changed->instrs));
+  }
+}
+
+TEST_CASE("Values computed twice in a row are copied.", "[ssa]") {
+  // print ([0] + [1]) * ([0] + [1]), then the same after a store to [1].
+  std::list<codegen::PixIRInstruction> square{
+      {PixIROpcode::PUSH, "[1]"}, {PixIROpcode::PUSH, "[0]"},
+      {PixIROpcode::ADD},         {PixIROpcode::PUSH, "[1]"},
+      {PixIROpcode::PUSH, "[0]"}, {PixIROpcode::ADD},
+      {PixIROpcode::MUL},         {PixIROpcode::PRINT}};
+  auto block = makeBlock(std::list<codegen::PixIRInstruction>(square));
+  block->instrs.push_back({PixIROpcode::PUSH, "5"});
+  block->instrs.push_back({PixIROpcode::PUSH, "1"});
+  block->instrs.push_back({PixIROpcode::PUSH, "0"});
+  block->instrs.push_back({PixIROpcode::ST});
+  block->instrs.insert(block->instrs.end(), square.begin(), square.end());
+
+  codegen::PixIRFunction func;
+  func.blocks.push_back(std::move(block));
+  codegen::ssaOptimize(func);
+  REQUIRE(toString(func.blocks[0]->instrs) ==
+          "push [1]; push [0]; add; dup; mul; print; "
+          "push 5; push 1; push 0; st; "
+          "push 5; push [0]; add; dup; mul; print; ");
+}
+
+TEST_CASE("Calls to pure functions are reused.", "[ssa]") {
+  // print .f([0]) + .f([0]), store .f([0]) to [1], then print .f([0]).
+  std::list<codegen::PixIRInstruction> call{{PixIROpcode::PUSH, "[0]"},
+                                            {PixIROpcode::PUSH, "1"},
+                                            {PixIROpcode::PUSH, ".f"},
+                                            {PixIROpcode::CALL}};
+  std::list<codegen::PixIRInstruction> instrs = call;
+  instrs.insert(instrs.end(), call.begin(), call.end());
+  instrs.push_back({PixIROpcode::ADD});
+  instrs.push_back({PixIROpcode::PRINT});
+  instrs.insert(instrs.end(), call.begin(), call.end());
+  instrs.push_back({PixIROpcode::PUSH, "1"});
+  instrs.push_back({PixIROpcode::PUSH, "0"});
+  instrs.push_back({PixIROpcode::ST});
+  instrs.insert(instrs.end(), call.begin(), call.end());
+  instrs.push_back({PixIROpcode::PRINT});
+  auto block = makeBlock(std::move(instrs));
+
+  // calls to other functions may store to any slot.
+  REQUIRE(toString(codegen::SSABlock{*block}.schedule()) ==
+          toString(block->instrs));
+  REQUIRE(toString(codegen::SSABlock{*block, {}, {".g"}}.schedule()) ==
+          toString(block->instrs));
+
+  REQUIRE(toString(codegen::SSABlock{*block, {}, {".f"}}.schedule()) ==
+          "push [0]; push 1; push .f; call; dup; add; print; "
+          "push [0]; push 1; push .f; call; push 1; push 0; st; "
+          "push [1]; print; ");
+}
+
+TEST_CASE("Constants are propagated across branches.", "[ssa]") {
+  codegen::PixIRCode code =
+      generate("let x: int = 3;\n"
+               "let debug: bool = false;\n"
+               "if (__width > 5) { x = 3; } else { __print 0; }\n"
+               "if (x == 3) { __print 1; } else { __print 2; }\n"
+               "while (debug) { __print 3; }\n"
+               "__print x;");
+  codegen::PixIRFunction &main = *code[0];
+  // else arms come before if arms.
+  REQUIRE(printed(main) == "0 2 1 3 [1] ");
+  interpreter::Trace before = interpreter::run(code);
+
+  codegen::propagateConstants(main);
+  // x is 3 whichever arm of the first if is taken.
+  REQUIRE(printed(main) == "0 1 3 ");
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+}
+
+TEST_CASE("CJMP branches on false constants.", "[ssa]") {
+  for (PixIROpcode jump : {PixIROpcode::CJMP, PixIROpcode::CJMP2})
+  {
+    // [0] = 0, then jump on [0] to a block printing 2, else print 1.
+    codegen::PixIRFunction func;
+    for (int i = 0; i < 3; i++)
+    {
+      func.blocks.push_back(makeBlock({}));
+    }
+    func.blocks[0]->instrs = {{PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::PUSH, "0"},
+                              {PixIROpcode::ST},
+                              {PixIROpcode::PUSH, "[0]"},
+                              {PixIROpcode::PUSH, func.blocks[2].get()},
+                              {jump}};
+    func.blocks[1]->instrs = {{PixIROpcode::PUSH, "1"},
+                              {PixIROpcode::PRINT},
+                              {PixIROpcode::HALT}};
+    func.blocks[2]->instrs = {{PixIROpcode::PUSH, "2"},
+                              {PixIROpcode::PRINT},
+                              {PixIROpcode::HALT}};
+
+    codegen::propagateConstants(func);
+    REQUIRE(printed(func) == (jump == PixIROpcode::CJMP ? "2 " : "1 "));
+  }
+}
+
+TEST_CASE("Values changed by loops aren't constants.", "[ssa]") {
+  codegen::PixIRCode code = generate("let i: int = 0;\n"
+                                     "let n: int = 3;\n"
+                                     "while (i < n) { i = i + 1; }\n"
+                                     "__print i;\n"
+                                     "__print n;");
+  codegen::PixIRFunction &main = *code[0];
+  size_t blocks = main.blocks.size();
+  interpreter::Trace before = interpreter::run(code);
+
+  codegen::propagateConstants(main);
+  REQUIRE(main.blocks.size() == blocks);
+  REQUIRE(printed(main) == "[0] 3 ");
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+}
+
+// the labels of the functions called by func, in the order of the calls.
+static std::string called(const codegen::PixIRFunction &func)
+{
+  std::string result;
+  const codegen::PixIRInstruction *last = nullptr;
+  for (const std::unique_ptr<codegen::BasicBlock> &block : func.blocks)
+  {
+    for (const codegen::PixIRInstruction &instr : block->instrs)
+    {
+      if (instr.opcode == PixIROpcode::CALL && last)
+      {
+        result += std::get<std::string>(last->data) + " ";
+      }
+      last = &instr;
+    }
+  }
+  return result;
+}
+
+TEST_CASE("Functions are specialized on constant arguments.", "[ssa]") {
+  codegen::PixIRCode code =
+      generate("fun show(x: int, verbose: bool) -> int {\n"
+               "  if (verbose) { __print 1; } else { __print 2; }\n"
+               "  __print x;\n"
+               "  return 0;\n"
+               "}\n"
+               "let r: int = show(5, true);\n"
+               "r = show(__width, true);\n"
+               "r = show(6, false);\n"
+               "r = show(__width, __width > 3);\n"
+               "r = show(5, true);");
+  interpreter::Trace before = interpreter::run(code);
+  codegen::specializeFunctions(code);
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+
+  // calls with the same constants share a clone, and the generic version is
+  // kept for the call without any.
+  REQUIRE(code.size() == 5);
+  REQUIRE(called(*code[0]) ==
+          ".show_1 .show_2 .show_3 .show .show_1 ");
+  REQUIRE(printed(*code[2]) == "1 5 ");
+  REQUIRE(printed(*code[4]) == "2 6 ");
+  REQUIRE(code[0]->callees.size() == 5);
+  REQUIRE(std::count(code[0]->callees.begin(), code[0]->callees.end(),
+                     ".show") == 1);
+}
+
+TEST_CASE("Pure calls in loops are memoized.", "[ssa]") {
+  codegen::PixIRCode code =
+      generate("fun sum(n: int) -> int {\n"
+               "  let s: int = 0;\n"
+               "  for (let i: int = 0; i < n; i = i + 1) { s = s + i; }\n"
+               "  return s;\n"
+               "}\n"
+               "fun show(n: int) -> int {\n"
+               "  for (let i: int = 0; i < n; i = i + 1) { __print i; }\n"
+               "  return n;\n"
+               "}\n"
+               "fun add(a: int, b: int) -> int { return sum(a) + b; }\n"
+               "fun sums(n: int) -> int {\n"
+               "  let s: int = 0;\n"
+               "  for (let i: int = 0; i < n; i = i + 1) { s = s + sum(i); }\n"
+               "  return s;\n"
+               "}\n"
+               "let t: int = sum(3) + sums(2);\n"
+               "for (let k: int = 0; k < 9; k = k + 1) {\n"
+               "  t = t + sum(k) + show(k) + add(k, 1);\n"
+               "}\n"
+               "__print t;");
+  codegen::PixIRFunction &main = *code[0];
+  REQUIRE(called(main) == ".sums .sum .add .show .sum ");
+  size_t blocks = main.blocks.size();
+  interpreter::Trace before = interpreter::run(code);
+
+  // the call out of the loop, and those to impure functions or with more
+  // arguments, are left alone, as are the calls of other functions. The call
+  // in the loop is made if the argument is out of the table's range, or if
+  // it isn't in the table yet.
+  codegen::memoizePureCalls(code);
+  REQUIRE(interpreter::sameBehaviour(before, interpreter::run(code)));
+  REQUIRE(called(main) == ".sums .sum .add .show .sum .sum ");
+  REQUIRE(std::count(main.callees.begin(), main.callees.end(), ".sum") == 3);
+  for (size_t func = 1; func < code.size(); func++)
+  {
+    const std::string &name = code[func]->funcName;
+    REQUIRE(called(*code[func]) ==
+            (name == ".add" || name == ".sums" ? ".sum " : ""));
+  }
+
+  // the entry makes the table, and a loop clears its flags before the
+  // rest of the entry runs, as the VM can't load elements never stored.
+  REQUIRE(main.blocks.size() == blocks + 7);
+  REQUIRE(toString(main.blocks[0]->instrs) ==
+          "push 3; alloc; push 512; alloca; push 2; push 0; st; "
+          "push 0; push 1; push 0; st; ");
+  std::list<codegen::PixIRInstruction> loop = main.blocks[1]->instrs;
+  REQUIRE(loop.back().opcode == PixIROpcode::CJMP2);
+  loop.pop_back();
+  REQUIRE(std::get<codegen::BasicBlock *>(loop.back().data) ==
+          main.blocks[1].get());
+  loop.pop_back();
+  REQUIRE(toString(loop) ==
+          "push 0; push 256; push [1]; add; push [2]; sta; "
+          "push 1; push [1]; add; push 1; push 0; st; "
+          "push 256; push [1]; lt; ");
+}
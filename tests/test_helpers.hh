@@ -0,0 +1,65 @@
+#ifndef TEST_HELPERS_H_
+#define TEST_HELPERS_H_
+
+#include "codegen.hh"
+#include "compiler.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "semantic_visitor.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+// generates the code of a program without linearizing it.
+inline codegen::PixIRCode generate(const std::string &src,
+                                   bool rotateLoops = false)
+{
+  std::stringstream ss{src};
+  lexer::Lexer lexer{ss};
+  parser::Parser parser{lexer};
+  std::unique_ptr<ast::TranslationUnit> tu = parser.parse();
+
+  ast::SymbolTable symbolTable;
+  ast::SemanticVisitor semanticChecker{symbolTable};
+  tu->accept(&semanticChecker);
+
+  codegen::CodeGenerator codeGenerator{symbolTable,
+                                       {.rotateLoops = rotateLoops}};
+  tu->accept(&codeGenerator);
+  return std::move(codeGenerator.code());
+}
+
+// compiles a program which must compile, optimizing and linearizing its code
+// as opts say.
+inline codegen::PixIRCode compiled(const std::string &src,
+                                   const CompilerOptions &opts = {})
+{
+  pixelc::CompilationResult result = pixelc::compile(src, opts);
+  REQUIRE(result.success);
+  return std::move(result.code);
+}
+
+// the operands printed by a function, in the order they appear. This only
+// inspects the code; run it with interpreter::run() to check what it does.
+inline std::string printed(const codegen::PixIRFunction &func)
+{
+  std::string result;
+  const codegen::PixIRInstruction *last = nullptr;
+  for (const std::unique_ptr<codegen::BasicBlock> &block : func.blocks)
+  {
+    for (const codegen::PixIRInstruction &instr : block->instrs)
+    {
+      if (instr.opcode == codegen::PixIROpcode::PRINT && last)
+      {
+        result += std::get<std::string>(last->data) + " ";
+      }
+      last = &instr;
+    }
+  }
+  return result;
+}
+
+#endif // TEST_HELPERS_H_
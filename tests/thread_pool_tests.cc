@@ -0,0 +1,30 @@
+#include "thread_pool.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <vector>
+
+TEST_CASE("parallelFor runs every index exactly once.", "[thread_pool]") {
+  ThreadPool pool{4};
+  std::vector<std::atomic<int>> hits(1000);
+
+  pool.parallelFor(hits.size(), [&](size_t i) { hits[i]++; });
+
+  for (std::atomic<int> &hit : hits) {
+    REQUIRE(hit == 1);
+  }
+}
+
+TEST_CASE("ThreadPool can be reused after wait().", "[thread_pool]") {
+  ThreadPool pool{2};
+  std::atomic<int> count = 0;
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 10; i++) {
+      pool.submit([&] { count++; });
+    }
+    pool.wait();
+    REQUIRE(count == 10 * (round + 1));
+  }
+}
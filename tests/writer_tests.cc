@@ -0,0 +1,38 @@
+#include "writer.hh"
+
+#include <catch2/catch_all.hpp>
+
+#include <sstream>
+#include <string>
+
+TEST_CASE("Buffered writer only reaches the sink when flushed.", "[writer]") {
+  std::string out;
+  BufferedWriter w{out};
+
+  w.indent(2) << "x = " << -42 << '\n';
+  REQUIRE(out.empty());
+
+  w.flush();
+  REQUIRE(out == "  x = -42\n");
+}
+
+TEST_CASE("Buffered writer handles output larger than its buffer.",
+          "[writer]") {
+  std::ostringstream out;
+  std::string expected;
+  {
+    BufferedWriter w{out};
+    std::string line(1000, 'a');
+    line += '\n';
+    for (int i = 0; i < 200; i++)
+    {
+      w << line;
+      expected += line;
+    }
+    w.indent(BufferedWriter::BUFFER_SIZE + 3);
+    expected.append(BufferedWriter::BUFFER_SIZE + 3, ' ');
+    w << std::string(BufferedWriter::BUFFER_SIZE * 2, 'b');
+    expected.append(BufferedWriter::BUFFER_SIZE * 2, 'b');
+  }
+  REQUIRE(out.str() == expected);
+}